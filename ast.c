@@ -2,33 +2,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include "lexer.h"
 #include "ast.h"
 #include "interpreter.h"
+#include "bytecode.h"
+#include "function.h"
+#include "optimize.h"
 #include "colors.h"
 #include "error_handling.h"
-// #include "debug_alloc.h"
-
-extern Token* tokens;
-extern int token_count;
-
-extern char *keywords[];
-extern char **lines;
-extern const int num_keywords;
-
-extern int error;
-extern int debug;
-extern int script_;
-extern int line_count;
-extern int current_line;
-
-int current = 0;
+#include "context.h"
+#include "stats.h"
+#include "hooks.h"
+#include "debug_alloc.h"
 
 int get_precedence(char op) {
     switch (op) {
         case '*': case '/': return 6;
         case '+': case '-': return 5;
-        case '>': case '<': case 'g': case 'e': case 'l': case 'n': return 4;
+        case '>': case '<': case 'g': case 'e': case 'l': case 'n': case 'i': return 4;
         case '!': return 3;
         case '&': return 2; 
         case '|': return 1;
@@ -53,108 +45,209 @@ const char* AST_node_name(ASTNodeType type) {
         case AST_ELIF: return "ELIF";
         case AST_ELSE: return "ELSE";
         case AST_WHILE : return "WHILE";
+        case AST_FOR : return "FOR";
         case AST_BLOCK: return "BLOCK";
+        case AST_CACHED: return "CACHED";
+        case AST_SCOPE: return "SCOPE";
+        case AST_LIST: return "LIST";
+        case AST_DICT: return "DICT";
+        case AST_INDEX: return "INDEX";
+        case AST_INDEX_ASSIGN: return "INDEX_ASSIGN";
+        case AST_CALL: return "CALL";
+        case AST_DEF: return "DEF";
+        case AST_RETURN: return "RETURN";
+        case AST_LOCAL: return "LOCAL";
+        case AST_CLASS: return "CLASS";
+        case AST_ATTR: return "ATTR";
+        case AST_ATTR_ASSIGN: return "ATTR_ASSIGN";
         default: return "UNKNOWN";
     }
 }
 
-Token peek(){
-    return tokens[current];
+Token peek(Interpreter* interp){
+    return interp->tokens[interp->current];
 }
 
-Token advance(){
-    return tokens[current++];
+Token advance(Interpreter* interp){
+    return interp->tokens[interp->current++];
 }
 
-void print_ast_debug(ASTNode* node, int indent, int is_last) {
+void print_ast_debug(FILE* out, ASTNode* node, int indent, int is_last) {
     if (!node) return;
 
     // Print branch lines
     for (int i = 0; i < indent - 1; i++) {
-        printf("%c   ", 179); // '│'
+        fprintf(out, "%c   ", 179); // '│'
     }
     if (indent > 0) {
-        printf("%c%c ", is_last ? 192 : 195, 196); // '└─' or '├─'
+        fprintf(out, "%c%c ", is_last ? 192 : 195, 196); // '└─' or '├─'
     }
     
-    printf("%s", AST_node_name(node->type));
+    fprintf(out, "%s", AST_node_name(node->type));
 
     switch (node->type) {
         case AST_OPERATOR:
-            printf(" '%c'\n", node->operate.op);
-            print_ast_debug(node->operate.left, indent + 1, 0);
-            print_ast_debug(node->operate.right, indent + 1, 1);
+            fprintf(out, " '%c'\n", node->operate.op);
+            print_ast_debug(out, node->operate.left, indent + 1, 0);
+            print_ast_debug(out, node->operate.right, indent + 1, 1);
             break;
 
         case AST_NUMERIC:
         case AST_FLOATING_POINT:
         case AST_BOOLEAN:
         case AST_STRING:
-            printf(" ");
-            print_literal(node->literal);
+            fprintf(out, " ");
+            fprint_literal(out, node->literal);
             break;
 
         case AST_IDENTIFIER:
-            printf(" %s\n", node->name);
+            fprintf(out, " %s\n", node->name);
+            break;
+
+        case AST_LOCAL:
+            fprintf(out, " %s #%d\n", node->local.name, node->local.slot);
+            break;
+
+        case AST_DEF: {
+            Function* fn = node->function;
+            fprintf(out, " %s(", fn->name);
+            for (int i = 0; i < fn->param_count; i++) fprintf(out, "%s%s", i ? ", " : "", fn->locals[i]);
+            fprintf(out, ") %d locals\n", fn->local_count);
+            print_ast_debug(out, fn->body, indent + 1, 1);
+            break;
+        }
+
+        case AST_RETURN:
+            fprintf(out, "\n");
+            print_ast_debug(out, node->ret.value, indent + 1, 1);
+            break;
+
+        case AST_CLASS:
+            fprintf(out, " %s\n", node->classdef.name);
+            print_ast_debug(out, node->classdef.body, indent + 1, 1);
+            break;
+
+        case AST_ATTR:
+            fprintf(out, " .%s @%d\n", node->attr.name, node->attr.site);
+            print_ast_debug(out, node->attr.object, indent + 1, 1);
+            break;
+
+        case AST_ATTR_ASSIGN:
+            fprintf(out, " .%s '%c' @%d\n", node->attr.name, node->attr.op, node->attr.site);
+            print_ast_debug(out, node->attr.object, indent + 1, 0);
+            print_ast_debug(out, node->attr.value, indent + 1, 1);
             break;
 
         case AST_PASS:
-            printf("\n");
+            fprintf(out, "\n");
             break;
         
         case AST_BREAK:
-            printf("\n");
+            fprintf(out, "\n");
             break;
 
         case AST_PRINT:
-            printf("\n");
-            print_ast_debug(node->print.value, indent + 1, 1);
+            fprintf(out, "\n");
+            print_ast_debug(out, node->print.value, indent + 1, 1);
             break;
 
         case AST_ASSIGNMENT:
-            printf("\n");
-            print_ast_debug(node->assign.value, indent + 1, 1);
+            fprintf(out, "\n");
+            print_ast_debug(out, node->assign.value, indent + 1, 1);
             break;
 
         case AST_IF:
         case AST_ELIF:
-            printf("\n");
-            for (int i = 0; i < indent; i++) printf("%c   ", 179);
-            printf("%c%c [IF_CONDITION]\n", 195, 196);
-            print_ast_debug(node->construct.condition, indent + 2, 1);
+            fprintf(out, "\n");
+            for (int i = 0; i < indent; i++) fprintf(out, "%c   ", 179);
+            fprintf(out, "%c%c [IF_CONDITION]\n", 195, 196);
+            print_ast_debug(out, node->construct.condition, indent + 2, 1);
 
-            for (int i = 0; i < indent; i++) printf("%c   ", 179);
-            printf("%c%c [IF_BODY]\n", 195, 196);
-            print_ast_debug(node->construct.code, indent + 2, 1);
+            for (int i = 0; i < indent; i++) fprintf(out, "%c   ", 179);
+            fprintf(out, "%c%c [IF_BODY]\n", 195, 196);
+            print_ast_debug(out, node->construct.code, indent + 2, 1);
 
-            if (node->construct.next) print_ast_debug(node->construct.next, indent, 1);
+            if (node->construct.next) print_ast_debug(out, node->construct.next, indent, 1);
             break;
 
         case AST_ELSE:
-            printf("\n");
-            print_ast_debug(node->construct.code, indent + 1, 0);
+            fprintf(out, "\n");
+            print_ast_debug(out, node->construct.code, indent + 1, 0);
             break;
 
         case AST_WHILE:
-            printf("\n");
-            for (int i = 0; i < indent; i++) printf("%c   ", 179);
-            printf("%c%c [WHILE_CONDITION]\n", 195, 196);
-            print_ast_debug(node->construct.condition, indent + 2, 1);
+            fprintf(out, "\n");
+            for (int i = 0; i < indent; i++) fprintf(out, "%c   ", 179);
+            fprintf(out, "%c%c [WHILE_CONDITION]\n", 195, 196);
+            print_ast_debug(out, node->construct.condition, indent + 2, 1);
+
+            for (int i = 0; i < indent; i++) fprintf(out, "%c   ", 179);
+            fprintf(out, "%c%c [WHILE_BODY]\n", 195, 196);
+            print_ast_debug(out, node->construct.code, indent + 2, 1);
+            break;
+
+        case AST_FOR:
+            fprintf(out, " %s\n", node->construct.name);
+            for (int i = 0; i < indent; i++) fprintf(out, "%c   ", 179);
+            fprintf(out, "%c%c [FOR_RANGE]\n", 195, 196);
+            print_ast_debug(out, node->construct.condition, indent + 2, 1);
 
-            for (int i = 0; i < indent; i++) printf("%c   ", 179);
-            printf("%c%c [WHILE_BODY]\n", 195, 196);
-            print_ast_debug(node->construct.code, indent + 2, 1);
+            for (int i = 0; i < indent; i++) fprintf(out, "%c   ", 179);
+            fprintf(out, "%c%c [FOR_BODY]\n", 195, 196);
+            print_ast_debug(out, node->construct.code, indent + 2, 1);
             break;
         
+        case AST_CACHED:
+            fprintf(out, " #%d\n", node->cached.slot);
+            print_ast_debug(out, node->cached.expr, indent + 1, 1);
+            break;
+
+        case AST_SCOPE:
+            fprintf(out, " #%d..#%d\n", node->scope.first, node->scope.first + node->scope.count - 1);
+            print_ast_debug(out, node->scope.body, indent + 1, 1);
+            break;
+
+        case AST_LIST:
+        case AST_DICT:
+            fprintf(out, "\n");
+            for (int i = 0; i < node->list.count; i++) {
+                print_ast_debug(out, node->list.items[i], indent + 1, (i == node->list.count - 1));
+            }
+            break;
+
+        case AST_INDEX:
+            fprintf(out, "\n");
+            print_ast_debug(out, node->index.target, indent + 1, 0);
+            print_ast_debug(out, node->index.index, indent + 1, 1);
+            break;
+
+        case AST_INDEX_ASSIGN:
+            fprintf(out, " '%c'\n", node->index.op);
+            print_ast_debug(out, node->index.target, indent + 1, 0);
+            print_ast_debug(out, node->index.index, indent + 1, 0);
+            print_ast_debug(out, node->index.value, indent + 1, 1);
+            break;
+
+        case AST_CALL:
+            fprintf(out, " %s%s\n", node->call.method ? "." : "", node->call.name);
+            for (int i = 0; i < node->call.count; i++) {
+                print_ast_debug(out, node->call.args[i], indent + 1, (i == node->call.count - 1));
+            }
+            break;
+
         case AST_BLOCK:
-            printf("\n");
+            if (node->block.lazy) {
+                fprintf(out, " (lines %d-%d not parsed)\n", node->block.lazy_start + 1, node->block.lazy_end);
+                break;
+            }
+            fprintf(out, "\n");
             for (int i = 0; i < node->block.count; i++) {
-                print_ast_debug(node->block.statements[i], indent + 1, (i == node->block.count - 1));
+                print_ast_debug(out, node->block.statements[i], indent + 1, (i == node->block.count - 1));
             }
             break;
 
         default:
-            printf("\n");
+            fprintf(out, "\n");
             break;
     }
 }
@@ -208,6 +301,16 @@ void ast_free(ASTNode *node) {
         case AST_WHILE:
             ast_free(node->construct.condition);
             ast_free(node->construct.code);
+            ast_free(node->construct.next);
+            chunk_free(node->construct.chunk);
+            break;
+
+        case AST_FOR:
+            free(node->construct.name);
+            ast_free(node->construct.condition);
+            ast_free(node->construct.code);
+            ast_free(node->construct.next);
+            chunk_free(node->construct.chunk);
             break;
 
         case AST_BLOCK:
@@ -217,6 +320,61 @@ void ast_free(ASTNode *node) {
             free(node->block.statements);
             break;
 
+        case AST_CACHED:
+            ast_free(node->cached.expr);
+            break;
+
+        case AST_SCOPE:
+            ast_free(node->scope.body);
+            break;
+
+        case AST_LIST:
+        case AST_DICT:
+            for (int i = 0; i < node->list.count; i++) {
+                ast_free(node->list.items[i]);
+            }
+            free(node->list.items);
+            break;
+
+        case AST_INDEX:
+        case AST_INDEX_ASSIGN:
+            ast_free(node->index.target);
+            ast_free(node->index.index);
+            ast_free(node->index.value);
+            break;
+
+        case AST_CALL:
+            free(node->call.name);
+            for (int i = 0; i < node->call.count; i++) {
+                ast_free(node->call.args[i]);
+            }
+            free(node->call.args);
+            break;
+
+        case AST_DEF:
+            if (node->function) function_release(node->function);
+            break;
+
+        case AST_RETURN:
+            ast_free(node->ret.value);
+            break;
+
+        case AST_LOCAL:
+            free(node->local.name);
+            break;
+
+        case AST_CLASS:
+            free(node->classdef.name);
+            ast_free(node->classdef.body);
+            break;
+
+        case AST_ATTR:
+        case AST_ATTR_ASSIGN:
+            ast_free(node->attr.object);
+            free(node->attr.name);
+            ast_free(node->attr.value);
+            break;
+
         default:
             break;
     }
@@ -226,41 +384,43 @@ void ast_free(ASTNode *node) {
     free(node);
 }
 
-ASTNode* new_node(){
-    ASTNode* node = malloc(sizeof(ASTNode));
+ASTNode* new_node(Interpreter* interp){
+    ASTNode* node = calloc(1, sizeof(ASTNode));
     if (!node) {
-        raiseError(MEMORY_ERROR, "Out of memory");
+        raiseError(interp, MEMORY_ERROR, "Out of memory");
         return NULL;
     }
+    if (interp->script && interp->current_line > 0) node->line = interp->line_numbers[interp->current_line - 1];
+    interp->stats.nodes++;
     return node;
 }
 
-ASTNode* parse_pass() {
-    ASTNode* node = new_node();
+ASTNode* parse_pass(Interpreter* interp) {
+    ASTNode* node = new_node(interp);
     if (!node) return NULL;
     node->type = AST_PASS;
     return node;
 }
 
-ASTNode* parse_break() {
-    ASTNode* node = new_node();
+ASTNode* parse_break(Interpreter* interp) {
+    ASTNode* node = new_node(interp);
     if (!node) return NULL;
     node->type = AST_BREAK;
     return node;
 }
 
-ASTNode* parse_none() {
-    advance();
-    ASTNode* node = new_node();
+ASTNode* parse_none(Interpreter* interp) {
+    advance(interp);
+    ASTNode* node = new_node(interp);
     if (!node) return NULL;
     node->type = AST_NONE;
     node->literal.datatype = NONE;
     return node;
 }
 
-ASTNode* parse_numeric() {
-    Token tok = advance();
-    ASTNode* node = new_node();
+ASTNode* parse_numeric(Interpreter* interp) {
+    Token tok = advance(interp);
+    ASTNode* node = new_node(interp);
     if (!node) return NULL;
     node->type = AST_NUMERIC;
     char *end;
@@ -270,9 +430,9 @@ ASTNode* parse_numeric() {
     return node;
 }
 
-ASTNode* parse_floating_point() {
-    Token tok = advance();
-    ASTNode* node = new_node();
+ASTNode* parse_floating_point(Interpreter* interp) {
+    Token tok = advance(interp);
+    ASTNode* node = new_node(interp);
     if (!node) return NULL;
     node->type = AST_FLOATING_POINT;
     char *end;
@@ -282,9 +442,9 @@ ASTNode* parse_floating_point() {
     return node;
 }
 
-ASTNode* parse_string() {
-    Token tok = advance();
-    ASTNode* node = new_node();
+ASTNode* parse_string(Interpreter* interp) {
+    Token tok = advance(interp);
+    ASTNode* node = new_node(interp);
     if (!node) return NULL;
     node->type = AST_STRING;
     node->literal.datatype = STRING;
@@ -292,9 +452,9 @@ ASTNode* parse_string() {
     return node;
 }
 
-ASTNode* parse_boolean() {
-    Token tok = advance();
-    ASTNode* node = new_node();
+ASTNode* parse_boolean(Interpreter* interp) {
+    Token tok = advance(interp);
+    ASTNode* node = new_node(interp);
     if (!node) return NULL;
     char* end;
     node->type = AST_BOOLEAN;
@@ -307,60 +467,251 @@ ASTNode* parse_boolean() {
     return node;
 }
 
-ASTNode* parse_identifier() {
-    Token tok = advance();
-    ASTNode* node = new_node();
+ASTNode* parse_identifier(Interpreter* interp) {
+    Token tok = advance(interp);
+    ASTNode* node = new_node(interp);
     if (!node) return NULL;
     node->type = AST_IDENTIFIER;
     node->name = strdup(tok.text);
     return node;
 }
 
-ASTNode* parse_paren() {
-    advance();//consume '(' token
-    ASTNode* node = parse_expression();
+ASTNode* parse_paren(Interpreter* interp) {
+    advance(interp);//consume '(' token
+    ASTNode* node = parse_expression(interp);
+    if (!node) return NULL;
+    if (peek(interp).type != TOKEN_RPAREN) {
+        raiseError(interp, SYNTAX_ERROR, "Unmatched '('");
+        ast_free(node);
+        return NULL;
+    }
+    advance(interp);//consume ')' token
+    return node;
+}
+
+// Comma-separated expressions up to the close token, which is consumed
+// along with them; the opening token already has been. first, if given,
+// becomes the first item. Frees everything and returns 0 on an error.
+static int parse_items(Interpreter* interp, ASTNode* first, TokenType close, const char* unmatched,
+                       ASTNode*** items, int* count){
+    int capacity = 0;
+    *items = NULL;
+    *count = 0;
+    ASTNode* item = first;
+    while (item || peek(interp).type != close) {
+        if (!item) {
+            item = parse_expression(interp);
+            if (!item) goto fail;
+            if (peek(interp).type == TOKEN_COMMA) {
+                advance(interp);
+            } else if (peek(interp).type != close) {
+                ast_free(item);
+                raiseError(interp, SYNTAX_ERROR, (char*)unmatched);
+                goto fail;
+            }
+        }
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 4;
+            ASTNode** tmp = realloc(*items, sizeof(ASTNode*) * capacity);
+            if (!tmp) {
+                ast_free(item);
+                raiseError(interp, MEMORY_ERROR, "Out of memory");
+                goto fail;
+            }
+            *items = tmp;
+        }
+        (*items)[(*count)++] = item;
+        item = NULL;
+    }
+    advance(interp);
+    return 1;
+
+    fail:
+        for (int i = 0; i < *count; i++) ast_free((*items)[i]);
+        free(*items);
+        *items = NULL;
+        *count = 0;
+        return 0;
+}
+
+ASTNode* parse_list(Interpreter* interp) {
+    advance(interp); // consume '['
+    ASTNode* node = new_node(interp);
+    if (!node) return NULL;
+    node->type = AST_LIST;
+    if (!parse_items(interp, NULL, TOKEN_BRACKET_CLOSE, "Unmatched '['", &node->list.items, &node->list.count)) {
+        ast_free(node);
+        return NULL;
+    }
+    return node;
+}
+
+// {key: value, ...}; the items alternate keys and values
+ASTNode* parse_dict(Interpreter* interp) {
+    advance(interp); // consume '{'
+    ASTNode* node = new_node(interp);
     if (!node) return NULL;
-    if (peek().type != TOKEN_RPAREN) {
-        raiseError(SYNTAX_ERROR, "Unmatched '('");
+    node->type = AST_DICT;
+    int capacity = 0;
+    while (peek(interp).type != TOKEN_BRACE_CLOSE) {
+        if (node->list.count == capacity) {
+            capacity = capacity ? capacity * 2 : 8;
+            ASTNode** tmp = realloc(node->list.items, sizeof(ASTNode*) * capacity);
+            if (!tmp) {
+                raiseError(interp, MEMORY_ERROR, "Out of memory");
+                goto fail;
+            }
+            node->list.items = tmp;
+        }
+        ASTNode* key = parse_expression(interp);
+        if (!key) goto fail;
+        node->list.items[node->list.count++] = key;
+        if (advance(interp).type != TOKEN_COLON) {
+            raiseError(interp, SYNTAX_ERROR, "Expected ':' after dict key");
+            goto fail;
+        }
+        ASTNode* value = parse_expression(interp);
+        if (!value) goto fail;
+        node->list.items[node->list.count++] = value;
+        if (peek(interp).type == TOKEN_COMMA) {
+            advance(interp);
+        } else if (peek(interp).type != TOKEN_BRACE_CLOSE) {
+            raiseError(interp, SYNTAX_ERROR, "Unmatched '{'");
+            goto fail;
+        }
+    }
+    advance(interp); // consume '}'
+    return node;
+
+    fail:
+        ast_free(node);
+        return NULL;
+}
+
+static Builtin find_builtin(const char* name, int method){
+    if (method) {
+        if (strcmp(name, "append") == 0) return BUILTIN_APPEND;
+    } else {
+        if (strcmp(name, "len") == 0) return BUILTIN_LEN;
+    }
+    return BUILTIN_NONE;
+}
+
+// name(args) or, with an object, object.name(args)
+ASTNode* parse_call(Interpreter* interp, ASTNode* object) {
+    ASTNode* node = new_node(interp);
+    if (!node) {
+        ast_free(object);
+        return NULL;
+    }
+    node->type = AST_CALL;
+    node->call.name = strdup(advance(interp).text);
+    node->call.method = object != NULL;
+    node->call.builtin = find_builtin(node->call.name, node->call.method);
+    if (node->call.method) node->call.site = interp->site_count++;
+    advance(interp); // consume '('
+    if (!parse_items(interp, object, TOKEN_RPAREN, "Unmatched '('", &node->call.args, &node->call.count)) {
+        ast_free(node);
         return NULL;
     }
-    advance();//consume ')' token
     return node;
 }
 
-ASTNode* parse_primary() {
-    Token tok = peek();
+// Indexing, attributes and method calls following a primary: a[i], p.x,
+// a.append(x)
+ASTNode* parse_postfix(Interpreter* interp, ASTNode* node) {
+    while (node) {
+        if (peek(interp).type == TOKEN_BRACKET_OPEN) {
+            advance(interp); // consume '['
+            ASTNode* index = parse_expression(interp);
+            if (!index) {
+                ast_free(node);
+                return NULL;
+            }
+            if (peek(interp).type != TOKEN_BRACKET_CLOSE) {
+                ast_free(node);
+                ast_free(index);
+                raiseError(interp, SYNTAX_ERROR, "Unmatched '['");
+                return NULL;
+            }
+            advance(interp); // consume ']'
+            ASTNode* access = new_node(interp);
+            if (!access) {
+                ast_free(node);
+                ast_free(index);
+                return NULL;
+            }
+            access->type = AST_INDEX;
+            access->index.target = node;
+            access->index.index = index;
+            node = access;
+        } else if (peek(interp).type == TOKEN_DOT) {
+            advance(interp); // consume '.'
+            if (peek(interp).type != TOKEN_IDENTIFIER) {
+                ast_free(node);
+                raiseError(interp, SYNTAX_ERROR, "Expected an attribute name after '.'");
+                return NULL;
+            }
+            if (interp->tokens[interp->current + 1].type == TOKEN_LPAREN) {
+                node = parse_call(interp, node);
+                continue;
+            }
+            ASTNode* access = new_node(interp);
+            if (!access) {
+                ast_free(node);
+                return NULL;
+            }
+            access->type = AST_ATTR;
+            access->attr.object = node;
+            access->attr.name = strdup(advance(interp).text);
+            access->attr.site = interp->site_count++;
+            node = access;
+        } else {
+            break;
+        }
+    }
+    return node;
+}
+
+ASTNode* parse_primary(Interpreter* interp) {
+    Token tok = peek(interp);
     switch (tok.type){
-        case TOKEN_NONE: return parse_none();
-        case TOKEN_NUMERIC: return parse_numeric();
-        case TOKEN_FLOATING_POINT: return parse_floating_point();
-        case TOKEN_STRING: return parse_string();
-        case TOKEN_BOOLEAN: return parse_boolean();
-        case TOKEN_IDENTIFIER: return parse_identifier();
-        case TOKEN_LPAREN: return parse_paren();
+        case TOKEN_NONE: return parse_none(interp);
+        case TOKEN_NUMERIC: return parse_numeric(interp);
+        case TOKEN_FLOATING_POINT: return parse_floating_point(interp);
+        case TOKEN_STRING: return parse_postfix(interp, parse_string(interp));
+        case TOKEN_BOOLEAN: return parse_boolean(interp);
+        case TOKEN_IDENTIFIER:
+            if (interp->tokens[interp->current + 1].type == TOKEN_LPAREN) return parse_postfix(interp, parse_call(interp, NULL));
+            return parse_postfix(interp, parse_identifier(interp));
+        case TOKEN_LPAREN: return parse_postfix(interp, parse_paren(interp));
+        case TOKEN_BRACKET_OPEN: return parse_postfix(interp, parse_list(interp));
+        case TOKEN_BRACE_OPEN: return parse_postfix(interp, parse_dict(interp));
         case TOKEN_SEMICOLON: return NULL;
         case TOKEN_COLON: return NULL;
         default: return NULL;
     }
 }
 
-ASTNode* parse_expression_prec(int min_prec);
+ASTNode* parse_expression_prec(Interpreter* interp, int min_prec);
 
-ASTNode* parse_expression() {
-    return parse_expression_prec(0);
+ASTNode* parse_expression(Interpreter* interp) {
+    return parse_expression_prec(interp, 0);
 }
 
-ASTNode* parse_expression_prec(int min_prec) {
-    ASTNode* left = parse_primary();
+ASTNode* parse_expression_prec(Interpreter* interp, int min_prec) {
+    ASTNode* left = parse_primary(interp);
     if (!left){
-        if(peek().type == TOKEN_OPERATOR){
-            if(peek().text[0] == '+' || peek().text[0] == '-'){
-                left = new_node();
+        if(peek(interp).type == TOKEN_OPERATOR){
+            if(peek(interp).text[0] == '+' || peek(interp).text[0] == '-'){
+                left = new_node(interp);
+                if (!left) return NULL;
                 left->type = AST_NUMERIC;
                 left->literal.datatype = INT;
                 left->literal.numeric = 0;
-            }else if(peek().text[0] == '!'){
-                left = new_node();
+            }else if(peek(interp).text[0] == '!'){
+                left = new_node(interp);
+                if (!left) return NULL;
                 left->type = AST_BOOLEAN;
                 left->literal.datatype = BOOLEAN;
                 left->literal.boolean = 1;
@@ -369,28 +720,32 @@ ASTNode* parse_expression_prec(int min_prec) {
             }
         }else{
             syntax_error:
-                raiseError(SYNTAX_ERROR, "Missing left operand");
+                raiseError(interp, SYNTAX_ERROR, "Missing left operand");
                 return NULL;
         }
     }
-    while (peek().type == TOKEN_OPERATOR) {
-        char op = peek().text[0];
+    while (peek(interp).type == TOKEN_OPERATOR) {
+        char op = peek(interp).text[0];
         int prec = get_precedence(op);
 
         if (prec < min_prec) break;
 
-        advance(); // consume operator
+        advance(interp); // consume operator
 
         // precedence climbing: right side must be at least prec + 1
-        ASTNode* right = parse_expression_prec(prec + 1);
+        ASTNode* right = parse_expression_prec(interp, prec + 1);
         if (!right) {
             ast_free(left);
-            raiseError(SYNTAX_ERROR, "Expected expression after operator");
+            raiseError(interp, SYNTAX_ERROR, "Expected expression after operator");
             return NULL;
         }
 
-        ASTNode* node = new_node();
-        if (!node) return NULL;
+        ASTNode* node = new_node(interp);
+        if (!node){
+            ast_free(left);
+            ast_free(right);
+            return NULL;
+        }
         node->type = AST_OPERATOR;
         node->operate.op = op;
         node->operate.left = left;
@@ -401,37 +756,48 @@ ASTNode* parse_expression_prec(int min_prec) {
     return left;
 }
 
-ASTNode* parse_assignment() {
-    char *name = strdup(advance().text);
-    char op = advance().text[0]; // '='
+ASTNode* parse_assignment(Interpreter* interp) {
+    const char* text = advance(interp).text;
+    char op = advance(interp).text[0]; // '='
     
     ASTNode* value;
     if (op == '='){
-        value = parse_expression();
+        value = parse_expression(interp);
     } else {
-        ASTNode* sub_node = new_node();
+        ASTNode* sub_node = new_node(interp);
         if (!sub_node) return NULL;
         sub_node->type = AST_OPERATOR;
         sub_node->operate.op = op;
-        ASTNode* id = new_node();
-        if (!id) return NULL;
+        ASTNode* id = new_node(interp);
+        if (!id){
+            free(sub_node);
+            return NULL;
+        }
         id->type = AST_IDENTIFIER;
-        id->name = strdup(name);
+        id->name = strdup(text);
         sub_node->operate.left = id;
-        sub_node->operate.right = parse_expression();
+        sub_node->operate.right = parse_expression(interp);
         value = sub_node;
     }
 
-    ASTNode* node = new_node();
-    if (!node) return NULL;
+    ASTNode* node = new_node(interp);
+    char* name = strdup(text);
+    if (!node || !name){
+        free(node);
+        free(name);
+        ast_free(value);
+        if (!interp->error) raiseError(interp, MEMORY_ERROR, "Out of memory");
+        return NULL;
+    }
     node->type = AST_ASSIGNMENT;
     node->assign.name = name;
     node->assign.value = value;
+    node->assign.slot = -1;
     return node;
 }
 
-ASTNode* new_block() {
-    ASTNode* node = new_node();
+ASTNode* new_block(Interpreter* interp) {
+    ASTNode* node = new_node(interp);
     if (!node) return NULL;
     node->type = AST_BLOCK;
     node->block.count = 0;
@@ -439,14 +805,14 @@ ASTNode* new_block() {
     return node;
 }
 
-ASTNode* update_block(ASTNode* block_node, ASTNode* stmt){
+ASTNode* update_block(Interpreter* interp, ASTNode* block_node, ASTNode* stmt){
     block_node->block.count++;
     ASTNode** tmp = realloc(
         block_node->block.statements,
         sizeof(ASTNode*) * block_node->block.count
     );
     if (!tmp) {
-        raiseError(MEMORY_ERROR,"Out of memory");
+        raiseError(interp, MEMORY_ERROR,"Out of memory");
         ast_free(stmt);
         ast_free(block_node);
         return NULL;
@@ -456,16 +822,127 @@ ASTNode* update_block(ASTNode* block_node, ASTNode* stmt){
     return block_node;
 }
 
-int block(ASTNode* parent_node, int parent_indent){
-    ASTNode* block_node = new_block();
+static int is_chain_line(const char* line, const char* keyword){
+    while (isspace((unsigned char)*line)) line++;
+    size_t len = strlen(keyword);
+    return strncmp(line, keyword, len) == 0 && !isalnum((unsigned char)line[len]) && line[len] != '_';
+}
+
+// Pre-parse mode: the body is only scanned for its extent (the lines
+// indented deeper than the header) and parsed the first time it runs.
+// The elif/else that continues the chain is still parsed here so the
+// construct keeps its shape.
+int parse_block(Interpreter* interp, ASTNode* parent_node, int parent_indent);
+
+int lazy_block(Interpreter* interp, ASTNode* parent_node, int parent_indent){
+    int start = interp->current_line;
+    int end = start;
+    while (end < interp->line_count && count_indent(interp->lines[end]) > parent_indent) end++;
+
+    reset_tokens(interp);
+    allocate_tokens(interp);
+
+    if (end == start) {
+        raiseError(interp, SYNTAX_ERROR,"Block of statements missing");
+        add_token(interp, TOKEN_EOF, "", 0);
+        return 0;
+    }
+
+    ASTNode* block_node = new_block(interp);
+    if (!block_node) {
+        add_token(interp, TOKEN_EOF, "", 0);
+        return 0;
+    }
+    block_node->block.lazy = 1;
+    block_node->block.lazy_start = start;
+    block_node->block.lazy_end = end;
+    block_node->block.lazy_indent = parent_indent;
+    parent_node->construct.code = block_node;
+    interp->current_line = end;
+
+    int chains = 0;
+    if (end < interp->line_count && count_indent(interp->lines[end]) == parent_indent) {
+        int is_if = parent_node->type == AST_IF || parent_node->type == AST_ELIF;
+        chains = (is_if && is_chain_line(interp->lines[end], "elif")) ||
+                 ((is_if || parent_node->type == AST_WHILE || parent_node->type == AST_FOR) && is_chain_line(interp->lines[end], "else"));
+    }
+    if (!chains) {
+        add_token(interp, TOKEN_EOF, "", 0);
+        return 1;
+    }
+
+    interp->current_line++;
+    interp->error_line = interp->line_numbers[end];
+    tokenize_line(interp, end);
+    HOOK(HOOK_TOKENS, hook_tokens(interp, interp->tokens, interp->token_count));
+    if (interp->error) return 0;
+    while (peek(interp).type == TOKEN_INDENT) advance(interp);
+    ASTNode* stmt = parse_statement(interp, parent_node);
+    if (!stmt) return 0;
+    parent_node->construct.next = stmt;
+    return 1;
+}
+
+// Parses a body left behind by lazy_block() in place, so later runs see a
+// normal block. The surrounding token and line state is preserved. This
+// runs during evaluation: the parser reports errors through the flag, so
+// the error frame is set aside and a failure is re-raised afterwards.
+int parse_lazy_block(Interpreter* interp, ASTNode* node){
+    ErrorFrame* saved_frame = interp->error_frame;
+    int saved_error_line = interp->error_line;
+    interp->error_frame = NULL;
+    Token* saved_tokens = interp->tokens;
+    int saved_token_count = interp->token_count;
+    int saved_current = interp->current;
+    int saved_line = interp->current_line;
+    int saved_line_count = interp->line_count;
+
+    interp->tokens = NULL;
+    interp->token_count = 0;
+    interp->current = 0;
+    interp->current_line = node->block.lazy_start;
+    interp->line_count = node->block.lazy_end;
+
+    ASTNode holder = {0}; // stands in for the construct owning the body
+    holder.type = AST_ELSE;
+    int ok = parse_block(interp, &holder, node->block.lazy_indent);
+
+    int failed = interp->error;
+    reset_tokens(interp);
+    interp->error = failed;
+    interp->tokens = saved_tokens;
+    interp->token_count = saved_token_count;
+    interp->current = saved_current;
+    interp->current_line = saved_line;
+    interp->line_count = saved_line_count;
+    interp->error_frame = saved_frame;
+    interp->error_line = saved_error_line;
+
+    if (!ok || interp->error){
+        error_throw(interp);
+        return 0;
+    }
+    ASTNode* body = holder.construct.code;
+    node->block.statements = body->block.statements;
+    node->block.count = body->block.count;
+    node->block.lazy = 0;
+    free(body);
+    for (int i = 0; i < node->block.count; i++) {
+        node->block.statements[i] = optimize(interp, node->block.statements[i]);
+    }
+    return 1;
+}
+
+int parse_block(Interpreter* interp, ASTNode* parent_node, int parent_indent){
+    ASTNode* block_node = new_block(interp);
     if (!block_node) goto mistake;
 
     char input[255];
 
     while (1) {
-        reset_tokens();
+        reset_tokens(interp);
 
-        if (!script_) {
+        if (!interp->script) {
             printf(MAG "... " RESET);
             
             if (!fgets(input, sizeof input, stdin)) goto end;
@@ -474,136 +951,148 @@ int block(ASTNode* parent_node, int parent_indent){
             // Check empty line -> end of block
             if (strlen(input) == 0) {
                 if (block_node->block.count == 0){
-                    raiseError(SYNTAX_ERROR,"Block of statements missing");
+                    raiseError(interp, SYNTAX_ERROR,"Block of statements missing");
                     goto mistake;
                 }
-                allocate_tokens();
-                add_token(TOKEN_EOF, "", 0);
+                allocate_tokens(interp);
+                add_token(interp, TOKEN_EOF, "", 0);
                 goto end;
             }
             
-            allocate_tokens();
-            tokenize(input);
+            allocate_tokens(interp);
+            tokenize(interp, input);
             
-            if (debug){ printf("Tokens:\n"); print_tokens_debug();}
-            if (error) goto mistake;
+            HOOK(HOOK_TOKENS, hook_tokens(interp, interp->tokens, interp->token_count));
+            if (interp->error) goto mistake;
 
-            while(peek().type != TOKEN_EOF){        
+            while(peek(interp).type != TOKEN_EOF){        
                 int indent = 0;
-                while(peek().type == TOKEN_INDENT){
-                    advance();
+                while(peek(interp).type == TOKEN_INDENT){
+                    advance(interp);
                     indent++;
                 }
                 // printf("%d %d\n",global_indent,indent);
 
                 if (indent < parent_indent){
                     if (block_node->block.count == 0){
-                        raiseError(SYNTAX_ERROR,"Block of statements missing");
+                        raiseError(interp, SYNTAX_ERROR,"Block of statements missing");
                         goto mistake;
                     }
+                    interp->current = 0; // the enclosing block counts the indent again
                     goto end;
                 }
-                ASTNode* stmt = parse_statement(parent_node);
+                ASTNode* stmt = parse_statement(interp, parent_node);
                 if (!stmt) goto mistake;
+                if (interp->error){ ast_free(stmt); goto mistake;}
 
                 if (stmt->type == AST_ELIF || stmt->type == AST_ELSE) {
                     if (parent_node && (parent_node->type == AST_IF || parent_node->type == AST_ELIF) && indent == parent_indent) {
                         parent_node->construct.next = stmt; // connect ELSE to IF
                         goto end;
-                    } else if (stmt->type == AST_ELSE && parent_node && (parent_node->type == AST_WHILE) && indent == parent_indent) {
+                    } else if (stmt->type == AST_ELSE && parent_node && (parent_node->type == AST_WHILE || parent_node->type == AST_FOR) && indent == parent_indent) {
                         parent_node->construct.next = stmt; // connect ELSE to IF
                         goto end;
                     }else {
                         ast_free(stmt);
                         goto mistake;
                     }
-                } else if (stmt->type == AST_IF || stmt->type == AST_WHILE) {
-                    if (!update_block(block_node,stmt)) goto mistake;
+                } else if (stmt->type == AST_IF || stmt->type == AST_WHILE || stmt->type == AST_FOR || stmt->type == AST_DEF || stmt->type == AST_CLASS) {
+                    if (!update_block(interp, block_node,stmt)) goto mistake;
                 } else {
                     // Normal statement
                     if (indent <= parent_indent){
+                        ast_free(stmt); // the enclosing block parses the line again
                         if (block_node->block.count == 0){
-                            raiseError(SYNTAX_ERROR,"Improper Indentation");
+                            raiseError(interp, SYNTAX_ERROR,"Improper Indentation");
                             goto mistake;
                         }
-                        current = 0;
+                        interp->current = 0;
                         goto end;
                     }
-                    if (!update_block(block_node,stmt)) goto mistake;
+                    if (!update_block(interp, block_node,stmt)) goto mistake;
                 }
             }
         } else {
-            if (current_line >= line_count){
-                allocate_tokens();
-                add_token(TOKEN_EOF, "", 0);
+            if (interp->current_line >= interp->line_count){
+                allocate_tokens(interp);
+                add_token(interp, TOKEN_EOF, "", 0);
                 goto end;
             }
-            strcpy(input,lines[current_line]);
-            current_line++;
+            interp->current_line++;
+            interp->error_line = interp->line_numbers[interp->current_line - 1];
 
-            allocate_tokens();
-            tokenize(input);
+            allocate_tokens(interp);
+            tokenize_line(interp, interp->current_line - 1);
             
-            if (debug){ printf("Tokens:\n"); print_tokens_debug();}
-            if (error) goto mistake;
+            HOOK(HOOK_TOKENS, hook_tokens(interp, interp->tokens, interp->token_count));
+            if (interp->error) goto mistake;
 
-            while(peek().type != TOKEN_EOF){        
+            while(peek(interp).type != TOKEN_EOF){        
                 int indent = 0;
-                while(peek().type == TOKEN_INDENT){
-                    advance();
+                while(peek(interp).type == TOKEN_INDENT){
+                    advance(interp);
                     indent++;
                 }
                 // printf("%d %d\n",global_indent,indent);
 
                 if (indent < parent_indent){
                     if (block_node->block.count == 0){
-                        raiseError(SYNTAX_ERROR,"Block of statements missing");
+                        raiseError(interp, SYNTAX_ERROR,"Block of statements missing");
                         goto mistake;
                     }
+                    interp->current = 0; // the enclosing block counts the indent again
                     goto end;
                 }
-                int lc = current_line-1;
-                ASTNode* stmt = parse_statement(parent_node);
+                if (indent == parent_indent && peek(interp).type == TOKEN_KEYWORD &&
+                    (strcmp(peek(interp).text, "if") == 0 || strcmp(peek(interp).text, "while") == 0 ||
+                     strcmp(peek(interp).text, "for") == 0 || strcmp(peek(interp).text, "def") == 0 ||
+                     strcmp(peek(interp).text, "class") == 0)) {
+                    // A sibling construct ends this body; leave its line for the caller
+                    interp->current_line--;
+                    reset_tokens(interp);
+                    allocate_tokens(interp);
+                    add_token(interp, TOKEN_EOF, "", 0);
+                    goto end;
+                }
+                ASTNode* stmt = parse_statement(interp, parent_node);
                 if (!stmt) goto mistake;
+                if (interp->error){ ast_free(stmt); goto mistake;}
 
                 if (stmt->type == AST_ELIF || stmt->type == AST_ELSE) {
                     if (parent_node && (parent_node->type == AST_IF || parent_node->type == AST_ELIF) && indent == parent_indent) {
                         parent_node->construct.next = stmt; // connect ELSE to IF
                         goto end;
-                    } else if (stmt->type == AST_ELSE && parent_node && (parent_node->type == AST_WHILE) && indent == parent_indent) {
+                    } else if (stmt->type == AST_ELSE && parent_node && (parent_node->type == AST_WHILE || parent_node->type == AST_FOR) && indent == parent_indent) {
                         parent_node->construct.next = stmt; // connect ELSE to IF
                         goto end;
                     } else {
                         ast_free(stmt);
                         goto mistake;
                     }
-                } else if (stmt->type == AST_IF || stmt->type == AST_WHILE) {
-                    if (indent == parent_indent) {
-                        ast_free(stmt);
-                        current_line = lc;
-                        goto end;
-                    } else {
-                        if (!update_block(block_node,stmt)) goto mistake;
-                    }
+                } else if (stmt->type == AST_IF || stmt->type == AST_WHILE || stmt->type == AST_FOR || stmt->type == AST_DEF || stmt->type == AST_CLASS) {
+                    if (!update_block(interp, block_node,stmt)) goto mistake;
                 } else {
                     // Normal statement
                     if (indent <= parent_indent){
+                        ast_free(stmt); // the enclosing block parses the line again
                         if (block_node->block.count == 0){
-                            raiseError(SYNTAX_ERROR,"Improper Indentation");
+                            raiseError(interp, SYNTAX_ERROR,"Improper Indentation");
                             goto mistake;
                         }
-                        current = 0;
+                        interp->current = 0;
                         goto end;
                     }
-                    if (!update_block(block_node,stmt)) goto mistake;
+                    if (!update_block(interp, block_node,stmt)) goto mistake;
                 }
             }
         }
     }
     mistake:
-        reset_tokens();
-        allocate_tokens();
-        add_token(TOKEN_EOF, "", 0);
+        int failed = interp->error;
+        reset_tokens(interp);
+        interp->error = failed; // reset_tokens() clears it, but the caller must see it
+        allocate_tokens(interp);
+        add_token(interp, TOKEN_EOF, "", 0);
         ast_free(block_node);
         return 0;
     end:
@@ -611,152 +1100,400 @@ int block(ASTNode* parent_node, int parent_indent){
         return 1;
 }
 
-ASTNode* parse_if(){
+int block(Interpreter* interp, ASTNode* parent_node, int parent_indent){
+    if (interp->script && interp->lazy_parse) return lazy_block(interp, parent_node, parent_indent);
+    return parse_block(interp, parent_node, parent_indent);
+}
+
+ASTNode* parse_if(Interpreter* interp){
     int indent = 0, j = 0;
-    while (tokens[j].type == TOKEN_INDENT){
+    while (interp->tokens[j].type == TOKEN_INDENT){
         j++; indent++;
     }
-    ASTNode* node = new_node();
+    ASTNode* node = new_node(interp);
     if (!node) return NULL;
-    ASTNode* condition = parse_expression();
-    if (!condition) return NULL;
+    ASTNode* condition = parse_expression(interp);
+    if (!condition){
+        free(node);
+        return NULL;
+    }
     node->type = AST_IF;
     node->construct.condition = condition;
     node->construct.code = NULL;
     node->construct.next = NULL;
-    if (advance().type == TOKEN_COLON){
-        if(peek().type == TOKEN_EOF){
-            advance();
-            if (!block(node, indent)) goto end;
+    if (advance(interp).type == TOKEN_COLON){
+        if(peek(interp).type == TOKEN_EOF){
+            advance(interp);
+            if (!block(interp, node, indent)) goto end;
             return node;
         }
     }
-    raiseError(SYNTAX_ERROR, "Missing colon");
+    raiseError(interp, SYNTAX_ERROR, "Missing colon");
     end:
         ast_free(node);
         return NULL;
 }
 
-ASTNode* parse_elif(){
+ASTNode* parse_elif(Interpreter* interp){
     int indent = 0, j = 0;
-    while (tokens[j].type == TOKEN_INDENT){
+    while (interp->tokens[j].type == TOKEN_INDENT){
         j++; indent++;
     }
-    ASTNode* node = new_node();
+    ASTNode* node = new_node(interp);
     if (!node) return NULL;
-    ASTNode* condition = parse_expression();
-    if (!condition) return NULL;
+    ASTNode* condition = parse_expression(interp);
+    if (!condition){
+        free(node);
+        return NULL;
+    }
     node->type = AST_ELIF;
     node->construct.condition = condition;
     node->construct.code = NULL;
     node->construct.next = NULL;
-    if (advance().type == TOKEN_COLON){
-        if(peek().type == TOKEN_EOF){
-            advance();
-            if (!block(node, indent)) goto end;
+    if (advance(interp).type == TOKEN_COLON){
+        if(peek(interp).type == TOKEN_EOF){
+            advance(interp);
+            if (!block(interp, node, indent)) goto end;
             return node;
         }
     }
-    raiseError(SYNTAX_ERROR, "Missing colon");
+    raiseError(interp, SYNTAX_ERROR, "Missing colon");
     end:
         ast_free(node);
         return NULL;
 }
 
-ASTNode* parse_else(){
+ASTNode* parse_else(Interpreter* interp){
     int indent = 0, j = 0;
-    while (tokens[j].type == TOKEN_INDENT){
+    while (interp->tokens[j].type == TOKEN_INDENT){
         j++; indent++;
     }
-    ASTNode* node = new_node();
+    ASTNode* node = new_node(interp);
     if (!node) return NULL;
     node->type = AST_ELSE;
     node->construct.condition = NULL;
     node->construct.code = NULL;
     node->construct.next = NULL;
-    if (advance().type == TOKEN_COLON){
-        if(peek().type == TOKEN_EOF){
-            advance();
-            if (!block(node, indent)) goto end;
+    if (advance(interp).type == TOKEN_COLON){
+        if(peek(interp).type == TOKEN_EOF){
+            advance(interp);
+            if (!block(interp, node, indent)) goto end;
             return node;
         }
     }
-    raiseError(SYNTAX_ERROR, "Missing colon");
+    raiseError(interp, SYNTAX_ERROR, "Missing colon");
     end:
         ast_free(node);
         return NULL;
 }
 
-ASTNode* parse_while(){
+ASTNode* parse_while(Interpreter* interp){
     int indent = 0, j = 0;
-    while (tokens[j].type == TOKEN_INDENT){
+    while (interp->tokens[j].type == TOKEN_INDENT){
         j++; indent++;
     }
-    ASTNode* node = new_node();
+    ASTNode* node = new_node(interp);
     if (!node) return NULL;
-    ASTNode* condition = parse_expression();
-    if (!condition) return NULL;
+    ASTNode* condition = parse_expression(interp);
+    if (!condition){
+        free(node);
+        return NULL;
+    }
     node->type = AST_WHILE;
     node->construct.condition = condition;
     node->construct.code = NULL;
     node->construct.next = NULL;
-    if (advance().type == TOKEN_COLON){
-        if(peek().type == TOKEN_EOF){
-            advance();
-            if (!block(node, indent)) goto end;
+    if (advance(interp).type == TOKEN_COLON){
+        if(peek(interp).type == TOKEN_EOF){
+            advance(interp);
+            if (!block(interp, node, indent)) goto end;
+            return node;
+        }
+    }
+    raiseError(interp, SYNTAX_ERROR, "Missing colon");
+    end:
+        ast_free(node);
+        return NULL;
+}
+
+// for <name> in range(stop), range(start, stop) or range(start, stop, step)
+ASTNode* parse_for(Interpreter* interp){
+    int indent = 0, j = 0;
+    while (interp->tokens[j].type == TOKEN_INDENT){
+        j++; indent++;
+    }
+    if (peek(interp).type != TOKEN_IDENTIFIER || interp->tokens[interp->current + 1].type != TOKEN_OPERATOR ||
+        strcmp(interp->tokens[interp->current + 1].text, "i") != 0){
+        raiseError(interp, SYNTAX_ERROR, "Expected 'for <name> in range(...)'");
+        return NULL;
+    }
+    ASTNode* node = new_node(interp);
+    if (!node) return NULL;
+    node->type = AST_FOR;
+    node->construct.name = strdup(advance(interp).text);
+    node->construct.reads = -1;
+    node->construct.slot = -1;
+    advance(interp); // skip 'in'
+    ASTNode* range = parse_expression(interp);
+    if (!range) goto end;
+    node->construct.condition = range;
+    if (range->type != AST_CALL || range->call.method || strcmp(range->call.name, "range") != 0){
+        raiseError(interp, SYNTAX_ERROR, "Only range() can be looped over");
+        goto end;
+    }
+    if (range->call.count < 1 || range->call.count > 3){
+        raiseError(interp, SYNTAX_ERROR, "range() takes 1 to 3 arguments");
+        goto end;
+    }
+    if (advance(interp).type == TOKEN_COLON){
+        if(peek(interp).type == TOKEN_EOF){
+            advance(interp);
+            if (!block(interp, node, indent)) goto end;
+            if (!node->construct.code->block.lazy) node->construct.reads = uses_variable(node->construct.code, node->construct.name);
             return node;
         }
     }
-    raiseError(SYNTAX_ERROR, "Missing colon");
+    raiseError(interp, SYNTAX_ERROR, "Missing colon");
     end:
         ast_free(node);
         return NULL;
 }
 
-ASTNode* parse_keyword(ASTNode* parent_node) {
-    char* key = strdup(advance().text);// skip 'keyword' and get the keyword
+// def name(params): the body is parsed right away, even with --lazy, so
+// its names can be resolved to frame slots before it runs
+ASTNode* parse_def(Interpreter* interp){
+    int indent = 0, j = 0;
+    while (interp->tokens[j].type == TOKEN_INDENT){
+        j++; indent++;
+    }
+    if (interp->in_function){
+        raiseError(interp, SYNTAX_ERROR, "Functions cannot be nested");
+        return NULL;
+    }
+    if (peek(interp).type != TOKEN_IDENTIFIER || interp->tokens[interp->current + 1].type != TOKEN_LPAREN){
+        raiseError(interp, SYNTAX_ERROR, "Expected 'def <name>(...)'");
+        return NULL;
+    }
+    char* name = strdup(advance(interp).text);
+    advance(interp); // consume '('
+    char** params = NULL;
+    int count = 0;
+    ASTNode* node = NULL;
+    while (peek(interp).type != TOKEN_RPAREN){
+        if (peek(interp).type != TOKEN_IDENTIFIER){
+            raiseError(interp, SYNTAX_ERROR, "Expected a parameter name");
+            goto fail;
+        }
+        char* param = advance(interp).text;
+        for (int i = 0; i < count; i++){
+            if (strcmp(params[i], param) == 0){
+                raiseError(interp, SYNTAX_ERROR, "Duplicate parameter");
+                goto fail;
+            }
+        }
+        char** tmp = realloc(params, sizeof(char*) * (count + 1));
+        if (!tmp){
+            raiseError(interp, MEMORY_ERROR, "Out of memory");
+            goto fail;
+        }
+        params = tmp;
+        params[count++] = strdup(param);
+        if (peek(interp).type == TOKEN_COMMA) advance(interp);
+        else if (peek(interp).type != TOKEN_RPAREN){
+            raiseError(interp, SYNTAX_ERROR, "Unmatched '('");
+            goto fail;
+        }
+    }
+    advance(interp); // consume ')'
+    if (advance(interp).type != TOKEN_COLON || peek(interp).type != TOKEN_EOF){
+        raiseError(interp, SYNTAX_ERROR, "Missing colon");
+        goto fail;
+    }
+    advance(interp);
+    node = new_node(interp);
+    if (!node) goto fail;
+    node->type = AST_DEF;
+
+    ASTNode holder = {0}; // stands in for the def, parse_block() fills in its body
+    holder.type = AST_ELSE;
+    int lazy_parse = interp->lazy_parse;
+    interp->lazy_parse = 0;
+    interp->in_function = 1;
+    int ok = parse_block(interp, &holder, indent);
+    interp->lazy_parse = lazy_parse;
+    interp->in_function = 0;
+    if (!ok) goto fail;
+
+    node->function = function_new(name, params, count, holder.construct.code);
+    if (!node->function){
+        ast_free(node);
+        raiseError(interp, MEMORY_ERROR, "Out of memory");
+        return NULL;
+    }
+    return node;
+
+    fail:
+        for (int i = 0; i < count; i++) free(params[i]);
+        free(params);
+        free(name);
+        ast_free(node);
+        return NULL;
+}
+
+// class Name: the body holds only method definitions (and 'pass'). It is
+// parsed right away, like a def; the class itself is made each time the
+// statement runs.
+ASTNode* parse_class(Interpreter* interp){
+    int indent = 0, j = 0;
+    while (interp->tokens[j].type == TOKEN_INDENT){
+        j++; indent++;
+    }
+    if (interp->in_function){
+        raiseError(interp, SYNTAX_ERROR, "Classes cannot be defined inside functions");
+        return NULL;
+    }
+    if (peek(interp).type != TOKEN_IDENTIFIER){
+        raiseError(interp, SYNTAX_ERROR, "Expected 'class <name>:'");
+        return NULL;
+    }
+    char* name = strdup(advance(interp).text);
+    if (advance(interp).type != TOKEN_COLON || peek(interp).type != TOKEN_EOF){
+        free(name);
+        raiseError(interp, SYNTAX_ERROR, "Missing colon");
+        return NULL;
+    }
+    advance(interp);
+    ASTNode* node = new_node(interp);
+    if (!node){
+        free(name);
+        return NULL;
+    }
+    node->type = AST_CLASS;
+    node->classdef.name = name;
+
+    ASTNode holder = {0}; // stands in for the class, parse_block() fills in its body
+    holder.type = AST_ELSE;
+    int lazy_parse = interp->lazy_parse;
+    interp->lazy_parse = 0;
+    int ok = parse_block(interp, &holder, indent);
+    interp->lazy_parse = lazy_parse;
+    if (!ok){
+        ast_free(node);
+        return NULL;
+    }
+    node->classdef.body = holder.construct.code;
+    ASTNode* body = node->classdef.body;
+    for (int i = 0; i < body->block.count; i++){
+        if (body->block.statements[i]->type != AST_DEF && body->block.statements[i]->type != AST_PASS){
+            interp->error_line = body->block.statements[i]->line;
+            raiseError(interp, SYNTAX_ERROR, "Only methods can be defined in a class body");
+            ast_free(node);
+            return NULL;
+        }
+    }
+    return node;
+}
+
+ASTNode* parse_return(Interpreter* interp){
+    if (!interp->in_function){
+        raiseError(interp, SYNTAX_ERROR, "'return' outside function");
+        return NULL;
+    }
+    ASTNode* value = NULL;
+    if (peek(interp).type != TOKEN_EOF && peek(interp).type != TOKEN_SEMICOLON){
+        value = parse_expression(interp);
+        if (!value) return NULL;
+    }
+    ASTNode* node = new_node(interp);
+    if (!node){
+        ast_free(value);
+        return NULL;
+    }
+    node->type = AST_RETURN;
+    node->ret.value = value;
+    return node;
+}
+
+ASTNode* parse_keyword(Interpreter* interp, ASTNode* parent_node) {
+    const char* key = advance(interp).text;// skip 'keyword' and get the keyword
     if (strcasecmp(key, "print") == 0){
-        if (peek().type == TOKEN_LPAREN){
-            ASTNode* val = parse_paren();
-            ASTNode* node = new_node();
-            if (!node) return NULL;
+        if (peek(interp).type == TOKEN_LPAREN){
+            ASTNode* val = parse_paren(interp);
+            if (!val) return NULL;
+            ASTNode* node = new_node(interp);
+            if (!node){
+                ast_free(val);
+                return NULL;
+            }
             node->type = AST_PRINT;
             node->print.value = val;
             return node;
         }else{
-            raiseError(SYNTAX_ERROR, "Missing brackets");
+            raiseError(interp, SYNTAX_ERROR, "Missing brackets");
             return NULL;
         }
     }else if (strcasecmp(key, "pass") == 0){
-        return parse_pass();
+        return parse_pass(interp);
     }else if (strcasecmp(key, "break") == 0){
-        return parse_break();
+        return parse_break(interp);
     }else if (strcasecmp(key, "if") == 0){
-        return parse_if();
+        return parse_if(interp);
     }else if (strcasecmp(key, "elif") == 0){
-        if (!parent_node){raiseError(SYNTAX_ERROR, "Elif without matching If"); goto end;}
-        return parse_elif();
+        if (!parent_node){raiseError(interp, SYNTAX_ERROR, "Elif without matching If"); goto end;}
+        return parse_elif(interp);
     }else if (strcasecmp(key, "else") == 0){
-        if (!parent_node){raiseError(SYNTAX_ERROR, "Else without matching If"); goto end;}
-        return parse_else();
+        if (!parent_node){raiseError(interp, SYNTAX_ERROR, "Else without matching If"); goto end;}
+        return parse_else(interp);
     }else if (strcasecmp(key, "while") == 0){
-        return parse_while();
+        return parse_while(interp);
+    }else if (strcasecmp(key, "for") == 0){
+        return parse_for(interp);
+    }else if (strcasecmp(key, "def") == 0){
+        return parse_def(interp);
+    }else if (strcasecmp(key, "return") == 0){
+        return parse_return(interp);
+    }else if (strcasecmp(key, "class") == 0){
+        return parse_class(interp);
     }else{
         end:
             return NULL;
     }
 }
 
-ASTNode* parse_statement(ASTNode* parent_node) {
-    if (peek().type == TOKEN_SEMICOLON){ 
-        current++;
+ASTNode* parse_statement(Interpreter* interp, ASTNode* parent_node) {
+    if (peek(interp).type == TOKEN_SEMICOLON){ 
+        interp->current++;
         return NULL;
     }
-    if (peek().type == TOKEN_KEYWORD) {
-        return parse_keyword(parent_node);
+    if (peek(interp).type == TOKEN_KEYWORD) {
+        return parse_keyword(interp, parent_node);
     }
-    if (peek().type == TOKEN_IDENTIFIER && tokens[current + 1].type == TOKEN_ASSIGN) {
-        return parse_assignment();
+    if (peek(interp).type == TOKEN_IDENTIFIER && interp->tokens[interp->current + 1].type == TOKEN_ASSIGN) {
+        return parse_assignment(interp);
     }
-    return parse_expression();
+    ASTNode* node = parse_expression(interp);
+    if (node && node->type == AST_INDEX && peek(interp).type == TOKEN_ASSIGN) {
+        // a[i] = value, a[i] += value
+        char op = advance(interp).text[0];
+        ASTNode* value = parse_expression(interp);
+        if (!value) {
+            ast_free(node);
+            return NULL;
+        }
+        node->type = AST_INDEX_ASSIGN;
+        node->index.op = op;
+        node->index.value = value;
+    } else if (node && node->type == AST_ATTR && peek(interp).type == TOKEN_ASSIGN) {
+        // p.x = value, p.x += value
+        char op = advance(interp).text[0];
+        ASTNode* value = parse_expression(interp);
+        if (!value) {
+            ast_free(node);
+            return NULL;
+        }
+        node->type = AST_ATTR_ASSIGN;
+        node->attr.op = op;
+        node->attr.value = value;
+    }
+    return node;
 }
\ No newline at end of file
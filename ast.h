@@ -5,6 +5,8 @@
 #include "memory.h"
 
 typedef struct ASTNode ASTNode;
+typedef struct Chunk Chunk;
+typedef struct Interpreter Interpreter;
 
 typedef enum {
     AST_BLOCK,
@@ -23,10 +25,32 @@ typedef enum {
     AST_ELIF,
     AST_ELSE,
     AST_WHILE,
+    AST_FOR,
+    AST_CACHED,
+    AST_SCOPE,
+    AST_LIST,
+    AST_DICT,
+    AST_INDEX,
+    AST_INDEX_ASSIGN,
+    AST_CALL,
+    AST_DEF,
+    AST_RETURN,
+    AST_LOCAL,
+    AST_CLASS,
+    AST_ATTR,
+    AST_ATTR_ASSIGN,
 } ASTNodeType;
 
+// Functions and methods the interpreter provides, resolved by the parser
+typedef enum {
+    BUILTIN_NONE, // unknown name, reported when the call runs
+    BUILTIN_LEN,    // len(x)
+    BUILTIN_APPEND, // list.append(x)
+} Builtin;
+
 typedef struct ASTNode {
     ASTNodeType type;
+    int line; // source line in the script, 0 when interactive
 
     union {
         char* name; // for AST_IDENTIFIER
@@ -36,6 +60,8 @@ typedef struct ASTNode {
         struct { // for AST_BLOCK
             ASTNode** statements;
             int count;
+            int lazy; // body not parsed yet, only its line range is known
+            int lazy_start, lazy_end, lazy_indent;
         } block;
 
         struct { // for AST_OPERATOR
@@ -47,31 +73,94 @@ typedef struct ASTNode {
         struct { // for AST_ASSIGNMENT
             char* name;
             struct ASTNode* value;
+            int slot; // in a function body: the local stored to; -1 for a global
         } assign;
 
         struct { // for AST_PRINT
             struct ASTNode* value;
         } print;
 
-        struct { // for AST_IF,AST_ELIF,AST_ELSE,AST_WHILE
-            struct ASTNode* condition;
+        struct { // for AST_IF,AST_ELIF,AST_ELSE,AST_WHILE,AST_FOR
+            struct ASTNode* condition; // AST_FOR: the range() call
             struct ASTNode* code;
             struct ASTNode* next;
+            int hotness; // AST_WHILE, AST_FOR: back-edges taken, -1 once rejected by the compiler
+            int reads; // AST_FOR: the body may use the variable, -1 until the body is parsed
+            Chunk* chunk; // AST_WHILE, AST_FOR: bytecode once the loop is hot
+            char* name; // AST_FOR: the loop variable
+            int slot; // AST_FOR: its local slot in a function body, -1 for a global
         } construct;
+
+        struct { // for AST_CACHED: expr's value is kept in cse_slots[slot]
+            struct ASTNode* expr;
+            int slot;
+        } cached;
+
+        struct { // for AST_SCOPE: the slots are released when body finishes
+            struct ASTNode* body;
+            int first;
+            int count;
+        } scope;
+
+        struct { // for AST_LIST, and AST_DICT with keys and values alternating
+            struct ASTNode** items;
+            int count;
+        } list;
+
+        struct { // for AST_INDEX, AST_INDEX_ASSIGN: target[index] op= value
+            struct ASTNode* target;
+            struct ASTNode* index;
+            struct ASTNode* value;
+            char op; // '=' or the operator of an augmented assignment
+        } index;
+
+        struct { // for AST_CALL: a method call passes its object as args[0]
+            char* name;
+            Builtin builtin;
+            int method;
+            int site; // a method call's inline cache, see object.h
+            struct ASTNode** args;
+            int count;
+        } call;
+
+        struct Function* function; // for AST_DEF
+
+        struct { // for AST_RETURN: value is NULL for a bare 'return'
+            struct ASTNode* value;
+        } ret;
+
+        struct { // for AST_LOCAL: a name resolved to a slot of the call frame
+            char* name;
+            int slot;
+        } local;
+
+        struct { // for AST_CLASS: body holds the methods (AST_DEF) and any 'pass'
+            char* name;
+            struct ASTNode* body;
+        } classdef;
+
+        struct { // for AST_ATTR, object.name, and AST_ATTR_ASSIGN, object.name <op>= value
+            struct ASTNode* object;
+            char* name;
+            struct ASTNode* value;
+            char op;
+            int site; // inline cache, see object.h
+        } attr;
     };
 
 } ASTNode;
 
 const char* AST_node_name(ASTNodeType type);
 
-void print_ast_debug(ASTNode* node, int indent, int is_last);
+void print_ast_debug(FILE* out, ASTNode* node, int indent, int is_last);
 void ast_free(ASTNode *node);
 
-Token peek();
-Token advance();
+Token peek(Interpreter* interp);
+Token advance(Interpreter* interp);
 
-ASTNode* new_node();
-ASTNode* parse_expression();
-ASTNode* parse_statement(ASTNode* parent_node);
+ASTNode* new_node(Interpreter* interp);
+ASTNode* parse_expression(Interpreter* interp);
+ASTNode* parse_statement(Interpreter* interp, ASTNode* parent_node);
+int parse_lazy_block(Interpreter* interp, ASTNode* node);
 
 #endif
\ No newline at end of file
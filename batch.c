@@ -0,0 +1,289 @@
+// batch.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "context.h"
+#include "minipy.h"
+#include "batch.h"
+#include "timer.h"
+#include "hooks.h"
+#include "colors.h"
+#include "debug_alloc.h"
+
+typedef struct {
+    char* path;
+    char* output; // everything the script printed
+    size_t output_len;
+    uint64_t ns;
+    int failed;
+    Error error;
+    int done;
+} Job;
+
+// Scripts not started yet. The owner takes from the front, so its share
+// runs in order and output can be written early; idle workers steal from
+// the back.
+typedef struct {
+    pthread_mutex_t lock;
+    int* items;
+    int head;
+    int tail;
+} Deque;
+
+typedef struct {
+    Job* jobs;
+    int job_count;
+    Deque* deques; // one per worker thread asked for
+    int deque_count;
+    int workers; // threads actually started
+    const Interpreter* config;
+    pthread_mutex_t done_lock;
+    pthread_cond_t done_cond;
+} Batch;
+
+typedef struct {
+    Batch* batch;
+    int id;
+    pthread_t thread;
+} Worker;
+
+static int take(Deque* d, int from_back){
+    int index = -1;
+    pthread_mutex_lock(&d->lock);
+    if (d->head < d->tail) index = from_back ? d->items[--d->tail] : d->items[d->head++];
+    pthread_mutex_unlock(&d->lock);
+    return index;
+}
+
+// Next script for worker id, stolen from another worker once its own
+// share is done. -1 when every deque is empty; nothing is added later.
+static int next_job(Batch* batch, int id){
+    int index = take(&batch->deques[id], 0);
+    for (int i = 1; index < 0 && i < batch->deque_count; i++){
+        index = take(&batch->deques[(id + i) % batch->deque_count], 1);
+    }
+    return index;
+}
+
+static void run_job(Interpreter* interp, Job* job){
+    FILE* out = open_memstream(&job->output, &job->output_len);
+    if (!out){
+        job->failed = 1;
+        snprintf(job->error.message, sizeof job->error.message, "Out of memory");
+        return;
+    }
+    minipy_set_output(interp, out);
+    minipy_reset(interp);
+    uint64_t start = timer_ns();
+    job->failed = minipy_run_file(interp, job->path);
+    job->ns = timer_ns() - start;
+    const Error* err = minipy_error(interp);
+    if (err) job->error = *err;
+    else if (job->failed) snprintf(job->error.message, sizeof job->error.message, "Failed to open file");
+    minipy_set_output(interp, NULL);
+    fclose(out);
+}
+
+static void* worker_main(void* arg){
+    Worker* w = arg;
+    Batch* batch = w->batch;
+    Interpreter* interp = minipy_create();
+    if (interp){
+        interp->lazy_parse = batch->config->lazy_parse;
+        interp->check_only = batch->config->check_only;
+        interp->gc_config = batch->config->gc_config;
+    }
+    int index;
+    while ((index = next_job(batch, w->id)) >= 0){
+        Job* job = &batch->jobs[index];
+        if (interp){
+            run_job(interp, job);
+        }else{
+            job->failed = 1;
+            snprintf(job->error.message, sizeof job->error.message, "Out of memory");
+        }
+        pthread_mutex_lock(&batch->done_lock);
+        job->done = 1;
+        pthread_cond_broadcast(&batch->done_cond);
+        pthread_mutex_unlock(&batch->done_lock);
+    }
+    minipy_destroy(interp);
+    return NULL;
+}
+
+static int add_job(Batch* batch, int* capacity, const char* path){
+    if (batch->job_count == *capacity){
+        int new_capacity = *capacity ? *capacity * 2 : 64;
+        Job* tmp = realloc(batch->jobs, sizeof(Job) * new_capacity);
+        if (!tmp) return 0;
+        batch->jobs = tmp;
+        *capacity = new_capacity;
+    }
+    Job* job = &batch->jobs[batch->job_count];
+    memset(job, 0, sizeof(Job));
+    job->path = strdup(path);
+    if (!job->path) return 0;
+    batch->job_count++;
+    return 1;
+}
+
+static int compare_jobs(const void* a, const void* b){
+    return strcmp(((const Job*)a)->path, ((const Job*)b)->path);
+}
+
+// A directory contributes its .sap files in name order, anything else is
+// read as a list of paths, one per line.
+static int collect_jobs(Batch* batch, const char* source){
+    int capacity = 0;
+    struct stat st;
+    if (stat(source, &st) != 0){
+        perror("Failed to open batch");
+        return 0;
+    }
+    if (S_ISDIR(st.st_mode)){
+        DIR* dir = opendir(source);
+        if (!dir){
+            perror("Failed to open batch");
+            return 0;
+        }
+        struct dirent* entry;
+        while ((entry = readdir(dir))){
+            size_t len = strlen(entry->d_name);
+            if (len < 5 || strcmp(entry->d_name + len - 4, ".sap") != 0) continue;
+            char* path = malloc(strlen(source) + len + 2);
+            if (!path) break;
+            sprintf(path, "%s/%s", source, entry->d_name);
+            int added = add_job(batch, &capacity, path);
+            free(path);
+            if (!added) break;
+        }
+        closedir(dir);
+        if (batch->job_count > 1) qsort(batch->jobs, batch->job_count, sizeof(Job), compare_jobs);
+        return 1;
+    }
+
+    FILE* list = fopen(source, "r");
+    if (!list){
+        perror("Failed to open batch");
+        return 0;
+    }
+    char line[4096];
+    while (fgets(line, sizeof line, list)){
+        char* path = line;
+        while (isspace((unsigned char)*path)) path++;
+        int len = strlen(path);
+        while (len > 0 && isspace((unsigned char)path[len - 1])) path[--len] = '\0';
+        if (len == 0 || path[0] == '#') continue;
+        if (!add_job(batch, &capacity, path)) break;
+    }
+    fclose(list);
+    return 1;
+}
+
+static void report(Batch* batch, uint64_t wall_ns){
+    int failed = 0;
+    uint64_t total_ns = 0;
+    fprintf(stderr, CYN "\n[BATCH]\n" RESET);
+    for (int i = 0; i < batch->job_count; i++){
+        Job* job = &batch->jobs[i];
+        total_ns += job->ns;
+        if (!job->failed){
+            fprintf(stderr, "%10.3f ms  ok    %s\n", job->ns / 1e6, job->path);
+            continue;
+        }
+        failed++;
+        if (job->error.line > 0){
+            fprintf(stderr, "%10.3f ms  " RED "FAIL" RESET "  %s: %s: %s (line %d)\n", job->ns / 1e6, job->path,
+                    error_name(job->error.type), job->error.message, job->error.line);
+        }else{
+            fprintf(stderr, "%10.3f ms  " RED "FAIL" RESET "  %s: %s\n", job->ns / 1e6, job->path, job->error.message);
+        }
+    }
+    fprintf(stderr, "%d scripts, %d failed, %d workers, %.3f ms wall, %.3f ms in scripts\n",
+            batch->job_count, failed, batch->workers, wall_ns / 1e6, total_ns / 1e6);
+}
+
+int batch_run(const char* source, int jobs, const Interpreter* config){
+    Batch batch = {0};
+    batch.config = config;
+    if (!collect_jobs(&batch, source)) return 1;
+    if (batch.job_count == 0){
+        fprintf(stderr, "no scripts in %s\n", source);
+        free(batch.jobs);
+        return 1;
+    }
+
+    if (jobs <= 0) jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs > batch.job_count) jobs = batch.job_count;
+    if (jobs < 1) jobs = 1;
+    batch.deque_count = jobs;
+    debug_locked = 1; // the level and the observer list are process-wide
+    pthread_mutex_init(&batch.done_lock, NULL);
+    pthread_cond_init(&batch.done_cond, NULL);
+
+    // each worker starts with a contiguous share of the scripts
+    int* items = malloc(sizeof(int) * batch.job_count);
+    batch.deques = calloc(jobs, sizeof(Deque));
+    Worker* workers = calloc(jobs, sizeof(Worker));
+    if (!items || !batch.deques || !workers){
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < batch.job_count; i++) items[i] = i;
+    for (int w = 0; w < jobs; w++){
+        Deque* d = &batch.deques[w];
+        pthread_mutex_init(&d->lock, NULL);
+        d->items = items;
+        d->head = (int)((long long)batch.job_count * w / jobs);
+        d->tail = (int)((long long)batch.job_count * (w + 1) / jobs);
+    }
+
+    fflush(stdout);
+    uint64_t start = timer_ns();
+    int started = 0;
+    for (int w = 0; w < jobs; w++){
+        workers[w] = (Worker){ .batch = &batch, .id = w };
+        if (pthread_create(&workers[w].thread, NULL, worker_main, &workers[w]) != 0) break;
+        started++;
+    }
+    // shares of threads that failed to start are stolen by the others
+    batch.workers = started;
+    if (started == 0){
+        workers[0] = (Worker){ .batch = &batch, .id = 0 };
+        batch.workers = 1;
+        worker_main(&workers[0]);
+    }
+
+    // write each script's output as soon as it and everything before it is done
+    int failed = 0;
+    for (int i = 0; i < batch.job_count; i++){
+        Job* job = &batch.jobs[i];
+        pthread_mutex_lock(&batch.done_lock);
+        while (!job->done) pthread_cond_wait(&batch.done_cond, &batch.done_lock);
+        pthread_mutex_unlock(&batch.done_lock);
+        if (job->output){
+            fwrite(job->output, 1, job->output_len, stdout);
+            free(job->output);
+            job->output = NULL;
+        }
+        failed |= job->failed;
+    }
+    fflush(stdout);
+    for (int w = 0; w < started; w++) pthread_join(workers[w].thread, NULL);
+    report(&batch, timer_ns() - start);
+
+    for (int w = 0; w < jobs; w++) pthread_mutex_destroy(&batch.deques[w].lock);
+    pthread_mutex_destroy(&batch.done_lock);
+    pthread_cond_destroy(&batch.done_cond);
+    for (int i = 0; i < batch.job_count; i++) free(batch.jobs[i].path);
+    free(batch.jobs);
+    free(batch.deques);
+    free(workers);
+    free(items);
+    return failed;
+}
@@ -0,0 +1,14 @@
+// batch.h
+#ifndef BATCH_H
+#define BATCH_H
+
+typedef struct Interpreter Interpreter;
+
+// --batch: runs every .sap file in a directory, or every path listed in a
+// file, on a pool of worker threads. Each script gets a fresh set of
+// variables and its own output buffer; the buffers are written to stdout
+// in script order, followed by a per-script report on stderr. config
+// supplies --lazy and --check. Returns 1 if any script failed.
+int batch_run(const char* source, int jobs, const Interpreter* config);
+
+#endif
@@ -0,0 +1,149 @@
+// bench/lex.c
+// Serial tokenize() against lex_lines() on 1, 2, 4 and 8 threads.
+//
+// Build from the repository root, linking everything but main.c:
+//   gcc -O2 -I. bench/lex.c $(ls *.c | grep -v main.c) -o lex -lpthread
+//
+//   ./lex [--lines N] [--reps N] [--threads N] [--seed N]
+//
+// The generated script mixes indented blocks, keywords, numbers, floats
+// and strings with escapes. Every parallel run is checked token by token
+// against the serial one before its time is reported.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lexer.h"
+#include "context.h"
+#include "minipy.h"
+#include "timer.h"
+
+static unsigned rng_state;
+
+static int rnd(int n){
+    rng_state = rng_state * 1103515245u + 12345u;
+    return (rng_state >> 8) % n;
+}
+
+static char* generate_line(int index){
+    char buf[512];
+    int len = 0;
+    int indent = rnd(3);
+    for (int i = 0; i < indent; i++) len += sprintf(buf + len, "    ");
+    switch (rnd(6)) {
+        case 0:
+            len += sprintf(buf + len, "while i%d < %d and not done:", rnd(50), rnd(100000));
+            break;
+        case 1:
+            len += sprintf(buf + len, "if x%d >= %d.%d or y != %d:", rnd(50), rnd(1000), rnd(100), rnd(10));
+            break;
+        case 2:
+            len += sprintf(buf + len, "s%d = \"line %d\\t\\\"quoted\\\"\" + 'tail\\n'", rnd(20), index);
+            break;
+        case 3:
+            len += sprintf(buf + len, "print((a%d + %d) * (b%d - %d.5) / %d)", rnd(30), rnd(99), rnd(30), rnd(9), rnd(9) + 1);
+            break;
+        case 4:
+            len += sprintf(buf + len, "total_%d += value_%d * %d", rnd(10), rnd(40), rnd(1000));
+            break;
+        default:
+            len += sprintf(buf + len, "flag = True and None == False; pass");
+            break;
+    }
+    return strdup(buf);
+}
+
+static int same_tokens(Token* a, int a_count, Token* b, int b_count){
+    if (a_count != b_count) return 0;
+    for (int i = 0; i < a_count; i++) {
+        if (a[i].type != b[i].type || strcmp(a[i].text, b[i].text) != 0) return 0;
+    }
+    return 1;
+}
+
+static void free_tokens(Interpreter* interp, LineTokens* serial, int lines){
+    for (int i = 0; i < lines; i++) {
+        interp->tokens = serial[i].tokens;
+        interp->token_count = serial[i].count;
+        reset_tokens(interp);
+        serial[i].tokens = NULL;
+    }
+}
+
+int main(int argc, char* argv[]){
+    int lines = 200000;
+    int reps = 3;
+    int max_threads = 8;
+    rng_state = 1;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--lines") == 0) lines = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--reps") == 0) reps = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--threads") == 0) max_threads = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--seed") == 0) rng_state = atoi(argv[i + 1]);
+        else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    char** src = malloc(sizeof(char*) * lines);
+    double bytes = 0;
+    for (int i = 0; i < lines; i++) {
+        src[i] = generate_line(i);
+        bytes += strlen(src[i]) + 1;
+    }
+    printf("%d lines, %.2f MB, %d reps\n", lines, bytes / 1e6, reps);
+
+    // Serial: what the parser does today, one line at a time. Every rep
+    // keeps its tokens until the next one, as lex_lines() does.
+    Interpreter* interp = minipy_create();
+    LineTokens* serial = calloc(lines, sizeof(LineTokens));
+    double best = 0;
+    for (int r = 0; r < reps; r++) {
+        free_tokens(interp, serial, lines);
+        uint64_t start = timer_ns();
+        for (int i = 0; i < lines; i++) {
+            allocate_tokens(interp);
+            tokenize(interp, src[i]);
+            serial[i].tokens = interp->tokens;
+            serial[i].count = interp->token_count;
+            interp->tokens = NULL;
+            interp->token_count = 0;
+        }
+        double s = (timer_ns() - start) / 1e9;
+        if (r == 0 || s < best) best = s;
+    }
+    double serial_s = best;
+    printf("%-10s %10.3f ms  %8.2f MB/s\n", "serial", serial_s * 1e3, bytes / serial_s / 1e6);
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        LexedLines* ahead = NULL;
+        for (int r = 0; r < reps; r++) {
+            free_lexed_lines(ahead);
+            uint64_t start = timer_ns();
+            ahead = lex_lines(src, lines, threads);
+            double s = (timer_ns() - start) / 1e9;
+            if (r == 0 || s < best) best = s;
+        }
+        if (!ahead) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        for (int i = 0; i < lines; i++) {
+            LineTokens* line = &ahead->lines[i];
+            if (!line->tokens || !same_tokens(line->tokens, line->count, serial[i].tokens, serial[i].count)) {
+                fprintf(stderr, "line %d differs from the serial lexer: %s\n", i + 1, src[i]);
+                return 1;
+            }
+        }
+        printf("%2d thread%s %10.3f ms  %8.2f MB/s  speedup %5.2fx\n", threads, threads == 1 ? " " : "s",
+               best * 1e3, bytes / best / 1e6, serial_s / best);
+        free_lexed_lines(ahead);
+    }
+
+    free_tokens(interp, serial, lines);
+    for (int i = 0; i < lines; i++) free(src[i]);
+    free(serial);
+    free(src);
+    minipy_destroy(interp);
+    return 0;
+}
@@ -0,0 +1,231 @@
+// bench/micro.c
+// Per-stage microbenchmarks for the front end and the evaluator.
+//
+// Build from the repository root, linking everything but main.c:
+//   gcc -O2 -I. bench/micro.c $(ls *.c | grep -v main.c) -o micro
+//
+//   ./micro [--lines N] [--reps N] [--line-length N] [--ident-density F]
+//           [--string-ratio F] [--depth N] [--seed N] [--stage lex|parse|eval]
+//
+// Every stage runs over the same generated source and is timed on its own:
+// tokenize() gets raw lines, parse_statement() gets pre-built token arrays
+// and eval() gets pre-built trees, so a regression in one stage is not
+// hidden by the cost of the others.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lexer.h"
+#include "ast.h"
+#include "memory.h"
+#include "interpreter.h"
+#include "error_handling.h"
+#include "context.h"
+#include "minipy.h"
+#include "timer.h"
+
+typedef struct {
+    int lines;
+    int reps;
+    int line_length;
+    double ident_density; // share of operands that are variables
+    double string_ratio;  // share of lines that are string expressions
+    int depth;            // parenthesis nesting per line
+    unsigned seed;
+    const char* stage;
+} Options;
+
+static unsigned rng_state;
+
+static double rnd(){
+    rng_state = rng_state * 1103515245u + 12345u;
+    return ((rng_state >> 8) & 0xFFFFFF) / (double)0x1000000;
+}
+
+static void append(char* buf, int* len, const char* text){
+    int n = strlen(text);
+    memcpy(buf + *len, text, n);
+    *len += n;
+    buf[*len] = '\0';
+}
+
+// One assignment per line. Numeric lines combine ints and the n0..n9
+// variables, string lines concatenate literals and the s0..s3 variables,
+// so every line evaluates without a type error.
+static char* generate_line(Options* o, int index){
+    char* buf = malloc(o->line_length + 256);
+    int len = 0;
+    int is_string = rnd() < o->string_ratio;
+    char tmp[64];
+
+    // targets never alias the operands, so values do not grow across reps
+    sprintf(tmp, "%c%d = ", is_string ? 't' : 'r', index % 100);
+    append(buf, &len, tmp);
+    for (int d = 0; d < o->depth; d++) append(buf, &len, "(");
+
+    int operands = 0;
+    int open = o->depth;
+    while (len < o->line_length || operands < 2) {
+        if (operands > 0) {
+            if (is_string) append(buf, &len, " + ");
+            else append(buf, &len, (const char*[]){" + ", " - ", " * "}[(int)(rnd() * 3)]);
+        }
+        if (rnd() < o->ident_density) {
+            sprintf(tmp, "%c%d", is_string ? 's' : 'n', (int)(rnd() * (is_string ? 4 : 10)));
+        } else if (is_string) {
+            sprintf(tmp, "\"lit%d\\t\"", (int)(rnd() * 1000));
+        } else {
+            sprintf(tmp, "%d", (int)(rnd() * 100));
+        }
+        append(buf, &len, tmp);
+        operands++;
+        if (open > 0 && operands % 2 == 0) {
+            append(buf, &len, ")");
+            open--;
+        }
+    }
+    while (open-- > 0) append(buf, &len, ")");
+    return buf;
+}
+
+static int count_nodes(ASTNode* node, int operators_only){
+    if (!node) return 0;
+    switch (node->type) {
+        case AST_OPERATOR:
+            return 1 + count_nodes(node->operate.left, operators_only) + count_nodes(node->operate.right, operators_only);
+        case AST_ASSIGNMENT:
+            return !operators_only + count_nodes(node->assign.value, operators_only);
+        default:
+            return !operators_only;
+    }
+}
+
+static void report(const char* stage, double seconds, const char* unit, double count, double bytes){
+    printf("%-6s %10.3f ms  %12.0f %s/s", stage, seconds * 1e3, count / seconds, unit);
+    if (bytes > 0) printf("  %8.2f MB/s", bytes / seconds / 1e6);
+    printf("\n");
+}
+
+int main(int argc, char* argv[]){
+    Options o = { 2000, 20, 80, 0.5, 0.2, 2, 1, NULL };
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--lines") == 0) o.lines = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--reps") == 0) o.reps = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--line-length") == 0) o.line_length = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--ident-density") == 0) o.ident_density = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--string-ratio") == 0) o.string_ratio = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--depth") == 0) o.depth = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--seed") == 0) o.seed = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--stage") == 0) o.stage = argv[i + 1];
+        else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (o.line_length > 900) o.line_length = 900; // tokenize() is line based, 1000 tokens max
+    rng_state = o.seed;
+    Interpreter* interp = minipy_create();
+
+    char** src = malloc(sizeof(char*) * o.lines);
+    double bytes = 0;
+    for (int i = 0; i < o.lines; i++) {
+        src[i] = generate_line(&o, i);
+        bytes += strlen(src[i]);
+    }
+    printf("%d lines, %.0f bytes, ident density %.2f, string ratio %.2f, depth %d, %d reps\n",
+           o.lines, bytes, o.ident_density, o.string_ratio, o.depth, o.reps);
+
+    // Lexer: raw text to tokens, including the token text copies
+    Token** line_tokens = malloc(sizeof(Token*) * o.lines);
+    int* line_counts = malloc(sizeof(int) * o.lines);
+    double token_total = 0;
+    uint64_t start = timer_ns();
+    for (int r = 0; r < o.reps; r++) {
+        for (int i = 0; i < o.lines; i++) {
+            allocate_tokens(interp);
+            tokenize(interp, src[i]);
+            if (r == o.reps - 1) {
+                // keep the last run's tokens for the parser stage
+                line_tokens[i] = interp->tokens;
+                line_counts[i] = interp->token_count;
+                interp->tokens = NULL;
+                interp->token_count = 0;
+                interp->current = 0;
+            } else {
+                token_total += interp->token_count;
+                reset_tokens(interp);
+            }
+        }
+    }
+    double lex_s = (timer_ns() - start) / 1e9;
+    for (int i = 0; i < o.lines; i++) token_total += line_counts[i];
+    if (!o.stage || strcmp(o.stage, "lex") == 0) report("lex", lex_s, "tokens", token_total, bytes * o.reps);
+
+    // Parser: token arrays to trees; tokens are only read, so they are reused
+    ASTNode** trees = malloc(sizeof(ASTNode*) * o.lines);
+    double node_total = 0;
+    start = timer_ns();
+    for (int r = 0; r < o.reps; r++) {
+        for (int i = 0; i < o.lines; i++) {
+            interp->tokens = line_tokens[i];
+            interp->token_count = line_counts[i];
+            interp->current = 0;
+            ASTNode* tree = parse_statement(interp, NULL);
+            if (r == o.reps - 1) {
+                trees[i] = tree;
+            } else {
+                node_total += count_nodes(tree, 0);
+                ast_free(tree);
+            }
+        }
+    }
+    double parse_s = (timer_ns() - start) / 1e9;
+    for (int i = 0; i < o.lines; i++) node_total += count_nodes(trees[i], 0);
+    interp->tokens = NULL;
+    if (interp->error) {
+        fprintf(stderr, "generated source failed to parse\n");
+        return 1;
+    }
+    if (!o.stage || strcmp(o.stage, "parse") == 0) report("parse", parse_s, "nodes", node_total, 0);
+
+    // Evaluator: operator evaluation over pre-built trees
+    for (int i = 0; i < 10; i++) {
+        char name[8];
+        sprintf(name, "n%d", i);
+        set_variable(interp, name, (Literal){ .datatype = INT, .numeric = i + 1 });
+    }
+    for (int i = 0; i < 4; i++) {
+        char name[8];
+        sprintf(name, "s%d", i);
+        set_variable(interp, name, (Literal){ .datatype = STRING, .string = "str" });
+    }
+    double op_total = 0;
+    for (int i = 0; i < o.lines; i++) op_total += count_nodes(trees[i], 1);
+    op_total *= o.reps;
+    ErrorFrame frame;
+    error_push(interp, &frame);
+    if (setjmp(frame.env)) {
+        fprintf(stderr, "generated source failed to evaluate\n");
+        return 1;
+    }
+    start = timer_ns();
+    for (int r = 0; r < o.reps; r++) {
+        for (int i = 0; i < o.lines; i++) eval(interp, trees[i]);
+    }
+    double eval_s = (timer_ns() - start) / 1e9;
+    error_pop(interp, &frame);
+    if (!o.stage || strcmp(o.stage, "eval") == 0) report("eval", eval_s, "ops", op_total, 0);
+
+    for (int i = 0; i < o.lines; i++) {
+        ast_free(trees[i]);
+        interp->tokens = line_tokens[i];
+        interp->token_count = line_counts[i];
+        reset_tokens(interp);
+        free(src[i]);
+    }
+    free(trees);
+    free(line_tokens);
+    free(line_counts);
+    free(src);
+    minipy_destroy(interp);
+    return 0;
+}
@@ -0,0 +1,249 @@
+#!/usr/bin/env python3
+"""Benchmark harness for the MiniPy interpreter.
+
+Runs every workload with warmup runs and repetitions and reports the
+median and median absolute deviation (MAD) of the wall-clock time.
+
+    python3 bench/run.py --interp ./interpreter
+    python3 bench/run.py --interp ./interpreter --size large --json out.json
+    python3 bench/run.py --interp ./new --baseline ./old --threshold 5
+
+With --baseline both binaries run the same generated scripts, interleaved
+rep by rep, and the run fails (exit status 1) if any workload is slower
+than the baseline by more than --threshold percent beyond the noise.
+--baseline-arg gives the baseline its own arguments, and on its own
+compares --interp against itself, say to pick a memory manager:
+
+    python3 bench/run.py --interp ./interpreter --filter alloc \
+        --arg=--gc=generational --baseline-arg=--gc=refcount
+
+With --counters the measured interpreter is run again with
+--perf-counters and the median hardware counters (cycles, instructions,
+branch-misses, L1d/LLC misses, page-faults) are reported per phase. The
+extra runs are kept out of the timings. Counters the kernel refuses to
+open (no PMU in a VM, perf_event_paranoid) are shown as "-".
+
+Workloads are templates in bench/workloads (@N@ is replaced with the size)
+or generated below when their shape depends on the size.
+"""
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+WORKLOAD_DIR = os.path.join(HERE, "workloads")
+
+SIZES = {"small": 0.1, "medium": 1.0, "large": 10.0}
+
+
+def template(name):
+    def generate(n):
+        with open(os.path.join(WORKLOAD_DIR, name + ".sap")) as f:
+            return f.read().replace("@N@", str(n))
+    return generate
+
+
+def if_elif_chain(n, depth=64):
+    lines = ["i = 0", "k = 0", "hits = 0", "while i < %d:" % n]
+    for d in range(depth):
+        keyword = "if" if d == 0 else "elif"
+        lines.append("    %s k == %d:" % (keyword, d))
+        lines.append("        hits = hits + %d" % (d % 3))
+    lines.append("    else:")
+    lines.append("        pass")
+    lines.append("    k = k + 1")
+    lines.append("    if k == %d:" % depth)
+    lines.append("        k = 0")
+    lines.append("    i = i + 1")
+    lines.append("print(hits)")
+    return "\n".join(lines) + "\n"
+
+
+def dict_lookup(n, depth=64):
+    # the map if_elif_chain spells out as branches
+    items = ", ".join("%d: %d" % (d, d % 3) for d in range(depth))
+    lines = ["table = {%s}" % items, "i = 0", "k = 0", "hits = 0",
+             "while i < %d:" % n,
+             "    hits = hits + table[k]",
+             "    k = k + 1",
+             "    if k == %d:" % depth,
+             "        k = 0",
+             "    i = i + 1",
+             "print(hits)"]
+    return "\n".join(lines) + "\n"
+
+
+def many_variables(n, count=500):
+    lines = ["v%d = %d" % (v, v) for v in range(count)]
+    lines += [
+        "i = 0",
+        "t = 0",
+        "while i < %d:" % n,
+        "    t = v0 + v%d + v%d" % (count // 2, count - 1),
+        "    v%d = v%d + 1" % (count - 1, count - 1),
+        "    i = i + 1",
+        "print(t)",
+    ]
+    return "\n".join(lines) + "\n"
+
+
+# name -> (generator, medium size)
+WORKLOADS = {
+    "int_loop": (template("int_loop"), 1000000),
+    "for_loop": (template("for_loop"), 1000000),
+    "call": (template("call"), 1000000),
+    "attr": (template("attr"), 500000),
+    "float_accum": (template("float_accum"), 500000),
+    "string_concat": (template("string_concat"), 10000),
+    "alloc": (template("alloc"), 300000),
+    "if_elif_chain": (if_elif_chain, 20000),
+    "dict_lookup": (dict_lookup, 20000),
+    "many_variables": (many_variables, 20000),
+    "print_loop": (template("print_loop"), 100000),
+}
+
+
+def run_once(interp, script, extra_args):
+    start = time.perf_counter()
+    proc = subprocess.run([interp] + extra_args + [script],
+                          stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    elapsed = time.perf_counter() - start
+    if proc.returncode != 0:
+        raise RuntimeError("%s failed on %s (exit %d): %s" % (
+            interp, script, proc.returncode, proc.stderr.decode(errors="replace")))
+    return elapsed
+
+
+def summarize(samples):
+    median = statistics.median(samples)
+    mad = statistics.median(abs(s - median) for s in samples)
+    return {"median": median, "mad": mad, "min": min(samples), "samples": samples}
+
+
+def measure(runs, script, warmup, reps):
+    # runs: (binary, extra arguments) pairs
+    for _ in range(warmup):
+        for interp, extra_args in runs:
+            run_once(interp, script, extra_args)
+    samples = [[] for _ in runs]
+    for _ in range(reps):
+        # interleave binaries so drift affects both equally
+        for i, (interp, extra_args) in enumerate(runs):
+            samples[i].append(run_once(interp, script, extra_args))
+    return [summarize(s) for s in samples]
+
+
+PHASES = ("lex", "parse", "eval")
+
+
+def measure_counters(interp, script, reps, extra_args, tmp):
+    report = os.path.join(tmp, "counters.json")
+    runs = []
+    for _ in range(reps):
+        run_once(interp, script, extra_args + ["--perf-counters=" + report])
+        with open(report) as f:
+            runs.append(json.load(f))
+    result = {"available": dict(zip(runs[0]["counters"], runs[0]["available"])), "phases": {}}
+    for phase in PHASES:
+        result["phases"][phase] = {}
+        for name in ["ns"] + runs[0]["counters"]:
+            values = [r["phases"][phase][name] for r in runs]
+            result["phases"][phase][name] = None if None in values else statistics.median(values)
+    return result
+
+
+def print_counters(counters):
+    names = list(counters["available"])
+    print("    %-6s %12s" % ("phase", "ms") + "".join(" %14s" % n for n in names))
+    for phase in PHASES:
+        values = counters["phases"][phase]
+        line = "    %-6s %12.2f" % (phase, values["ns"] / 1e6)
+        for n in names:
+            line += " %14s" % ("-" if values[n] is None else "%.0f" % values[n])
+        print(line)
+    if not counters["available"].get("cycles"):
+        print("    (hardware counters unavailable)")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--interp", required=True, help="interpreter binary to measure")
+    parser.add_argument("--baseline", help="binary to compare against")
+    parser.add_argument("--size", choices=SIZES, default="medium")
+    parser.add_argument("--scale", type=float, default=1.0, help="extra size multiplier")
+    parser.add_argument("--warmup", type=int, default=1)
+    parser.add_argument("--reps", type=int, default=5)
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="regression threshold in percent (default 5)")
+    parser.add_argument("--filter", default="", help="only run workloads containing this")
+    parser.add_argument("--json", help="write results to this file")
+    parser.add_argument("--counters", action="store_true",
+                        help="also collect per-phase perf counters for --interp")
+    parser.add_argument("--arg", action="append", default=[],
+                        help="extra interpreter argument (repeatable)")
+    parser.add_argument("--baseline-arg", action="append",
+                        help="extra argument for the baseline instead of --arg (repeatable)")
+    args = parser.parse_args()
+
+    if args.baseline_arg is not None and not args.baseline:
+        args.baseline = args.interp
+    runs = [(args.interp, args.arg)]
+    if args.baseline:
+        runs.append((args.baseline, args.arg if args.baseline_arg is None else args.baseline_arg))
+    results = {"size": args.size, "scale": args.scale, "reps": args.reps,
+               "interp": args.interp, "baseline": args.baseline, "args": args.arg,
+               "baseline_args": runs[1][1] if args.baseline else None, "workloads": {}}
+    regressions = []
+
+    with tempfile.TemporaryDirectory() as tmp:
+        for name, (generate, medium) in WORKLOADS.items():
+            if args.filter not in name:
+                continue
+            n = max(1, int(medium * SIZES[args.size] * args.scale))
+            script = os.path.join(tmp, name + ".sap")
+            with open(script, "w") as f:
+                f.write(generate(n))
+
+            stats = measure(runs, script, args.warmup, args.reps)
+            entry = {"n": n, "interp": stats[0]}
+            line = "%-16s n=%-9d median %9.2f ms  mad %7.2f ms" % (
+                name, n, stats[0]["median"] * 1e3, stats[0]["mad"] * 1e3)
+
+            if args.baseline:
+                base = stats[1]
+                change = (stats[0]["median"] / base["median"] - 1.0) * 100.0
+                noise = 2.0 * (stats[0]["mad"] + base["mad"])
+                slower = stats[0]["median"] - base["median"]
+                regressed = change > args.threshold and slower > noise
+                entry.update({"baseline": base, "change_pct": change, "regression": regressed})
+                line += "  base %9.2f ms  %+6.1f%%%s" % (
+                    base["median"] * 1e3, change, "  REGRESSION" if regressed else "")
+                if regressed:
+                    regressions.append(name)
+
+            results["workloads"][name] = entry
+            print(line, flush=True)
+
+            if args.counters:
+                entry["counters"] = measure_counters(args.interp, script, args.reps, args.arg, tmp)
+                print_counters(entry["counters"])
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(results, f, indent=2)
+
+    if regressions:
+        print("regressions beyond %.1f%%: %s" % (args.threshold, ", ".join(regressions)))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,146 @@
+// bench/scale.c
+// Throughput of one compiled program run by several threads at once.
+//
+// Build from the repository root, linking everything but main.c:
+//   gcc -O2 -I. bench/scale.c $(ls *.c | grep -v main.c) -o scale -lpthread
+//
+//   ./scale [--runs N] [--n N] [--threads N] [--script path]
+//
+// The script is compiled once and then run --runs times in total, split
+// evenly between the threads; each thread has its own interpreter and sets
+// the input n before every run. The first line re-lexes and re-parses the
+// source on every run, as minipy_run_string() does, for comparison.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "minipy.h"
+#include "timer.h"
+
+static const char* default_script =
+    "i = 0\n"
+    "t = 0\n"
+    "while i < n:\n"
+    "    if i > n / 2:\n"
+    "        t = t + i * 3\n"
+    "    else:\n"
+    "        t = t - i\n"
+    "    i = i + 1\n";
+
+typedef struct {
+    const Program* program;
+    int runs;
+    int n;
+    int failed;
+    pthread_t thread;
+} Worker;
+
+static void* work(void* arg){
+    Worker* w = arg;
+    Interpreter* interp = minipy_create();
+    if (!interp){
+        w->failed = 1;
+        return NULL;
+    }
+    for (int r = 0; r < w->runs; r++) {
+        minipy_set_int(interp, "n", w->n + r % 16);
+        if (minipy_run_program(interp, w->program)) {
+            w->failed = 1;
+            break;
+        }
+    }
+    minipy_destroy(interp);
+    return NULL;
+}
+
+static char* read_file(const char* path){
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* buf = malloc(size + 1);
+    if (buf && fread(buf, 1, size, f) != (size_t)size) size = 0;
+    if (buf) buf[size] = '\0';
+    fclose(f);
+    return buf;
+}
+
+int main(int argc, char* argv[]){
+    int runs = 2000;
+    int n = 2000;
+    int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char* path = NULL;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--runs") == 0) runs = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--n") == 0) n = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--threads") == 0) max_threads = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--script") == 0) path = argv[i + 1];
+        else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (max_threads < 1) max_threads = 1;
+
+    char* source = path ? read_file(path) : strdup(default_script);
+    if (!source) {
+        perror("Failed to open file");
+        return 1;
+    }
+
+    Interpreter* compiler = minipy_create();
+    uint64_t start = timer_ns();
+    Program* program = minipy_compile_string(compiler, source);
+    double compile_s = (timer_ns() - start) / 1e9;
+    if (!program) {
+        fprintf(stderr, "script failed to compile\n");
+        return 1;
+    }
+    printf("%d runs, n=%d, compile %.3f ms\n", runs, n, compile_s * 1e3);
+
+    // Reference: what running the script costs without a shared program
+    int reparse_runs = runs / 10 > 0 ? runs / 10 : 1;
+    Interpreter* interp = minipy_create();
+    start = timer_ns();
+    for (int r = 0; r < reparse_runs; r++) {
+        minipy_set_int(interp, "n", n + r % 16);
+        minipy_run_string(interp, source);
+    }
+    double reparse_s = (timer_ns() - start) / 1e9;
+    minipy_destroy(interp);
+    printf("%-10s %10.1f runs/s\n", "reparse", reparse_runs / reparse_s);
+
+    Worker* workers = calloc(max_threads, sizeof(Worker));
+    double base = 0;
+    // 1, 2, 4, ... and finally every core
+    for (int threads = 1; threads <= max_threads;
+         threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2) {
+        start = timer_ns();
+        for (int t = 0; t < threads; t++) {
+            workers[t] = (Worker){ program, runs / threads + (t < runs % threads), n, 0 };
+            pthread_create(&workers[t].thread, NULL, work, &workers[t]);
+        }
+        int failed = 0;
+        for (int t = 0; t < threads; t++) {
+            pthread_join(workers[t].thread, NULL);
+            failed |= workers[t].failed;
+        }
+        double seconds = (timer_ns() - start) / 1e9;
+        if (failed) {
+            fprintf(stderr, "a run failed\n");
+            return 1;
+        }
+        double rate = runs / seconds;
+        if (threads == 1) base = rate;
+        printf("%2d thread%s %10.1f runs/s  speedup %5.2fx  efficiency %3.0f%%\n",
+               threads, threads == 1 ? " " : "s", rate, rate / base, rate / base / threads * 100);
+    }
+
+    minipy_program_free(program);
+    minipy_destroy(compiler);
+    free(workers);
+    free(source);
+    return 0;
+}
@@ -0,0 +1,93 @@
+// bytecode.h
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "memory.h"
+
+typedef struct ASTNode ASTNode;
+typedef struct Interpreter Interpreter;
+
+typedef enum {
+    OP_CONST,         // push constants[arg]
+    OP_LOAD,          // push variable names[arg]
+    OP_STORE,         // pop into variable names[arg]
+    OP_LOAD_LOCAL,    // push local slot arg, names[arg2] for errors
+    OP_STORE_LOCAL,   // pop into local slot arg
+    OP_BINARY,        // pop right, pop left, push left <op> right
+    OP_PRINT,         // pop and print
+    OP_JUMP,          // jump to arg
+    OP_JUMP_IF_FALSE, // pop, jump to arg if falsy
+    OP_LOOP,          // back-edge: jump to arg
+    OP_BREAK,         // leave the chunk signalling 'break' to the enclosing loop
+    OP_HALT,
+    OP_NOP,           // stands in for a statement with no code of its own, so it is counted
+    OP_CACHE_LOAD,    // push cse_slots[arg] and jump to arg2 if it holds a value
+    OP_CACHE_STORE,   // keep a copy of the top of the stack in cse_slots[arg]
+    OP_CACHE_CLEAR,   // release cse_slots[arg .. arg + arg2)
+    OP_BUILD_LIST,    // pop arg values, push a list of them
+    OP_BUILD_DICT,    // pop arg key, value pairs, push a dict of them
+    OP_INDEX,         // pop index, pop object, push object[index]
+    OP_STORE_INDEX,   // pop value, index and object: object[index] = value, or <binary>= when binary is set
+    OP_CALL,          // pop arg values, push builtin arg2 applied to them; names[arg3] for errors.
+                      // With BUILTIN_NONE, call the function or class bound to names[arg3]
+    OP_CALL_METHOD,   // pop arg values, the object first, and push method names[arg3] of it called on the rest:
+                      // builtin binary for a list, inline cache arg2 for an object
+    OP_GET_ATTR,      // pop object, push attribute names[arg] of it; inline cache arg2
+    OP_SET_ATTR,      // pop value and object: object.names[arg] = value, or <binary>= when binary is set
+    OP_RETURN,        // pop into interp->returned and leave the chunk signalling 'return'
+    OP_FOR_PREP,      // check the start, stop and step on the stack; pop them and jump to arg3 if the range is empty
+    OP_FOR_LOOP,      // step the counter and jump to arg3 while in range, else pop the loop state
+    OP_FOR_END,       // a 'break' leaves the for loop here: pop the loop state
+    // superinstructions produced by peephole()
+    OP_TEST_VAR_CONST, // names[arg] <binary> constants[arg2], jump to arg3 if false
+    OP_TEST_VAR_VAR,   // names[arg] <binary> names[arg2], jump to arg3 if false
+    OP_UPDATE_VAR,     // names[arg] = names[arg] <binary> constants[arg2]
+    OP_COUNT,
+} OpCode;
+
+typedef struct {
+    unsigned char op;
+    char binary;      // operator for OP_BINARY and the fused forms; for the OP_FOR_* ops, whether
+                      // names[arg] (local slot arg2 - 1 if arg2 is set) is written on every
+                      // iteration rather than once on exit
+    unsigned char stmt; // first instruction of a statement in a block
+    int arg;
+    int arg2;
+    int arg3;
+} Instr;
+
+typedef struct Chunk {
+    Instr* code;
+    int* lines; // source line of the statement each instruction belongs to
+    int count;
+    int capacity;
+
+    Literal* constants;
+    int const_count;
+
+    char** names;
+    int name_count;
+
+    int max_stack;
+    int resume; // a for loop's OP_FOR_LOOP, where the tree-walker hands over its counter
+} Chunk;
+
+const char* opcode_name(OpCode op);
+
+Chunk* compile_loop(Interpreter* interp, ASTNode* node, int* retry);
+void chunk_free(Chunk* chunk);
+void print_chunk_debug(FILE* out, Chunk* chunk);
+
+void peephole(Chunk* chunk);
+
+extern int peephole_enabled;
+extern int pair_profile_enabled;
+extern unsigned long long pair_counts[OP_COUNT][OP_COUNT];
+
+int write_pair_profile(const char* path);
+int fusion_report(const char* paths);
+
+int vm_run(Interpreter* interp, Chunk* chunk);
+int vm_resume(Interpreter* interp, Chunk* chunk, int pc, const Literal* stack, int count);
+
+#endif
@@ -0,0 +1,582 @@
+// compiler.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lexer.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "interpreter.h"
+#include "error_handling.h"
+#include "optimize.h"
+#include "context.h"
+#include "stats.h"
+#include "debug_alloc.h"
+
+typedef struct {
+    Interpreter* interp;
+    Chunk* chunk;
+    int depth;
+    int* breaks; // jumps to patch at the end of the innermost loop
+    int break_count;
+    int break_capacity;
+    int in_loop;
+    int lazy; // hit a body that has not been parsed yet
+    int line; // of the statement being compiled, for chunk->lines
+    int stmt; // the next instruction starts a block statement
+} Compiler;
+
+const char* opcode_name(OpCode op) {
+    switch (op) {
+        case OP_CONST: return "CONST";
+        case OP_LOAD: return "LOAD";
+        case OP_STORE: return "STORE";
+        case OP_LOAD_LOCAL: return "LOAD_LOCAL";
+        case OP_STORE_LOCAL: return "STORE_LOCAL";
+        case OP_BINARY: return "BINARY";
+        case OP_PRINT: return "PRINT";
+        case OP_JUMP: return "JUMP";
+        case OP_JUMP_IF_FALSE: return "JUMP_IF_FALSE";
+        case OP_LOOP: return "LOOP";
+        case OP_BREAK: return "BREAK";
+        case OP_HALT: return "HALT";
+        case OP_NOP: return "NOP";
+        case OP_CACHE_LOAD: return "CACHE_LOAD";
+        case OP_CACHE_STORE: return "CACHE_STORE";
+        case OP_CACHE_CLEAR: return "CACHE_CLEAR";
+        case OP_BUILD_LIST: return "BUILD_LIST";
+        case OP_BUILD_DICT: return "BUILD_DICT";
+        case OP_INDEX: return "INDEX";
+        case OP_STORE_INDEX: return "STORE_INDEX";
+        case OP_CALL: return "CALL";
+        case OP_CALL_METHOD: return "CALL_METHOD";
+        case OP_GET_ATTR: return "GET_ATTR";
+        case OP_SET_ATTR: return "SET_ATTR";
+        case OP_RETURN: return "RETURN";
+        case OP_FOR_PREP: return "FOR_PREP";
+        case OP_FOR_LOOP: return "FOR_LOOP";
+        case OP_FOR_END: return "FOR_END";
+        case OP_TEST_VAR_CONST: return "TEST_VAR_CONST";
+        case OP_TEST_VAR_VAR: return "TEST_VAR_VAR";
+        case OP_UPDATE_VAR: return "UPDATE_VAR";
+        default: return "UNKNOWN";
+    }
+}
+
+static int emit(Compiler* c, OpCode op, char binary, int arg){
+    Chunk* chunk = c->chunk;
+    if (chunk->count == chunk->capacity){
+        int capacity = chunk->capacity ? chunk->capacity * 2 : 16;
+        Instr* tmp = realloc(chunk->code, sizeof(Instr) * capacity);
+        if (!tmp) return -1;
+        chunk->code = tmp;
+        int* lines = realloc(chunk->lines, sizeof(int) * capacity);
+        if (!lines) return -1;
+        chunk->lines = lines;
+        chunk->capacity = capacity;
+    }
+    chunk->lines[chunk->count] = c->line;
+    Instr* in = &chunk->code[chunk->count];
+    in->op = op;
+    in->binary = binary;
+    in->stmt = c->stmt;
+    c->stmt = 0;
+    in->arg = arg;
+    in->arg2 = 0;
+    in->arg3 = 0;
+
+    switch (op){
+        case OP_CONST: case OP_LOAD: case OP_LOAD_LOCAL: c->depth++; break;
+        case OP_STORE: case OP_STORE_LOCAL: case OP_BINARY: case OP_PRINT: case OP_JUMP_IF_FALSE: c->depth--; break;
+        case OP_INDEX: case OP_RETURN: c->depth--; break;
+        case OP_SET_ATTR: c->depth -= 2; break;
+        case OP_STORE_INDEX: case OP_FOR_LOOP: case OP_FOR_END: c->depth -= 3; break;
+        case OP_BUILD_LIST: case OP_CALL: case OP_CALL_METHOD: c->depth += 1 - arg; break;
+        case OP_BUILD_DICT: c->depth += 1 - 2 * arg; break;
+        default: break;
+    }
+    if (c->depth > chunk->max_stack) chunk->max_stack = c->depth;
+    return chunk->count++;
+}
+
+static int add_constant(Compiler* c, Literal lit){
+    Chunk* chunk = c->chunk;
+    Literal* tmp = realloc(chunk->constants, sizeof(Literal) * (chunk->const_count + 1));
+    if (!tmp) return -1;
+    chunk->constants = tmp;
+    // the chunk keeps its strings itself, out of reach of the collector
+    lit.owns_str = 0;
+    if (lit.datatype == STRING){
+        size_t len = strlen(lit.string);
+        char* copy = malloc(len + 1);
+        if (!copy) return -1;
+        memcpy(copy, lit.string, len + 1);
+        stats_string(&c->interp->stats, len + 1, len);
+        lit.string = copy;
+        lit.owns_str = 1;
+    }
+    chunk->constants[chunk->const_count] = lit;
+    return chunk->const_count++;
+}
+
+static int add_name(Chunk* chunk, const char* name){
+    for (int i = 0; i < chunk->name_count; i++){
+        if (strcmp(chunk->names[i], name) == 0) return i;
+    }
+    char** tmp = realloc(chunk->names, sizeof(char*) * (chunk->name_count + 1));
+    if (!tmp) return -1;
+    chunk->names = tmp;
+    chunk->names[chunk->name_count] = strdup(name);
+    return chunk->name_count++;
+}
+
+static int compile_expression(Compiler* c, ASTNode* node){
+    if (!node) return 0;
+    switch (node->type){
+        case AST_NONE:
+        case AST_NUMERIC:
+        case AST_FLOATING_POINT:
+        case AST_STRING:
+        case AST_BOOLEAN: {
+            int idx = add_constant(c, node->literal);
+            return idx >= 0 && emit(c, OP_CONST, 0, idx) >= 0;
+        }
+        case AST_IDENTIFIER: {
+            int idx = add_name(c->chunk, node->name);
+            return idx >= 0 && emit(c, OP_LOAD, 0, idx) >= 0;
+        }
+        case AST_LOCAL: {
+            int idx = add_name(c->chunk, node->local.name);
+            if (idx < 0 || emit(c, OP_LOAD_LOCAL, 0, node->local.slot) < 0) return 0;
+            c->chunk->code[c->chunk->count - 1].arg2 = idx;
+            return 1;
+        }
+        case AST_OPERATOR:
+            if (!compile_expression(c, node->operate.left)) return 0;
+            if (!compile_expression(c, node->operate.right)) return 0;
+            return emit(c, OP_BINARY, node->operate.op, 0) >= 0;
+        case AST_CACHED: {
+            int load = emit(c, OP_CACHE_LOAD, 0, node->cached.slot);
+            if (load < 0) return 0;
+            if (!compile_expression(c, node->cached.expr)) return 0;
+            if (emit(c, OP_CACHE_STORE, 0, node->cached.slot) < 0) return 0;
+            c->chunk->code[load].arg2 = c->chunk->count;
+            return 1;
+        }
+        case AST_SCOPE:
+            if (!compile_expression(c, node->scope.body)) return 0;
+            if (emit(c, OP_CACHE_CLEAR, 0, node->scope.first) < 0) return 0;
+            c->chunk->code[c->chunk->count - 1].arg2 = node->scope.count;
+            return 1;
+        case AST_LIST:
+            for (int i = 0; i < node->list.count; i++){
+                if (!compile_expression(c, node->list.items[i])) return 0;
+            }
+            return emit(c, OP_BUILD_LIST, 0, node->list.count) >= 0;
+        case AST_DICT:
+            for (int i = 0; i < node->list.count; i++){
+                if (!compile_expression(c, node->list.items[i])) return 0;
+            }
+            return emit(c, OP_BUILD_DICT, 0, node->list.count / 2) >= 0;
+        case AST_INDEX:
+            if (!compile_expression(c, node->index.target)) return 0;
+            if (!compile_expression(c, node->index.index)) return 0;
+            return emit(c, OP_INDEX, 0, 0) >= 0;
+        case AST_CALL: {
+            for (int i = 0; i < node->call.count; i++){
+                if (!compile_expression(c, node->call.args[i])) return 0;
+            }
+            int name = add_name(c->chunk, node->call.name);
+            if (name < 0) return 0;
+            if (node->call.method){
+                if (emit(c, OP_CALL_METHOD, node->call.builtin, node->call.count) < 0) return 0;
+                c->chunk->code[c->chunk->count - 1].arg2 = node->call.site;
+            } else {
+                if (emit(c, OP_CALL, 0, node->call.count) < 0) return 0;
+                c->chunk->code[c->chunk->count - 1].arg2 = node->call.builtin;
+            }
+            c->chunk->code[c->chunk->count - 1].arg3 = name;
+            return 1;
+        }
+        case AST_ATTR: {
+            if (!compile_expression(c, node->attr.object)) return 0;
+            int name = add_name(c->chunk, node->attr.name);
+            if (name < 0 || emit(c, OP_GET_ATTR, 0, name) < 0) return 0;
+            c->chunk->code[c->chunk->count - 1].arg2 = node->attr.site;
+            return 1;
+        }
+        default:
+            return 0;
+    }
+}
+
+static int compile_statement(Compiler* c, ASTNode* node);
+static int compile_node(Compiler* c, ASTNode* node);
+
+static int compile_while(Compiler* c, ASTNode* node){
+    // the back edge re-enters at the condition, so a nested loop is
+    // counted as a statement ahead of it
+    if (c->stmt && emit(c, OP_NOP, 0, 0) < 0) return 0;
+
+    int* outer_breaks = c->breaks;
+    int outer_count = c->break_count, outer_capacity = c->break_capacity;
+    int outer_in_loop = c->in_loop;
+    c->breaks = NULL;
+    c->break_count = c->break_capacity = 0;
+
+    int ok = 0;
+    int loop_start = c->chunk->count;
+    if (!compile_expression(c, node->construct.condition)) goto end;
+    int exit_jump = emit(c, OP_JUMP_IF_FALSE, 0, 0);
+    if (exit_jump < 0) goto end;
+
+    c->in_loop = 1;
+    if (!compile_statement(c, node->construct.code)) goto end;
+    if (emit(c, OP_LOOP, 0, loop_start) < 0) goto end;
+
+    // 'break' inside the else clause belongs to the enclosing loop
+    c->chunk->code[exit_jump].arg = c->chunk->count;
+    c->in_loop = outer_in_loop;
+    int* breaks = c->breaks;
+    int break_count = c->break_count;
+    c->breaks = outer_breaks;
+    c->break_count = outer_count;
+    c->break_capacity = outer_capacity;
+    ok = compile_statement(c, node->construct.next);
+
+    for (int i = 0; i < break_count; i++){
+        c->chunk->code[breaks[i]].arg = c->chunk->count;
+    }
+    free(breaks);
+    return ok;
+
+    end:
+        free(c->breaks);
+        c->breaks = outer_breaks;
+        c->break_count = outer_count;
+        c->break_capacity = outer_capacity;
+        c->in_loop = outer_in_loop;
+        return 0;
+}
+
+static int compile_int(Compiler* c, int value){
+    Literal lit;
+    lit.datatype = INT;
+    lit.owns_str = 0;
+    lit.numeric = value;
+    int idx = add_constant(c, lit);
+    return idx >= 0 && emit(c, OP_CONST, 0, idx) >= 0;
+}
+
+// The start, stop and step stay on the stack for the whole loop, so the
+// counter is never boxed into a variable the body does not use. *loop_pc
+// receives the position of the back-edge.
+static int compile_for(Compiler* c, ASTNode* node, int* loop_pc){
+    ASTNode* range = node->construct.condition;
+    ASTNode* body = node->construct.code;
+    if (body->block.lazy){
+        c->lazy = 1;
+        return 0;
+    }
+    int reads = uses_variable(body, node->construct.name);
+    int name = add_name(c->chunk, node->construct.name);
+    int local = node->construct.slot + 1;
+    if (name < 0) return 0;
+    if (range->call.count == 1 && !compile_int(c, 0)) return 0;
+    for (int i = 0; i < range->call.count; i++){
+        if (!compile_expression(c, range->call.args[i])) return 0;
+    }
+    if (range->call.count < 3 && !compile_int(c, 1)) return 0;
+    int prep = emit(c, OP_FOR_PREP, reads, name);
+    if (prep < 0) return 0;
+    c->chunk->code[prep].arg2 = local;
+
+    int* outer_breaks = c->breaks;
+    int outer_count = c->break_count, outer_capacity = c->break_capacity;
+    int outer_in_loop = c->in_loop;
+    c->breaks = NULL;
+    c->break_count = c->break_capacity = 0;
+
+    int body_start = c->chunk->count;
+    c->in_loop = 1;
+    if (!compile_statement(c, body)) goto end;
+    int loop = emit(c, OP_FOR_LOOP, reads, name);
+    if (loop < 0) goto end;
+    c->chunk->code[loop].arg2 = local;
+    c->chunk->code[loop].arg3 = body_start;
+    c->chunk->code[prep].arg3 = c->chunk->count;
+    if (loop_pc) *loop_pc = loop;
+
+    c->in_loop = outer_in_loop;
+    int* breaks = c->breaks;
+    int break_count = c->break_count;
+    c->breaks = outer_breaks;
+    c->break_count = outer_count;
+    c->break_capacity = outer_capacity;
+    int ok = compile_statement(c, node->construct.next);
+    if (ok && break_count){
+        // breaks skip the else clause and land on an OP_FOR_END, which
+        // still finds the loop state on the stack
+        int jump = emit(c, OP_JUMP, 0, 0);
+        c->depth += 3;
+        int exit = jump < 0 ? -1 : emit(c, OP_FOR_END, reads, name);
+        if (exit < 0){
+            ok = 0;
+        } else {
+            c->chunk->code[exit].arg2 = local;
+            for (int i = 0; i < break_count; i++){
+                c->chunk->code[breaks[i]].arg = exit;
+            }
+            c->chunk->code[jump].arg = c->chunk->count;
+        }
+    }
+    free(breaks);
+    return ok;
+
+    end:
+        free(c->breaks);
+        c->breaks = outer_breaks;
+        c->break_count = outer_count;
+        c->break_capacity = outer_capacity;
+        c->in_loop = outer_in_loop;
+        return 0;
+}
+
+static int compile_break(Compiler* c){
+    if (!c->in_loop) return emit(c, OP_BREAK, 0, 0) >= 0;
+
+    int jump = emit(c, OP_JUMP, 0, 0);
+    if (jump < 0) return 0;
+    if (c->break_count == c->break_capacity){
+        int capacity = c->break_capacity ? c->break_capacity * 2 : 4;
+        int* tmp = realloc(c->breaks, sizeof(int) * capacity);
+        if (!tmp) return 0;
+        c->breaks = tmp;
+        c->break_capacity = capacity;
+    }
+    c->breaks[c->break_count++] = jump;
+    return 1;
+}
+
+static int compile_node(Compiler* c, ASTNode* node){
+    if (!node) return 1;
+    switch (node->type){
+        case AST_NONE:
+            return 1;
+
+        case AST_PASS:
+            return !c->stmt || emit(c, OP_NOP, 0, 0) >= 0;
+
+        case AST_NUMERIC:
+        case AST_FLOATING_POINT:
+        case AST_STRING:
+        case AST_BOOLEAN:
+        case AST_IDENTIFIER:
+        case AST_LOCAL:
+        case AST_OPERATOR:
+        case AST_CACHED:
+        case AST_LIST:
+        case AST_DICT:
+        case AST_INDEX:
+        case AST_ATTR:
+        case AST_CALL:
+            if (!compile_expression(c, node)) return 0;
+            return emit(c, OP_PRINT, 0, 0) >= 0;
+
+        case AST_INDEX_ASSIGN:
+            if (!compile_expression(c, node->index.target)) return 0;
+            if (!compile_expression(c, node->index.index)) return 0;
+            if (!compile_expression(c, node->index.value)) return 0;
+            return emit(c, OP_STORE_INDEX, node->index.op == '=' ? 0 : node->index.op, 0) >= 0;
+
+        case AST_ATTR_ASSIGN: {
+            if (!compile_expression(c, node->attr.object)) return 0;
+            if (!compile_expression(c, node->attr.value)) return 0;
+            int name = add_name(c->chunk, node->attr.name);
+            if (name < 0 || emit(c, OP_SET_ATTR, node->attr.op == '=' ? 0 : node->attr.op, name) < 0) return 0;
+            c->chunk->code[c->chunk->count - 1].arg2 = node->attr.site;
+            return 1;
+        }
+
+        case AST_SCOPE:
+            if (!compile_statement(c, node->scope.body)) return 0;
+            if (emit(c, OP_CACHE_CLEAR, 0, node->scope.first) < 0) return 0;
+            c->chunk->code[c->chunk->count - 1].arg2 = node->scope.count;
+            return 1;
+
+        case AST_PRINT:
+            if (!node->print.value) return 1;
+            if (node->print.value->type == AST_NONE) return 1;
+            if (!compile_expression(c, node->print.value)) return 0;
+            return emit(c, OP_PRINT, 0, 0) >= 0;
+
+        case AST_ASSIGNMENT: {
+            ASTNode* value = node->assign.value;
+            if (!value) return 0;
+            switch (value->type){
+                case AST_NONE: case AST_NUMERIC: case AST_FLOATING_POINT:
+                case AST_STRING: case AST_BOOLEAN: case AST_IDENTIFIER: case AST_LOCAL: case AST_OPERATOR:
+                case AST_CACHED: case AST_SCOPE: case AST_LIST: case AST_DICT: case AST_INDEX: case AST_ATTR:
+                case AST_CALL:
+                    break;
+                default:
+                    return 0; // left to the tree-walker, which reports the error
+            }
+            if (!compile_expression(c, value)) return 0;
+            if (node->assign.slot >= 0) return emit(c, OP_STORE_LOCAL, 0, node->assign.slot) >= 0;
+            int idx = add_name(c->chunk, node->assign.name);
+            return idx >= 0 && emit(c, OP_STORE, 0, idx) >= 0;
+        }
+
+        case AST_RETURN:
+            if (node->ret.value){
+                if (!compile_expression(c, node->ret.value)) return 0;
+            } else {
+                Literal none;
+                none.datatype = NONE;
+                none.owns_str = 0;
+                int idx = add_constant(c, none);
+                if (idx < 0 || emit(c, OP_CONST, 0, idx) < 0) return 0;
+            }
+            return emit(c, OP_RETURN, 0, 0) >= 0;
+
+        case AST_BREAK:
+            return compile_break(c);
+
+        case AST_BLOCK:
+            if (node->block.lazy){
+                c->lazy = 1;
+                return 0;
+            }
+            for (int i = 0; i < node->block.count; i++){
+                c->stmt = 1;
+                if (!compile_statement(c, node->block.statements[i])) return 0;
+                c->stmt = 0;
+            }
+            return 1;
+
+        case AST_IF:
+        case AST_ELIF: {
+            if (!compile_expression(c, node->construct.condition)) return 0;
+            int else_jump = emit(c, OP_JUMP_IF_FALSE, 0, 0);
+            if (else_jump < 0) return 0;
+            if (!compile_statement(c, node->construct.code)) return 0;
+            if (!node->construct.next){
+                c->chunk->code[else_jump].arg = c->chunk->count;
+                return 1;
+            }
+            int end_jump = emit(c, OP_JUMP, 0, 0);
+            if (end_jump < 0) return 0;
+            c->chunk->code[else_jump].arg = c->chunk->count;
+            if (!compile_statement(c, node->construct.next)) return 0;
+            c->chunk->code[end_jump].arg = c->chunk->count;
+            return 1;
+        }
+
+        case AST_ELSE:
+            return compile_statement(c, node->construct.code);
+
+        case AST_WHILE:
+            return compile_while(c, node);
+
+        case AST_FOR:
+            return compile_for(c, node, NULL);
+
+        default:
+            return 0;
+    }
+}
+
+// Instructions take the line of their statement, as interp->error_line
+// does in the tree-walker: an elif or else reports the line of its if.
+static int compile_statement(Compiler* c, ASTNode* node){
+    int line = c->line;
+    if (node && node->line > 0 && node->type != AST_ELIF && node->type != AST_ELSE) c->line = node->line;
+    int ok = compile_node(c, node);
+    c->line = line;
+    return ok;
+}
+
+// Compiles a whole while or for statement (header, body and else clause).
+// Returns NULL if the loop contains anything the VM does not support,
+// in which case it stays on the tree-walking tier. *retry is set when the
+// only obstacle was a body that has not been parsed yet.
+Chunk* compile_loop(Interpreter* interp, ASTNode* node, int* retry){
+    Chunk* chunk = calloc(1, sizeof(Chunk));
+    if (!chunk) return NULL;
+    Compiler c = {0};
+    c.interp = interp;
+    c.chunk = chunk;
+    c.line = node->line;
+    int ok = node->type == AST_FOR ? compile_for(&c, node, &chunk->resume) : compile_while(&c, node);
+    if (!ok || emit(&c, OP_HALT, 0, 0) < 0){
+        if (retry) *retry = c.lazy;
+        chunk_free(c.chunk);
+        return NULL;
+    }
+    if (peephole_enabled) peephole(chunk);
+    return chunk;
+}
+
+void chunk_free(Chunk* chunk){
+    if (!chunk) return;
+    for (int i = 0; i < chunk->const_count; i++){
+        if (chunk->constants[i].owns_str) free(chunk->constants[i].string);
+    }
+    for (int i = 0; i < chunk->name_count; i++){
+        free(chunk->names[i]);
+    }
+    free(chunk->constants);
+    free(chunk->names);
+    free(chunk->code);
+    free(chunk->lines);
+    free(chunk);
+}
+
+void print_chunk_debug(FILE* out, Chunk* chunk){
+    for (int i = 0; i < chunk->count; i++){
+        Instr in = chunk->code[i];
+        fprintf(out, "%04d %-14s", i, opcode_name(in.op));
+        switch (in.op){
+            case OP_CONST: fprintf(out, " "); fprint_literal(out, chunk->constants[in.arg]); break;
+            case OP_LOAD:
+            case OP_STORE: fprintf(out, " %s\n", chunk->names[in.arg]); break;
+            case OP_LOAD_LOCAL: fprintf(out, " %s #%d\n", chunk->names[in.arg2], in.arg); break;
+            case OP_STORE_LOCAL: fprintf(out, " #%d\n", in.arg); break;
+            case OP_BINARY: fprintf(out, " '%c'\n", in.binary); break;
+            case OP_JUMP:
+            case OP_JUMP_IF_FALSE:
+            case OP_LOOP: fprintf(out, " -> %04d\n", in.arg); break;
+            case OP_TEST_VAR_CONST:
+                fprintf(out, " %s '%c' -> %04d ", chunk->names[in.arg], in.binary, in.arg3);
+                fprint_literal(out, chunk->constants[in.arg2]);
+                break;
+            case OP_CACHE_LOAD: fprintf(out, " #%d -> %04d\n", in.arg, in.arg2); break;
+            case OP_CACHE_STORE: fprintf(out, " #%d\n", in.arg); break;
+            case OP_CACHE_CLEAR: fprintf(out, " #%d..#%d\n", in.arg, in.arg + in.arg2 - 1); break;
+            case OP_BUILD_LIST:
+            case OP_BUILD_DICT: fprintf(out, " %d\n", in.arg); break;
+            case OP_STORE_INDEX:
+                if (in.binary) fprintf(out, " '%c'\n", in.binary);
+                else fprintf(out, "\n");
+                break;
+            case OP_CALL: fprintf(out, " %s %d\n", chunk->names[in.arg3], in.arg); break;
+            case OP_CALL_METHOD: fprintf(out, " .%s %d @%d\n", chunk->names[in.arg3], in.arg, in.arg2); break;
+            case OP_GET_ATTR: fprintf(out, " .%s @%d\n", chunk->names[in.arg], in.arg2); break;
+            case OP_SET_ATTR:
+                if (in.binary) fprintf(out, " .%s '%c' @%d\n", chunk->names[in.arg], in.binary, in.arg2);
+                else fprintf(out, " .%s @%d\n", chunk->names[in.arg], in.arg2);
+                break;
+            case OP_FOR_PREP:
+            case OP_FOR_LOOP: fprintf(out, " %s%s -> %04d\n", chunk->names[in.arg], in.binary ? "" : " (on exit)", in.arg3); break;
+            case OP_FOR_END: fprintf(out, " %s%s\n", chunk->names[in.arg], in.binary ? "" : " (on exit)"); break;
+            case OP_TEST_VAR_VAR:
+                fprintf(out, " %s '%c' %s -> %04d\n", chunk->names[in.arg], in.binary, chunk->names[in.arg2], in.arg3);
+                break;
+            case OP_UPDATE_VAR:
+                fprintf(out, " %s '%c' ", chunk->names[in.arg], in.binary);
+                fprint_literal(out, chunk->constants[in.arg2]);
+                break;
+            default: fprintf(out, "\n"); break;
+        }
+    }
+}
@@ -0,0 +1,93 @@
+// context.h
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <stdio.h>
+
+#include "lexer.h"
+#include "memory.h"
+#include "error_handling.h"
+#include "object.h"
+#include "optimize.h"
+#include "tier.h"
+#include "stats.h"
+#include "gc.h"
+
+// Everything one interpreter changes while it runs. The lexer, parser and
+// evaluator take the context they work on, so independent interpreters can
+// run side by side, one per thread. Process-wide settings (tier_config,
+// optimize_enabled, observers, the profiler and tracer) are only changed
+// before scripts start.
+typedef struct Interpreter {
+    // lexer and parser
+    Token* tokens;
+    int token_count;
+    int current; // next token for the parser
+
+    // script input: block() reads the lines of a block body from here
+    char** lines;
+    int* line_numbers; // source line of each entry, blank lines are not kept
+    int current_line;
+    int line_count;
+    LexedLines* lexed; // from lex_lines(); NULL when the lines were not lexed ahead
+    int lexing_ahead; // a lex_lines() worker: errors leave the line to tokenize()
+    int script;     // reading lines rather than prompting on stdin
+    int lazy_parse; // --lazy: parse block bodies the first time they run
+    int check_only; // --check: parse the whole script without running it
+    int in_function; // parsing a def body, where 'return' is allowed
+    int site_count;  // attribute and method call sites numbered so far, see object.h
+
+    // errors
+    int error; // set by raiseError(); the parser checks it
+    ErrorFrame* error_frame;
+    Error last_error;
+    int error_line; // line of the statement being parsed or run
+
+    // evaluator
+    Variable* symbol_table;
+    Literal* temps;
+    int temp_top;
+    Literal* stack; // locals of the running calls, see function.h
+    int stack_top;
+    int stack_capacity;
+    int frame;      // position of the innermost call's slot 0
+    int call_depth;
+    Literal returned; // set by 'return', taken by call_function()
+    InlineCache* caches; // by site, grown as sites run
+    int cache_capacity;
+    unsigned shape_count; // ids handed out to shapes
+    CacheSlot* cse_slots;
+    int slot_count;
+    int slot_capacity;
+    GcConfig gc_config;  // memory manager, see minipy_set_gc()
+    Gc* gc;              // NULL until the generational collector first allocates
+    RootRange* vm_roots; // operand stacks of the running vm_resume() calls
+    HeapState heap;
+
+    FILE* out; // print statements and error messages, stdout by default
+
+    TierStats tier_stats;
+    Stats stats;
+} Interpreter;
+
+static inline Literal* temp_push(Interpreter* interp){
+    if (interp->temp_top == MAX_TEMPS) temps_overflow(interp);
+    Literal* temp = &interp->temps[interp->temp_top++];
+    temp->datatype = NONE; // the collector reads it before it is set
+    temp->owns_str = 0;
+    return temp;
+}
+
+// Safe points are also where the generational collector runs, once an
+// allocation has asked for it.
+static inline void heap_safe_point(Interpreter* interp){
+    if (interp->heap.root_count >= HEAP_ROOTS_LIMIT) heap_collect(interp);
+    if (interp->heap.gc_pending) gc_collect(interp);
+}
+
+static inline void stack_push(Interpreter* interp, Literal value){
+    if (interp->stack_top == interp->stack_capacity) stack_grow(interp);
+    interp->stack[interp->stack_top++] = value;
+}
+
+#endif
@@ -0,0 +1,254 @@
+// debug_alloc.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#define DEBUG_ALLOC_IMPL // the tracker itself calls the real allocator
+#include "debug_alloc.h"
+#include "colors.h"
+
+// Live blocks are kept in an open-addressing table keyed by address, so
+// free is O(1) instead of a walk over every allocation ever made.
+typedef struct {
+    void* address; // NULL = empty
+    size_t size;
+    int site;
+} Block;
+
+typedef struct {
+    const char* file; // __FILE__ literal, compared by pointer first
+    int line;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t bytes;      // total bytes requested
+    uint64_t live_blocks;
+    uint64_t live_bytes;
+} Site;
+
+int alloc_tracking = 0;
+
+// --batch allocates from several threads; the tables are shared.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static Block* blocks;
+static size_t block_capacity; // power of two
+static size_t block_count;
+
+static Site* sites;
+static int site_count;
+static int site_capacity;
+static int* site_index;       // hash of (file, line) -> sites[] + 1
+static int site_index_capacity;
+
+static uint64_t live_bytes;
+static uint64_t peak_bytes;
+static uint64_t untracked_frees; // frees of blocks allocated before tracking started
+
+static size_t hash_pointer(void* p){
+    uint64_t x = (uint64_t)(uintptr_t)p;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+static size_t hash_site(const char* file, int line){
+    return hash_pointer((void*)file) ^ (size_t)line * 0x9e3779b97f4a7c15ull;
+}
+
+static void site_index_grow(){
+    int capacity = site_index_capacity ? site_index_capacity * 2 : 256;
+    int* index = calloc(capacity, sizeof(int));
+    for (int i = 0; i < site_count; i++){
+        size_t h = hash_site(sites[i].file, sites[i].line) & (capacity - 1);
+        while (index[h]) h = (h + 1) & (capacity - 1);
+        index[h] = i + 1;
+    }
+    free(site_index);
+    site_index = index;
+    site_index_capacity = capacity;
+}
+
+static int find_site(const char* file, int line){
+    if (site_count * 2 >= site_index_capacity) site_index_grow();
+    size_t h = hash_site(file, line) & (site_index_capacity - 1);
+    while (site_index[h]){
+        Site* s = &sites[site_index[h] - 1];
+        if (s->line == line && (s->file == file || strcmp(s->file, file) == 0)) return site_index[h] - 1;
+        h = (h + 1) & (site_index_capacity - 1);
+    }
+    if (site_count == site_capacity){
+        site_capacity = site_capacity ? site_capacity * 2 : 64;
+        sites = realloc(sites, site_capacity * sizeof(Site));
+    }
+    memset(&sites[site_count], 0, sizeof(Site));
+    sites[site_count].file = file;
+    sites[site_count].line = line;
+    site_index[h] = ++site_count;
+    return site_count - 1;
+}
+
+static void blocks_insert(void* p, size_t size, int site);
+
+static void blocks_grow(){
+    Block* old = blocks;
+    size_t old_capacity = block_capacity;
+    block_capacity = block_capacity ? block_capacity * 2 : 1024;
+    blocks = calloc(block_capacity, sizeof(Block));
+    block_count = 0;
+    for (size_t i = 0; i < old_capacity; i++){
+        if (old[i].address) blocks_insert(old[i].address, old[i].size, old[i].site);
+    }
+    free(old);
+}
+
+static void blocks_insert(void* p, size_t size, int site){
+    if ((block_count + 1) * 2 > block_capacity) blocks_grow();
+    size_t h = hash_pointer(p) & (block_capacity - 1);
+    while (blocks[h].address) h = (h + 1) & (block_capacity - 1);
+    blocks[h] = (Block){ p, size, site };
+    block_count++;
+}
+
+// Removes p and returns its entry; address is NULL if p was not tracked.
+static Block blocks_remove(void* p){
+    Block found = { NULL, 0, 0 };
+    if (!block_count) return found;
+    size_t mask = block_capacity - 1;
+    size_t h = hash_pointer(p) & mask;
+    while (blocks[h].address && blocks[h].address != p) h = (h + 1) & mask;
+    if (!blocks[h].address) return found;
+    found = blocks[h];
+    block_count--;
+
+    // backward-shift deletion keeps probe chains intact without tombstones
+    size_t hole = h;
+    size_t i = (h + 1) & mask;
+    while (blocks[i].address){
+        size_t home = hash_pointer(blocks[i].address) & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)){
+            blocks[hole] = blocks[i];
+            hole = i;
+        }
+        i = (i + 1) & mask;
+    }
+    blocks[hole].address = NULL;
+    return found;
+}
+
+static void record_alloc(void* p, size_t size, const char* file, int line){
+    int site = find_site(file, line);
+    Site* s = &sites[site];
+    s->allocs++;
+    s->bytes += size;
+    s->live_blocks++;
+    s->live_bytes += size;
+    live_bytes += size;
+    if (live_bytes > peak_bytes) peak_bytes = live_bytes;
+    blocks_insert(p, size, site);
+}
+
+// Charges a block already taken out of the table to its site.
+static void record_removed(Block b){
+    if (!b.address){
+        untracked_frees++;
+        return;
+    }
+    Site* s = &sites[b.site];
+    s->frees++;
+    s->live_blocks--;
+    s->live_bytes -= b.size;
+    live_bytes -= b.size;
+}
+
+static void record_free(void* p){
+    record_removed(blocks_remove(p));
+}
+
+static void record_alloc_locked(void* p, size_t size, const char* file, int line){
+    pthread_mutex_lock(&lock);
+    record_alloc(p, size, file, line);
+    pthread_mutex_unlock(&lock);
+}
+
+void* track_malloc(size_t size, const char* file, int line){
+    void* p = malloc(size);
+    if (p && alloc_tracking) record_alloc_locked(p, size, file, line);
+    return p;
+}
+
+void* track_calloc(size_t count, size_t size, const char* file, int line){
+    void* p = calloc(count, size);
+    if (p && alloc_tracking) record_alloc_locked(p, count * size, file, line);
+    return p;
+}
+
+void* track_realloc(void* ptr, size_t size, const char* file, int line){
+    if (!alloc_tracking) return realloc(ptr, size);
+    // held across the call so no other thread is handed ptr before it is untracked
+    pthread_mutex_lock(&lock);
+    // untracked before the call, since ptr must not be used once it is freed
+    Block old = { NULL, 0, 0 };
+    if (ptr) old = blocks_remove(ptr);
+    void* p = realloc(ptr, size);
+    if (p){
+        if (ptr) record_removed(old);
+        record_alloc(p, size, file, line);
+    }else if (old.address){
+        // the block is unchanged, put it back
+        blocks_insert(old.address, old.size, old.site);
+    }
+    pthread_mutex_unlock(&lock);
+    return p;
+}
+
+char* track_strdup(const char* str, const char* file, int line){
+    char* p = strdup(str);
+    if (p && alloc_tracking) record_alloc_locked(p, strlen(p) + 1, file, line);
+    return p;
+}
+
+void track_free(void* ptr){
+    if (ptr && alloc_tracking){
+        pthread_mutex_lock(&lock);
+        record_free(ptr);
+        pthread_mutex_unlock(&lock);
+    }
+    free(ptr);
+}
+
+static int compare_sites(const void* a, const void* b){
+    const Site* x = a;
+    const Site* y = b;
+    if (x->bytes != y->bytes) return x->bytes < y->bytes ? 1 : -1;
+    return x->allocs < y->allocs ? 1 : x->allocs > y->allocs ? -1 : 0;
+}
+
+void alloc_report(FILE* out){
+    if (!alloc_tracking) return;
+#ifndef TRACK_ALLOC
+    fprintf(out, "allocation tracking needs a build with -DTRACK_ALLOC\n");
+    return;
+#endif
+    qsort(sites, site_count, sizeof(Site), compare_sites);
+
+    uint64_t leaked_blocks = 0, leaked_bytes = 0;
+    fprintf(out, "\n[MEMORY STATUS]\n");
+    fprintf(out, "%-24s %10s %10s %12s %10s %12s\n", "site", "allocs", "frees", "bytes", "live", "live bytes");
+    for (int i = 0; i < site_count; i++){
+        Site* s = &sites[i];
+        char where[64];
+        const char* base = strrchr(s->file, '/');
+        snprintf(where, sizeof where, "%s:%d", base ? base + 1 : s->file, s->line);
+        fprintf(out, "%s%-24s %10llu %10llu %12llu %10llu %12llu%s\n", s->live_blocks ? RED : "", where,
+                (unsigned long long)s->allocs, (unsigned long long)s->frees, (unsigned long long)s->bytes,
+                (unsigned long long)s->live_blocks, (unsigned long long)s->live_bytes, s->live_blocks ? RESET : "");
+        leaked_blocks += s->live_blocks;
+        leaked_bytes += s->live_bytes;
+    }
+    fprintf(out, "peak live: %llu bytes\n", (unsigned long long)peak_bytes);
+    fprintf(out, "leaked at exit: %llu blocks, %llu bytes\n", (unsigned long long)leaked_blocks,
+            (unsigned long long)leaked_bytes);
+    if (untracked_frees) fprintf(out, "untracked frees: %llu\n", (unsigned long long)untracked_frees);
+}
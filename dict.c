@@ -0,0 +1,196 @@
+// dict.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lexer.h"
+#include "ast.h"
+#include "dict.h"
+#include "memory.h"
+#include "interpreter.h"
+#include "error_handling.h"
+#include "context.h"
+#include "debug_alloc.h"
+
+#define MIN_INDEX 8
+
+static inline uint32_t hash_int(int value){
+    // Fibonacci hashing: consecutive ints land in consecutive slots
+    // without clustering the way an identity hash would under masking
+    return (uint32_t)(((uint64_t)(uint32_t)value * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+static uint32_t hash_string(const char* s){
+    uint32_t h = 2166136261u; // FNV-1a
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+// Equal keys hash alike: 1, 1.0 and True are the same key.
+static uint32_t hash_key(Interpreter* interp, Literal key){
+    switch (key.datatype){
+        case INT: return hash_int(key.numeric);
+        case BOOLEAN: return hash_int(key.boolean);
+        case FLOAT: {
+            float f = key.floating_point;
+            if (f == (float)(int)f) return hash_int((int)f);
+            uint32_t bits;
+            memcpy(&bits, &f, sizeof bits);
+            return hash_int((int)bits);
+        }
+        case STRING: return hash_string(key.string);
+        case NONE: return 0x9E3779B9u;
+        default: {
+            char msg[255];
+            sprintf(msg, "Unhashable type: \'%s\'", datatype_name(key.datatype));
+            raiseError(interp, TYPE_ERROR, msg);
+            return 0;
+        }
+    }
+}
+
+static inline int same_key(Literal a, Literal b){
+    if (a.datatype == INT && b.datatype == INT) return a.numeric == b.numeric;
+    return values_equal(a, b);
+}
+
+// Entry position of key, or -1 with *free_slot set to where it would go.
+static int find(Dict* dict, Literal key, uint32_t hash, uint32_t* free_slot){
+    uint32_t i = hash & dict->mask;
+    while (1){
+        DictSlot slot = dict->index[i];
+        if (slot.entry < 0) break;
+        if (slot.hash == hash && same_key(dict->entries[slot.entry].key, key)) return slot.entry;
+        i = (i + 1) & dict->mask;
+    }
+    if (free_slot) *free_slot = i;
+    return -1;
+}
+
+// Rebuilds the index with room for size slots, from the cached hashes.
+static int rehash(Interpreter* interp, Dict* dict, uint32_t size){
+    DictSlot* index = heap_buffer(interp, &dict->head, NULL, sizeof(DictSlot) * size);
+    if (!index) return 0;
+    memset(index, 0xff, sizeof(DictSlot) * size);
+    uint32_t mask = size - 1;
+    for (int e = 0; e < dict->count; e++){
+        uint32_t i = dict->entries[e].hash & mask;
+        while (index[i].entry >= 0) i = (i + 1) & mask;
+        index[i].hash = dict->entries[e].hash;
+        index[i].entry = e;
+    }
+    heap_buffer_free(&dict->head, dict->index);
+    dict->index = index;
+    dict->mask = mask;
+    return 1;
+}
+
+// Room for one more entry: the index stays at most two thirds full.
+static int reserve(Interpreter* interp, Dict* dict){
+    if (dict->count == dict->capacity){
+        int capacity = dict->capacity ? dict->capacity * 2 : 4;
+        DictEntry* tmp = heap_buffer(interp, &dict->head, dict->entries, sizeof(DictEntry) * capacity);
+        if (!tmp) return 0;
+        dict->entries = tmp;
+        dict->capacity = capacity;
+    }
+    uint32_t size = dict->mask + 1;
+    if ((uint64_t)(dict->count + 1) * 3 > (uint64_t)size * 2) return rehash(interp, dict, size * 2);
+    return 1;
+}
+
+static void describe_key(char* buf, size_t size, Literal key){
+    switch (key.datatype){
+        case INT: snprintf(buf, size, "%d", key.numeric); break;
+        case FLOAT: snprintf(buf, size, "%f", key.floating_point); break;
+        case BOOLEAN: snprintf(buf, size, "%s", key.boolean ? "True" : "False"); break;
+        case STRING: snprintf(buf, size, "\'%.200s\'", key.string); break;
+        default: snprintf(buf, size, "None"); break;
+    }
+}
+
+// A new dict of count key, value pairs, with one reference for the caller.
+// A repeated key keeps its first position and its last value.
+Dict* dict_from(Interpreter* interp, const Literal* pairs, int count){
+    // unhashable keys, every type after BOOLEAN, raise before anything is allocated
+    for (int i = 0; i < count; i++){
+        if (pairs[2 * i].datatype > BOOLEAN) hash_key(interp, pairs[2 * i]);
+    }
+    Dict* dict = heap_new(interp, HEAP_DICT, sizeof(Dict));
+    if (!dict) goto out_of_memory;
+    uint32_t size = MIN_INDEX;
+    while ((uint64_t)count * 3 > (uint64_t)size * 2) size *= 2;
+    dict->mask = size - 1;
+    dict->index = heap_buffer(interp, &dict->head, NULL, sizeof(DictSlot) * size);
+    dict->entries = count ? heap_buffer(interp, &dict->head, NULL, sizeof(DictEntry) * count) : NULL;
+    if (!dict->index || (count && !dict->entries)){
+        heap_release(interp, &dict->head);
+        goto out_of_memory;
+    }
+    memset(dict->index, 0xff, sizeof(DictSlot) * size);
+    dict->capacity = count;
+    for (int i = 0; i < count; i++) dict_set(interp, dict, pairs[2 * i], pairs[2 * i + 1]);
+    return dict;
+
+    out_of_memory:
+        raiseError(interp, MEMORY_ERROR, "Out of memory");
+        return NULL;
+}
+
+void dict_get(Interpreter* interp, Dict* dict, Literal key, Literal* out){
+    int e = find(dict, key, hash_key(interp, key), NULL);
+    if (e < 0){
+        char name[220];
+        char msg[255];
+        describe_key(name, sizeof name, key);
+        snprintf(msg, sizeof msg, "Key not found -> %s", name);
+        raiseError(interp, KEY_ERROR, msg);
+        return;
+    }
+    *out = copy_literal(interp, dict->entries[e].value);
+}
+
+void dict_set(Interpreter* interp, Dict* dict, Literal key, Literal value){
+    uint32_t hash = hash_key(interp, key);
+    uint32_t slot;
+    int e = find(dict, key, hash, &slot);
+    if (e >= 0){
+        Literal old = dict->entries[e].value;
+        dict->entries[e].value = heap_store(interp, &dict->head, value);
+        release_literal(interp, &old);
+        return;
+    }
+    uint32_t size = dict->mask + 1;
+    if (!reserve(interp, dict)){
+        raiseError(interp, MEMORY_ERROR, "Out of memory");
+        return;
+    }
+    if (dict->mask + 1 != size) find(dict, key, hash, &slot); // the index was rebuilt
+    DictEntry* entry = &dict->entries[dict->count];
+    entry->hash = hash;
+    entry->key = heap_store(interp, &dict->head, key);
+    entry->value = heap_store(interp, &dict->head, value);
+    dict->index[slot].hash = hash;
+    dict->index[slot].entry = dict->count;
+    dict->count++;
+}
+
+int dict_contains(Interpreter* interp, Dict* dict, Literal key){
+    return find(dict, key, hash_key(interp, key), NULL) >= 0;
+}
+
+void fprint_dict(FILE* out, Dict* dict){
+    if (dict->printing){
+        fputs("{...}", out);
+        return;
+    }
+    dict->printing = 1;
+    fputc('{', out);
+    for (int i = 0; i < dict->count; i++){
+        if (i > 0) fputs(", ", out);
+        fprint_value(out, dict->entries[i].key);
+        fputs(": ", out);
+        fprint_value(out, dict->entries[i].value);
+    }
+    fputc('}', out);
+    dict->printing = 0;
+}
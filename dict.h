@@ -0,0 +1,45 @@
+// dict.h
+#ifndef DICT_H
+#define DICT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "memory.h"
+#include "heap.h"
+
+// Entries are kept dense in insertion order, which is also the order they
+// print in. The open-addressing index maps a hash to an entry position; it
+// holds the hash as well, so a probe that misses never touches an entry
+// or compares a string.
+typedef struct {
+    uint32_t hash; // cached, so growing never hashes a key again
+    Literal key;   // keys and values own their strings and references
+    Literal value;
+} DictEntry;
+
+typedef struct {
+    uint32_t hash;
+    int32_t entry; // position in entries, -1 = empty
+} DictSlot;
+
+// Shared by reference and counted, like List. Entries are never removed,
+// so the index needs no tombstones.
+typedef struct Dict {
+    Heap head;
+    int count;
+    int capacity;  // of entries
+    uint32_t mask; // index size - 1, a power of two minus one
+    DictSlot* index;
+    DictEntry* entries;
+    int printing; // inside fprint_dict(), so a cycle prints as {...}
+} Dict;
+
+Dict* dict_from(Interpreter* interp, const Literal* pairs, int count); // count key, value pairs
+
+void dict_get(Interpreter* interp, Dict* dict, Literal key, Literal* out); // out is owned
+void dict_set(Interpreter* interp, Dict* dict, Literal key, Literal value);
+int dict_contains(Interpreter* interp, Dict* dict, Literal key);
+
+void fprint_dict(FILE* out, Dict* dict);
+
+#endif
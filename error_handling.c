@@ -1,9 +1,10 @@
 //error_handling.c
 #include <stdio.h>
+#include <string.h>
 #include "colors.h"
 #include "error_handling.h"
-
-int error = 0;
+#include "context.h"
+#include "profile.h"
 
 const char* error_name(ErrorType type) {
     switch (type) {
@@ -16,11 +17,49 @@ const char* error_name(ErrorType type) {
         case ASSIGNMENT_ERROR: return "Assignment Error";
         case MEMORY_ERROR: return "Memory Error";
         case INDENTATION_ERROR: return "Indentation Error";
+        case INDEX_ERROR: return "Index Error";
+        case KEY_ERROR: return "Key Error";
+        case ATTRIBUTE_ERROR: return "Attribute Error";
         default: return "Unknown Error";
     }
 }
 
-void raiseError(ErrorType type, char* error_msg){
-    printf(RED "%s" RESET ": " RED "%s\n" RESET, error_name(type), error_msg);
-    error = 1;
-}
\ No newline at end of file
+void error_push(Interpreter* interp, ErrorFrame* frame){
+    frame->prev = interp->error_frame;
+    frame->temps = interp->temp_top;
+    frame->stack = interp->stack_top;
+    frame->frame = interp->frame;
+    frame->call_depth = interp->call_depth;
+    frame->profile_depth = profiling ? profile_depth : 0;
+    interp->error_frame = frame;
+}
+
+void error_pop(Interpreter* interp, ErrorFrame* frame){
+    interp->error_frame = frame->prev;
+}
+
+void error_throw(Interpreter* interp){
+    interp->error = 1;
+    ErrorFrame* frame = interp->error_frame;
+    if (!frame) return;
+    interp->error_frame = frame->prev;
+    temps_unwind(interp, frame->temps);
+    stack_unwind(interp, frame->stack);
+    interp->frame = frame->frame;
+    interp->call_depth = frame->call_depth;
+    if (profiling) profile_depth = frame->profile_depth;
+    longjmp(frame->env, 1);
+}
+
+void raiseError(Interpreter* interp, ErrorType type, char* error_msg){
+    Error* err = &interp->last_error;
+    err->type = type;
+    snprintf(err->message, sizeof err->message, "%s", error_msg);
+    err->line = interp->error_line;
+    if (err->line > 0){
+        fprintf(interp->out, RED "%s" RESET ": " RED "%s (line %d)\n" RESET, error_name(type), error_msg, err->line);
+    }else{
+        fprintf(interp->out, RED "%s" RESET ": " RED "%s\n" RESET, error_name(type), error_msg);
+    }
+    error_throw(interp);
+}
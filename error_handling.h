@@ -2,6 +2,10 @@
 #ifndef ERROR_HANDLING_H
 #define ERROR_HANDLING_H
 
+#include <setjmp.h>
+
+typedef struct Interpreter Interpreter;
+
 typedef enum{
     SYNTAX_ERROR,
     NAME_ERROR,
@@ -12,8 +16,38 @@ typedef enum{
     ASSIGNMENT_ERROR,
     MEMORY_ERROR,
     INDENTATION_ERROR,
+    INDEX_ERROR,
+    KEY_ERROR,
+    ATTRIBUTE_ERROR,
 }ErrorType;
 
-void raiseError(ErrorType type, char* error_msg);
+typedef struct {
+    ErrorType type;
+    char message[256];
+    int line; // source line, 0 if unknown (interactive)
+} Error;
+
+// Evaluation runs inside error frames. raiseError() unwinds to the
+// innermost frame with longjmp, releasing the temporaries, call frames and
+// profiler frames pushed since it was entered, so the evaluator never
+// checks for errors itself. The parser runs with no frame and sees interp->error.
+typedef struct ErrorFrame {
+    jmp_buf env;
+    struct ErrorFrame* prev;
+    int temps;         // temp_top when the frame was entered
+    int stack;         // stack_top, frame and call_depth likewise
+    int frame;
+    int call_depth;
+    int profile_depth;
+} ErrorFrame;
+
+// Usage: error_push(&frame); if (setjmp(frame.env)) { handle } ... error_pop(&frame);
+// The frame is already popped when the handler runs.
+void error_push(Interpreter* interp, ErrorFrame* frame);
+void error_pop(Interpreter* interp, ErrorFrame* frame);
+void error_throw(Interpreter* interp); // re-raise last_error in the next frame out
+
+const char* error_name(ErrorType type);
+void raiseError(Interpreter* interp, ErrorType type, char* error_msg);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,234 @@
+// function.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lexer.h"
+#include "ast.h"
+#include "function.h"
+#include "object.h"
+#include "memory.h"
+#include "interpreter.h"
+#include "error_handling.h"
+#include "context.h"
+#include "debug_alloc.h"
+
+static int slot_of(Function* fn, const char* name){
+    for (int i = 0; i < fn->local_count; i++){
+        if (strcmp(fn->locals[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+static int add_local(Function* fn, const char* name){
+    if (slot_of(fn, name) >= 0) return 1;
+    char** tmp = realloc(fn->locals, sizeof(char*) * (fn->local_count + 1));
+    if (!tmp) return 0;
+    fn->locals = tmp;
+    fn->locals[fn->local_count++] = strdup(name);
+    return 1;
+}
+
+// As in Python, every name the body assigns is local to the call.
+static int collect_locals(Function* fn, ASTNode* node){
+    if (!node) return 1;
+    switch (node->type){
+        case AST_ASSIGNMENT:
+            return add_local(fn, node->assign.name);
+        case AST_BLOCK:
+            for (int i = 0; i < node->block.count; i++){
+                if (!collect_locals(fn, node->block.statements[i])) return 0;
+            }
+            return 1;
+        case AST_FOR:
+            if (!add_local(fn, node->construct.name)) return 0;
+            // fall through
+        case AST_IF: case AST_ELIF: case AST_ELSE: case AST_WHILE:
+            return collect_locals(fn, node->construct.code) && collect_locals(fn, node->construct.next);
+        default:
+            return 1;
+    }
+}
+
+// Turns the identifiers naming locals into AST_LOCAL and gives the
+// assignments and for loops that store to a local its slot.
+static void resolve(Function* fn, ASTNode* node){
+    if (!node) return;
+    switch (node->type){
+        case AST_IDENTIFIER: {
+            int slot = slot_of(fn, node->name);
+            if (slot < 0) return;
+            char* name = node->name;
+            node->type = AST_LOCAL;
+            node->local.name = name;
+            node->local.slot = slot;
+            return;
+        }
+        case AST_ASSIGNMENT:
+            node->assign.slot = slot_of(fn, node->assign.name);
+            resolve(fn, node->assign.value);
+            return;
+        case AST_OPERATOR:
+            resolve(fn, node->operate.left);
+            resolve(fn, node->operate.right);
+            return;
+        case AST_PRINT:
+            resolve(fn, node->print.value);
+            return;
+        case AST_RETURN:
+            resolve(fn, node->ret.value);
+            return;
+        case AST_BLOCK:
+            for (int i = 0; i < node->block.count; i++) resolve(fn, node->block.statements[i]);
+            return;
+        case AST_FOR:
+            node->construct.slot = slot_of(fn, node->construct.name);
+            // fall through
+        case AST_IF: case AST_ELIF: case AST_ELSE: case AST_WHILE:
+            resolve(fn, node->construct.condition);
+            resolve(fn, node->construct.code);
+            resolve(fn, node->construct.next);
+            return;
+        case AST_LIST:
+        case AST_DICT:
+            for (int i = 0; i < node->list.count; i++) resolve(fn, node->list.items[i]);
+            return;
+        case AST_INDEX:
+        case AST_INDEX_ASSIGN:
+            resolve(fn, node->index.target);
+            resolve(fn, node->index.index);
+            resolve(fn, node->index.value);
+            return;
+        case AST_CALL:
+            for (int i = 0; i < node->call.count; i++) resolve(fn, node->call.args[i]);
+            return;
+        case AST_ATTR:
+        case AST_ATTR_ASSIGN:
+            resolve(fn, node->attr.object);
+            resolve(fn, node->attr.value);
+            return;
+        default:
+            return;
+    }
+}
+
+// Takes name, params (an array of strings) and body. Returns NULL if out
+// of memory, having freed them.
+Function* function_new(char* name, char** params, int param_count, ASTNode* body){
+    Function* fn = calloc(1, sizeof(Function));
+    if (!fn){
+        for (int i = 0; i < param_count; i++) free(params[i]);
+        free(params);
+        free(name);
+        ast_free(body);
+        return NULL;
+    }
+    heap_init(&fn->head, HEAP_FUNCTION);
+    fn->name = name;
+    fn->param_count = param_count;
+    fn->local_count = param_count;
+    fn->locals = params;
+    fn->body = body;
+    if (!collect_locals(fn, body)){
+        function_release(fn);
+        return NULL;
+    }
+    resolve(fn, body);
+    return fn;
+}
+
+void function_release(Function* fn){
+    if (__atomic_sub_fetch(&fn->head.refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    for (int i = 0; i < fn->local_count; i++) free(fn->locals[i]);
+    free(fn->locals);
+    free(fn->name);
+    ast_free(fn->body);
+    free(fn);
+}
+
+// Looks up what name is bound to and returns the position the arguments
+// go from. Calling a class pushes the new instance below the frame, where
+// call_end() finds it, and the instance again as the 'self' of __init__.
+int call_begin(Interpreter* interp, const char* name, Literal* callee){
+    char msg[255];
+    Variable* var = find_variable(interp, name);
+    if (!var){
+        snprintf(msg, sizeof msg, "Undefined function -> %s", name);
+        raiseError(interp, NAME_ERROR, msg);
+    }
+    *callee = var->literal;
+    callee->owns_str = 0;
+    if (callee->datatype == FUNCTION) return interp->stack_top;
+    if (callee->datatype != CLASS){
+        sprintf(msg, "\'%s\' object is not callable", datatype_name(callee->datatype));
+        raiseError(interp, TYPE_ERROR, msg);
+    }
+    Literal instance;
+    instance.datatype = OBJECT;
+    instance.owns_str = 1;
+    instance.object = object_new(interp, callee->cls);
+    stack_push(interp, instance);
+    instance.owns_str = 0;
+    stack_push(interp, instance);
+    return interp->stack_top - 1;
+}
+
+void call_end(Interpreter* interp, Literal callee, int base, Literal* out){
+    if (callee.datatype == FUNCTION){
+        call_function(interp, callee.function, base, out);
+        return;
+    }
+    Class* cls = callee.cls;
+    if (cls->init){
+        Literal result;
+        call_function(interp, cls->init, base, &result);
+        if (result.datatype != NONE){
+            release_literal(interp, &result);
+            raiseError(interp, TYPE_ERROR, "__init__() should return None");
+        }
+    } else if (interp->stack_top - base > 1){
+        char msg[255];
+        snprintf(msg, sizeof msg, "%.200s() takes no arguments", cls->name);
+        raiseError(interp, TYPE_ERROR, msg);
+    } else {
+        interp->stack_top = base;
+    }
+    *out = interp->stack[--interp->stack_top];
+}
+
+// Calls a method of the object at stack[base], which the frame owns as
+// its 'self', on the arguments pushed after it.
+void call_method(Interpreter* interp, const char* name, int site, int base, Literal* out){
+    Function* fn = method_find(interp, interp->stack[base].object, name, site);
+    call_function(interp, fn, base, out);
+}
+
+void call_function(Interpreter* interp, Function* fn, int base, Literal* out){
+    int count = interp->stack_top - base;
+    if (count != fn->param_count){
+        char msg[255];
+        snprintf(msg, sizeof msg, "%.200s() takes %d arguments (%d given)", fn->name, fn->param_count, count);
+        raiseError(interp, TYPE_ERROR, msg);
+    }
+    if (interp->call_depth == MAX_CALL_DEPTH) raiseError(interp, MEMORY_ERROR, "Maximum recursion depth exceeded");
+
+    Literal unbound;
+    unbound.datatype = ERROR;
+    unbound.owns_str = 0;
+    for (int i = count; i < fn->local_count; i++) stack_push(interp, unbound);
+    int frame = interp->frame;
+    interp->frame = base;
+    interp->call_depth++;
+    interp->stats.calls++;
+
+    if (eval(interp, fn->body) == FLOW_RETURN){
+        *out = interp->returned;
+        interp->returned.owns_str = 0;
+    } else {
+        out->datatype = NONE;
+        out->owns_str = 0;
+    }
+
+    interp->call_depth--;
+    interp->frame = frame;
+    stack_unwind(interp, base);
+}
@@ -0,0 +1,39 @@
+// function.h
+#ifndef FUNCTION_H
+#define FUNCTION_H
+
+#include "memory.h"
+#include "heap.h"
+
+typedef struct ASTNode ASTNode;
+
+// A call's locals live in interp->stack: the arguments are evaluated
+// straight into the first slots, the rest start unbound (datatype ERROR),
+// and interp->frame is the position of slot 0 while the body runs. Every
+// name a body assigns is local, so no global can be rebound while a call
+// runs: the function and any value loaded from a global stay alive without
+// taking a reference.
+#define MAX_CALL_DEPTH 1000
+
+// Made by the parser and shared by the AST_DEF node and every variable
+// bound to it. The interpreters running a program share its functions,
+// so the count is changed atomically.
+typedef struct Function {
+    Heap head;
+    char* name;
+    int param_count;
+    int local_count; // the parameters, then every other name the body assigns
+    char** locals;   // name of each slot
+    ASTNode* body;
+} Function;
+
+Function* function_new(char* name, char** params, int param_count, ASTNode* body); // takes the strings and body
+void function_release(Function* fn);
+
+int call_begin(Interpreter* interp, const char* name, Literal* callee); // callee is borrowed; returns the base
+void call_end(Interpreter* interp, Literal callee, int base, Literal* out);   // call it on the arguments pushed
+void call_function(Interpreter* interp, Function* fn, int base, Literal* out); // run fn on the arguments pushed
+                                                                               // from base; out is owned
+void call_method(Interpreter* interp, const char* name, int site, int base, Literal* out);
+
+#endif
@@ -0,0 +1,544 @@
+// gc.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#include "gc.h"
+#include "list.h"
+#include "dict.h"
+#include "object.h"
+#include "optimize.h"
+#include "context.h"
+#include "error_handling.h"
+#include "stats.h"
+#include "timer.h"
+#include "debug_alloc.h"
+
+#define ALIGN 8
+#define MIN_CELL 16    // room for the header and a forwarding address or free list link
+#define SMALL_CELL 512 // free cells up to this size are kept in lists by exact size
+#define MAX_CELL ((size_t)1 << 30) // free runs are split below what Heap.size holds
+#define MIN_MAJOR ((size_t)8 << 20)
+
+typedef struct FreeCell {
+    Heap head;
+    struct FreeCell* next;
+} FreeCell;
+
+struct Gc {
+    Interpreter* interp; // the owner, whose heap.gc_pending asks for a collection
+    char* nursery;
+    char* nursery_top;
+    char* nursery_end;
+    size_t pretenure; // larger cells go straight to the old generation
+
+    // Old cells lie end to end below old_top, free ones included, so the
+    // sweep can walk them by their sizes.
+    char* old;
+    char* old_top;
+    char* old_end;
+    char* old_high; // the highest old_top has been, for giving pages back
+    FreeCell* free[SMALL_CELL / ALIGN + 1];
+    FreeCell* large; // free cells above SMALL_CELL, first fit
+    size_t free_bytes;
+    size_t promoted; // bytes copied by the running minor collection
+    size_t old_live;   // bytes of old cells alive at the last major collection, plus those allocated since
+    size_t next_major; // old_live that makes the next collection a major one
+    int major_due;
+
+    Heap** remembered; // old cells stored into since the last minor collection
+    int remembered_count;
+    int remembered_capacity;
+    Heap** work; // cells to trace
+    int work_count;
+    int work_capacity;
+    Heap** pinned; // open addressing by address, capacity a power of two
+    int pinned_count;
+    int pinned_capacity;
+};
+
+static void* map(size_t size, int huge_pages, int* got){
+    *got = 0;
+#ifdef _WIN32
+    (void)huge_pages;
+    return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void* p;
+#ifdef MAP_HUGETLB
+    if (huge_pages){
+        // reserved up front: hugetlbfs pages that run out later are a SIGBUS
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED){
+            *got = 1;
+            return p;
+        }
+    }
+#endif
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+    // no huge pages reserved: ask for transparent ones instead
+    if (huge_pages && madvise(p, size, MADV_HUGEPAGE) == 0) *got = 2;
+#endif
+    return p;
+#endif
+}
+
+static void unmap(void* p, size_t size){
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    munmap(p, size);
+#endif
+}
+
+static inline size_t round_up(size_t size, size_t to){
+    return (size + to - 1) / to * to;
+}
+
+static Gc* gc_get(Interpreter* interp){
+    if (interp->gc) return interp->gc;
+    Gc* gc = calloc(1, sizeof(Gc));
+    if (!gc) return NULL;
+    const GcConfig* config = &interp->gc_config;
+    size_t min_nursery = (size_t)GC_MIN_NURSERY << 10;
+    size_t nursery = config->nursery_size ? config->nursery_size : GC_NURSERY_SIZE;
+    size_t old = config->old_size ? config->old_size : GC_OLD_SIZE;
+    nursery = round_up(nursery < min_nursery ? min_nursery : nursery, 4096);
+    old = round_up(old < nursery ? nursery : old, (size_t)2 << 20);
+    int huge;
+    gc->nursery = map(nursery, 0, &huge);
+    gc->old = map(old, config->huge_pages, &interp->stats.gc_huge_pages);
+    if (!gc->nursery || !gc->old){
+        if (gc->nursery) unmap(gc->nursery, nursery);
+        if (gc->old) unmap(gc->old, old);
+        free(gc);
+        return NULL;
+    }
+    gc->interp = interp;
+    gc->nursery_top = gc->nursery;
+    gc->nursery_end = gc->nursery + nursery;
+    gc->pretenure = nursery / 8;
+    gc->old_top = gc->old_high = gc->old;
+    gc->old_end = gc->old + old;
+    gc->next_major = MIN_MAJOR > nursery * 4 ? MIN_MAJOR : nursery * 4;
+    interp->stats.gc_nursery_size = nursery;
+    interp->stats.gc_old_size = old;
+    interp->gc = gc;
+    return gc;
+}
+
+void gc_destroy(Interpreter* interp){
+    Gc* gc = interp->gc;
+    if (!gc) return;
+    for (int i = 0; i < gc->pinned_capacity; i++){
+        if (gc->pinned[i]) heap_release(interp, gc->pinned[i]);
+    }
+    unmap(gc->nursery, gc->nursery_end - gc->nursery);
+    unmap(gc->old, gc->old_end - gc->old);
+    free(gc->remembered);
+    free(gc->work);
+    free(gc->pinned);
+    free(gc);
+    interp->gc = NULL;
+}
+
+static void append(Heap*** array, int* count, int* capacity, Heap* head){
+    if (*count == *capacity){
+        int grown = *capacity ? *capacity * 2 : 256;
+        Heap** tmp = realloc(*array, sizeof(Heap*) * grown);
+        if (!tmp){
+            fprintf(stderr, "Out of memory in the garbage collector\n");
+            abort();
+        }
+        *array = tmp;
+        *capacity = grown;
+    }
+    (*array)[(*count)++] = head;
+}
+
+static inline void push(Gc* gc, Heap* cell){
+    append(&gc->work, &gc->work_count, &gc->work_capacity, cell);
+}
+
+static inline void remember(Gc* gc, Heap* cell){
+    cell->buffered = 1;
+    append(&gc->remembered, &gc->remembered_count, &gc->remembered_capacity, cell);
+}
+
+static inline int in_nursery(Gc* gc, const void* p){
+    return (const char*)p >= gc->nursery && (const char*)p < gc->nursery_end;
+}
+
+// Whether a string is a collected cell rather than, say, a constant of
+// the program.
+static inline int collected(Gc* gc, const void* p){
+    return in_nursery(gc, p) || ((const char*)p >= gc->old && (const char*)p < gc->old_top);
+}
+
+static void add_free(Gc* gc, char* at, size_t size){
+    while (size){
+        size_t part = size > MAX_CELL ? MAX_CELL : size;
+        if (size - part && size - part < MIN_CELL) part -= MIN_CELL; // leave room for the next header
+        FreeCell* cell = (FreeCell*)at;
+        cell->head.size = part;
+        cell->head.kind = HEAP_FREE;
+        cell->head.color = 0;
+        cell->head.buffered = 0;
+        cell->head.gen = GEN_OLD;
+        FreeCell** list = part <= SMALL_CELL ? &gc->free[part / ALIGN] : &gc->large;
+        cell->next = *list;
+        *list = cell;
+        gc->free_bytes += part;
+        at += part;
+        size -= part;
+    }
+}
+
+static Heap* take_large(Gc* gc, size_t size){
+    for (FreeCell** link = &gc->large; *link; link = &(*link)->next){
+        FreeCell* cell = *link;
+        if (cell->head.size < size) continue;
+        *link = cell->next;
+        gc->free_bytes -= cell->head.size;
+        size_t rest = cell->head.size - size;
+        if (rest >= MIN_CELL){
+            add_free(gc, (char*)cell + size, rest);
+            cell->head.size = size;
+        }
+        return &cell->head;
+    }
+    return NULL;
+}
+
+// A cell of at least size bytes in the old generation, its size set.
+static Heap* old_alloc(Gc* gc, size_t size){
+    Heap* cell;
+    if (size <= SMALL_CELL && gc->free[size / ALIGN]){
+        FreeCell* free_cell = gc->free[size / ALIGN];
+        gc->free[size / ALIGN] = free_cell->next;
+        gc->free_bytes -= size;
+        cell = &free_cell->head;
+    } else if (!(cell = take_large(gc, size))){
+        // only bump once the holes are used up, or the generation keeps growing
+        if ((size_t)(gc->old_end - gc->old_top) < size) return NULL;
+        cell = (Heap*)gc->old_top;
+        cell->size = size;
+        gc->old_top += size;
+        if (gc->old_top > gc->old_high) gc->old_high = gc->old_top;
+    }
+    gc->old_live += cell->size;
+    if (gc->old_live > gc->next_major && !gc->major_due){
+        gc->major_due = 1;
+        gc->interp->heap.gc_pending = 1;
+    }
+    return cell;
+}
+
+void* gc_alloc(Interpreter* interp, HeapKind kind, size_t size){
+    Gc* gc = gc_get(interp);
+    if (!gc) return NULL;
+    int contents = kind == HEAP_STRING || kind == HEAP_BUFFER;
+    size_t bytes = round_up(contents ? size + sizeof(Heap) : size, ALIGN);
+    if (bytes < MIN_CELL) bytes = MIN_CELL;
+    if (bytes > MAX_CELL) return NULL;
+    Heap* cell;
+    if (bytes <= gc->pretenure && (size_t)(gc->nursery_end - gc->nursery_top) >= bytes){
+        cell = (Heap*)gc->nursery_top;
+        gc->nursery_top += bytes;
+        cell->size = bytes;
+        cell->gen = GEN_YOUNG;
+    } else {
+        if (bytes <= gc->pretenure) interp->heap.gc_pending = 1; // the nursery is full
+        cell = old_alloc(gc, bytes);
+        if (!cell) return NULL;
+        cell->gen = GEN_OLD;
+    }
+    if (!contents) memset(cell + 1, 0, cell->size - sizeof(Heap));
+    cell->kind = kind;
+    cell->color = 0;
+    cell->buffered = 0;
+    interp->stats.gc_allocated += cell->size;
+    return contents ? (void*)(cell + 1) : (void*)cell;
+}
+
+// A new buffer for owner holding the contents of old, which is left to
+// the collector.
+void* gc_buffer(Interpreter* interp, Heap* owner, void* old, size_t size){
+    char* buffer = gc_alloc(interp, HEAP_BUFFER, size);
+    if (!buffer) return NULL;
+    if (old){
+        size_t had = ((Heap*)old - 1)->size - sizeof(Heap);
+        memcpy(buffer, old, had < size ? had : size);
+    }
+    if (owner->gen == GEN_OLD && !owner->buffered) remember(interp->gc, owner);
+    return buffer;
+}
+
+char* gc_share_string(Interpreter* interp, char* string){
+    if (interp->gc && collected(interp->gc, string)) return string;
+    size_t len = strlen(string);
+    char* copy = gc_alloc(interp, HEAP_STRING, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, string, len + 1);
+    stats_string(&interp->stats, len + 1, len);
+    return copy;
+}
+
+// Keeps a class or function alive for as long as the interpreter, so the
+// collected values referring to it need not count their references.
+void gc_pin(Interpreter* interp, Heap* head){
+    Gc* gc = interp->gc;
+    if ((gc->pinned_count + 1) * 2 > gc->pinned_capacity){
+        int capacity = gc->pinned_capacity ? gc->pinned_capacity * 2 : 64;
+        Heap** pinned = calloc(capacity, sizeof(Heap*));
+        if (!pinned){
+            fprintf(stderr, "Out of memory in the garbage collector\n");
+            abort();
+        }
+        for (int i = 0; i < gc->pinned_capacity; i++){
+            Heap* p = gc->pinned[i];
+            if (!p) continue;
+            uint32_t j = (uint32_t)(((uintptr_t)p >> 4) * 0x9E3779B97F4A7C15ull >> 32) & (capacity - 1);
+            while (pinned[j]) j = (j + 1) & (capacity - 1);
+            pinned[j] = p;
+        }
+        free(gc->pinned);
+        gc->pinned = pinned;
+        gc->pinned_capacity = capacity;
+    }
+    uint32_t mask = gc->pinned_capacity - 1;
+    uint32_t i = (uint32_t)(((uintptr_t)head >> 4) * 0x9E3779B97F4A7C15ull >> 32) & mask;
+    while (gc->pinned[i]){
+        if (gc->pinned[i] == head) return;
+        i = (i + 1) & mask;
+    }
+    gc->pinned[i] = head;
+    gc->pinned_count++;
+    heap_retain(head);
+}
+
+// Called by heap_store() once value is copied into a collected holder.
+void gc_store(Interpreter* interp, Heap* holder, Literal* value){
+    if (value->datatype == FUNCTION || value->datatype == CLASS){
+        // the pin holds the reference from now on
+        gc_pin(interp, value->heap);
+        heap_release(interp, value->heap);
+        value->owns_str = 0;
+    }
+    if (holder->gen == GEN_OLD && !holder->buffered) remember(interp->gc, holder);
+}
+
+// Calls value on each value cell holds and replaces each buffer it owns
+// with what buffer returns.
+static void trace(Gc* gc, Heap* cell, void (*value)(Gc*, Literal*), void* (*buffer)(Gc*, void*)){
+    switch (cell->kind){
+        case HEAP_LIST: {
+            List* list = (List*)cell;
+            if (list->data) list->data = buffer(gc, list->data);
+            if (list->kind != LIST_BOXED) return;
+            for (int i = 0; i < list->count; i++) value(gc, &list->items[i]);
+            return;
+        }
+        case HEAP_DICT: {
+            Dict* dict = (Dict*)cell;
+            if (dict->entries) dict->entries = buffer(gc, dict->entries);
+            if (dict->index) dict->index = buffer(gc, dict->index);
+            for (int i = 0; i < dict->count; i++){
+                value(gc, &dict->entries[i].key);
+                value(gc, &dict->entries[i].value);
+            }
+            return;
+        }
+        case HEAP_OBJECT: {
+            Object* obj = (Object*)cell;
+            if (obj->slots != obj->inline_slots) obj->slots = buffer(gc, obj->slots);
+            for (int i = 0; i < obj->shape->count; i++) value(gc, &obj->slots[i]);
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+static void each_root(Interpreter* interp, Gc* gc, void (*value)(Gc*, Literal*)){
+    for (Variable* var = interp->symbol_table; var; var = var->next) value(gc, &var->literal);
+    for (int i = 0; i < interp->stack_top; i++) value(gc, &interp->stack[i]);
+    for (int i = 0; i < interp->temp_top; i++) value(gc, &interp->temps[i]);
+    for (int i = 0; i < interp->slot_count; i++){
+        if (interp->cse_slots[i].valid) value(gc, &interp->cse_slots[i].value);
+    }
+    if (interp->returned.owns_str) value(gc, &interp->returned);
+    for (RootRange* range = interp->vm_roots; range; range = range->next){
+        for (int i = 0; i < range->count; i++) value(gc, &range->values[i]);
+    }
+}
+
+// Minor collection: copies the young cells reachable from the roots and
+// the remembered set into the old generation, leaving each one's new
+// address behind, and traces the copies in turn.
+
+static Heap* promote(Gc* gc, Heap* cell){
+    Heap* copy;
+    if (cell->gen == GEN_FORWARDED){
+        memcpy(&copy, cell + 1, sizeof copy);
+        return copy;
+    }
+    copy = old_alloc(gc, cell->size);
+    if (!copy){
+        fprintf(stderr, "Out of memory in the old generation\n");
+        abort();
+    }
+    size_t size = copy->size;
+    memcpy(copy, cell, cell->size);
+    copy->size = size;
+    copy->gen = GEN_OLD;
+    copy->color = 0; // a major collection just before marks young cells too
+    if (cell->kind == HEAP_OBJECT && ((Object*)copy)->slots == ((Object*)cell)->inline_slots){
+        ((Object*)copy)->slots = ((Object*)copy)->inline_slots;
+    }
+    gc->promoted += cell->size;
+    cell->gen = GEN_FORWARDED;
+    memcpy(cell + 1, &copy, sizeof copy);
+    if (cell->kind <= HEAP_OBJECT) push(gc, copy); // a buffer is traced by its owner
+    return copy;
+}
+
+static void minor_value(Gc* gc, Literal* lit){
+    switch (lit->datatype){
+        case LIST:
+        case DICT:
+        case OBJECT:
+            if (lit->heap->gen != GEN_OLD) lit->heap = promote(gc, lit->heap);
+            return;
+        case STRING:
+            if (in_nursery(gc, lit->string)) lit->string = (char*)(promote(gc, (Heap*)lit->string - 1) + 1);
+            return;
+        default:
+            return;
+    }
+}
+
+static void* minor_buffer(Gc* gc, void* buffer){
+    if (!in_nursery(gc, buffer)) return buffer;
+    return promote(gc, (Heap*)buffer - 1) + 1;
+}
+
+static void minor(Interpreter* interp, Gc* gc){
+    gc->promoted = 0;
+    each_root(interp, gc, minor_value);
+    for (int i = 0; i < gc->remembered_count; i++){
+        gc->remembered[i]->buffered = 0;
+        trace(gc, gc->remembered[i], minor_value, minor_buffer);
+    }
+    gc->remembered_count = 0;
+    while (gc->work_count){
+        Heap* cell = gc->work[--gc->work_count];
+        trace(gc, cell, minor_value, minor_buffer);
+    }
+    gc->nursery_top = gc->nursery;
+    interp->stats.gc_minor++;
+    interp->stats.gc_promoted += gc->promoted;
+}
+
+// Major collection: marks everything reachable, young cells included so
+// the old cells only they refer to survive, and sweeps the old
+// generation. The minor collection that follows empties the nursery.
+
+static void mark_value(Gc* gc, Literal* lit){
+    switch (lit->datatype){
+        case LIST:
+        case DICT:
+        case OBJECT:
+            if (lit->heap->color) return;
+            lit->heap->color = 1;
+            push(gc, lit->heap);
+            return;
+        case STRING:
+            if (collected(gc, lit->string)) ((Heap*)lit->string - 1)->color = 1;
+            return;
+        default:
+            return;
+    }
+}
+
+static void* mark_buffer(Gc* gc, void* buffer){
+    (void)gc;
+    ((Heap*)buffer - 1)->color = 1;
+    return buffer;
+}
+
+// Frees the old cells left unmarked, joining neighbouring free space, and
+// clears the marks of the rest.
+static void sweep(Gc* gc){
+    memset(gc->free, 0, sizeof gc->free);
+    gc->large = NULL;
+    gc->free_bytes = 0;
+    size_t live = 0;
+    char* run = NULL; // start of the free space being joined
+    for (char* p = gc->old; p < gc->old_top; ){
+        Heap* cell = (Heap*)p;
+        size_t size = cell->size;
+        if (cell->kind != HEAP_FREE && cell->color){
+            cell->color = 0;
+            live += size;
+            if (run){
+                add_free(gc, run, p - run);
+                run = NULL;
+            }
+        } else if (!run){
+            run = p;
+        }
+        p += size;
+    }
+    if (run) gc->old_top = run; // free space at the end goes back to the bump pointer
+#ifndef _WIN32
+    // and so do its pages, once there are enough of them
+    char* from = (char*)round_up((uintptr_t)gc->old_top, (size_t)2 << 20);
+    if (gc->old_high > from && gc->old_high - from >= (2 << 20)){
+        madvise(from, gc->old_high - from, MADV_DONTNEED);
+        gc->old_high = from;
+    }
+#endif
+    gc->old_live = live;
+    gc->next_major = live * 2 > MIN_MAJOR ? live * 2 : MIN_MAJOR;
+}
+
+static void major(Interpreter* interp, Gc* gc){
+    each_root(interp, gc, mark_value);
+    while (gc->work_count){
+        Heap* cell = gc->work[--gc->work_count];
+        trace(gc, cell, mark_value, mark_buffer);
+    }
+    // the remembered cells about to be freed must not be traced
+    int kept = 0;
+    for (int i = 0; i < gc->remembered_count; i++){
+        if (gc->remembered[i]->color) gc->remembered[kept++] = gc->remembered[i];
+    }
+    gc->remembered_count = kept;
+    sweep(gc);
+    gc->major_due = 0;
+    interp->stats.gc_major++;
+}
+
+void gc_collect(Interpreter* interp){
+    interp->heap.gc_pending = 0;
+    Gc* gc = interp->gc;
+    if (!gc) return;
+    uint64_t start = timer_ns();
+    size_t young = gc->nursery_top - gc->nursery;
+    if (gc->major_due || (size_t)(gc->old_end - gc->old_top) + gc->free_bytes < young) major(interp, gc);
+    if ((size_t)(gc->old_end - gc->old_top) + gc->free_bytes < young){
+        stats_pause(&interp->stats, timer_ns() - start);
+        raiseError(interp, MEMORY_ERROR, "Out of memory");
+        return;
+    }
+    minor(interp, gc);
+    stats_pause(&interp->stats, timer_ns() - start);
+}
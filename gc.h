@@ -0,0 +1,62 @@
+// gc.h
+#ifndef GC_H
+#define GC_H
+
+#include <stddef.h>
+#include "memory.h"
+#include "heap.h"
+
+// The generational collector, the memory manager --gc=generational picks
+// instead of reference counting. Lists, dicts, objects, strings and the
+// storage they own are cells with a Heap header, allocated by bumping a
+// pointer through the nursery. When it fills up, the next safe point (see
+// heap_safe_point()) copies the young cells still reachable into the old
+// generation and starts the nursery over; the rest cost nothing to free.
+// The old generation is collected by mark-sweep once it has grown past
+// twice what the last one left alive.
+//
+// Roots are exact: the symbol table, the call stack, the temporaries, the
+// CSE slots and the operand stack of every running vm_resume(). A slot of
+// an operand stack above the top still holds the value it last held, so
+// that value stays alive until the slot is reused. References from the
+// old generation to young cells are found through the remembered set,
+// which every store into an old cell adds it to (heap_store()).
+//
+// Classes and functions stay counted; one that a collected value refers
+// to is pinned, and lives until the interpreter is destroyed.
+//
+// Each interpreter has its own configuration (interp->gc_config), set by
+// minipy_set_gc() before its first run. Sizes left at 0 take the defaults.
+typedef struct GcConfig {
+    int enabled;          // --gc=generational
+    size_t nursery_size;  // --gc-nursery=KB
+    size_t old_size;      // --gc-old=MB: the most the old generation grows to
+    int huge_pages;       // --gc-huge-pages: back the old generation with huge pages
+} GcConfig;
+
+// The nursery is at least this many kB, rounded up to whole pages; the old
+// generation at least the nursery, rounded up to 2 MB.
+#define GC_MIN_NURSERY 64
+#define GC_NURSERY_SIZE ((size_t)2 << 20)
+#define GC_OLD_SIZE ((size_t)1 << 30)
+
+typedef struct Gc Gc;
+
+// A run of values the collector treats as roots, linked from
+// interp->vm_roots while a vm_resume() runs.
+typedef struct RootRange {
+    Literal* values;
+    int count;
+    struct RootRange* next;
+} RootRange;
+
+// A new cell. For a list, dict or object size covers the whole struct and
+// the header is returned; for a string or buffer it is the size of the
+// contents, which are returned. NULL when out of memory.
+void* gc_alloc(Interpreter* interp, HeapKind kind, size_t size);
+void* gc_buffer(Interpreter* interp, Heap* owner, void* old, size_t size);
+char* gc_share_string(Interpreter* interp, char* string); // string, or a collected copy of it
+void gc_pin(Interpreter* interp, Heap* head);
+void gc_destroy(Interpreter* interp);
+
+#endif
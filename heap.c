@@ -0,0 +1,303 @@
+// heap.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "heap.h"
+#include "list.h"
+#include "dict.h"
+#include "object.h"
+#include "function.h"
+#include "context.h"
+#include "gc.h"
+#include "stats.h"
+#include "timer.h"
+#include "debug_alloc.h"
+
+enum {
+    BLACK,  // in use, or freed while still listed as a candidate
+    GRAY,   // reached by trial deletion
+    WHITE,  // garbage once trial deletion is done
+    PURPLE, // a candidate root
+};
+
+static void append(Heap*** array, int* count, int* capacity, Heap* head){
+    if (*count == *capacity){
+        int grown = *capacity ? *capacity * 2 : 256;
+        Heap** tmp = realloc(*array, sizeof(Heap*) * grown);
+        if (!tmp){
+            fprintf(stderr, "Out of memory in the cycle collector\n");
+            abort();
+        }
+        *array = tmp;
+        *capacity = grown;
+    }
+    (*array)[(*count)++] = head;
+}
+
+void heap_init(Heap* head, HeapKind kind){
+    head->refs = 1;
+    head->kind = kind;
+    head->color = BLACK;
+    head->buffered = 0;
+    head->gen = GEN_COUNTED;
+}
+
+void* heap_new(Interpreter* interp, HeapKind kind, size_t size){
+    if (interp->gc_config.enabled) return gc_alloc(interp, kind, size);
+    Heap* head = calloc(1, size);
+    if (head) heap_init(head, kind);
+    return head;
+}
+
+void* heap_buffer(Interpreter* interp, Heap* owner, void* old, size_t size){
+    if (owner->gen != GEN_COUNTED) return gc_buffer(interp, owner, old, size);
+    return realloc(old, size);
+}
+
+void heap_buffer_free(Heap* owner, void* buffer){
+    if (owner->gen == GEN_COUNTED) free(buffer);
+}
+
+char* heap_string(Interpreter* interp, size_t size){
+    if (interp->gc_config.enabled) return gc_alloc(interp, HEAP_STRING, size);
+    return malloc(size);
+}
+
+static inline int is_traced(const Literal* lit){
+    return lit->owns_str && (lit->datatype == LIST || lit->datatype == DICT || lit->datatype == OBJECT);
+}
+
+// Calls visit on every value a list, dict or object holds.
+static void each_child(Interpreter* interp, Heap* head, void (*visit)(Interpreter*, Literal*)){
+    switch (head->kind){
+        case HEAP_LIST: {
+            List* list = (List*)head;
+            if (list->kind != LIST_BOXED) return;
+            for (int i = 0; i < list->count; i++) visit(interp, &list->items[i]);
+            return;
+        }
+        case HEAP_DICT: {
+            Dict* dict = (Dict*)head;
+            for (int i = 0; i < dict->count; i++){
+                visit(interp, &dict->entries[i].key);
+                visit(interp, &dict->entries[i].value);
+            }
+            return;
+        }
+        case HEAP_OBJECT: {
+            Object* obj = (Object*)head;
+            for (int i = 0; i < obj->shape->count; i++) visit(interp, &obj->slots[i]);
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+// Frees the memory of a list, dict or object whose values are already
+// released.
+static void free_storage(Heap* head){
+    switch (head->kind){
+        case HEAP_LIST:
+            free(((List*)head)->data);
+            break;
+        case HEAP_DICT:
+            free(((Dict*)head)->entries);
+            free(((Dict*)head)->index);
+            break;
+        case HEAP_OBJECT: {
+            Object* obj = (Object*)head;
+            if (obj->slots != obj->inline_slots) free(obj->slots);
+            break;
+        }
+        default:
+            break;
+    }
+    free(head);
+}
+
+static void release_class(Interpreter* interp, Heap* head){
+    if (head->kind == HEAP_OBJECT) heap_release(interp, &((Object*)head)->cls->head);
+}
+
+static void possible_root(HeapState* heap, Heap* head){
+    if (head->color == PURPLE) return;
+    if (head->kind == HEAP_LIST && ((List*)head)->kind != LIST_BOXED) return; // holds no references
+    head->color = PURPLE;
+    if (head->buffered) return;
+    if (heap->root_count == heap->root_capacity){
+        int capacity = heap->root_capacity ? heap->root_capacity * 2 : 256;
+        Heap** tmp = realloc(heap->roots, sizeof(Heap*) * capacity);
+        if (!tmp) return; // not traced this time; a later release lists it again
+        heap->roots = tmp;
+        heap->root_capacity = capacity;
+    }
+    head->buffered = 1;
+    heap->roots[heap->root_count++] = head;
+}
+
+// Values whose count reached zero go through heap->dying, so freeing a
+// long chain of them cannot overflow the C stack.
+void heap_release(Interpreter* interp, Heap* head){
+    if (head->gen != GEN_COUNTED) return; // left to the tracing collector
+    switch (head->kind){
+        case HEAP_FUNCTION: function_release((Function*)head); return;
+        case HEAP_CLASS: class_release((Class*)head); return;
+        default: break;
+    }
+    HeapState* heap = &interp->heap;
+    if (--head->refs > 0){
+        possible_root(heap, head);
+        return;
+    }
+    append(&heap->dying, &heap->dying_count, &heap->dying_capacity, head);
+    if (heap->draining) return; // an outer call is releasing, and gets to it
+    heap->draining = 1;
+    while (heap->dying_count){
+        Heap* node = heap->dying[--heap->dying_count];
+        each_child(interp, node, release_literal);
+        release_class(interp, node);
+        node->color = BLACK;
+        if (!node->buffered) free_storage(node);
+        // else the collector still lists it and frees it when it gets there
+    }
+    heap->draining = 0;
+}
+
+// Work list of the traversals, so a long chain of objects cannot overflow
+// the C stack.
+static void push(Interpreter* interp, Heap* head){
+    HeapState* heap = &interp->heap;
+    append(&heap->work, &heap->work_count, &heap->work_capacity, head);
+}
+
+static void gray_child(Interpreter* interp, Literal* lit){
+    if (!is_traced(lit)) return;
+    lit->heap->refs--;
+    push(interp, lit->heap);
+}
+
+// Takes away the references the subgraph under head holds on itself.
+static void mark_gray(Interpreter* interp, Heap* head){
+    HeapState* heap = &interp->heap;
+    push(interp, head);
+    while (heap->work_count){
+        Heap* node = heap->work[--heap->work_count];
+        if (node->color == GRAY) continue;
+        node->color = GRAY;
+        each_child(interp, node, gray_child);
+    }
+}
+
+static void black_child(Interpreter* interp, Literal* lit){
+    if (!is_traced(lit)) return;
+    lit->heap->refs++;
+    if (lit->heap->color != BLACK){
+        lit->heap->color = BLACK;
+        push(interp, lit->heap);
+    }
+}
+
+// head is reachable from outside: gives back the references of everything
+// under it.
+static void scan_black(Interpreter* interp, Heap* head){
+    HeapState* heap = &interp->heap;
+    int base = heap->work_count;
+    head->color = BLACK;
+    push(interp, head);
+    while (heap->work_count > base){
+        Heap* node = heap->work[--heap->work_count];
+        each_child(interp, node, black_child);
+    }
+}
+
+static void scan_child(Interpreter* interp, Literal* lit){
+    if (is_traced(lit)) push(interp, lit->heap);
+}
+
+static void scan(Interpreter* interp, Heap* head){
+    HeapState* heap = &interp->heap;
+    push(interp, head);
+    while (heap->work_count){
+        Heap* node = heap->work[--heap->work_count];
+        if (node->color != GRAY) continue;
+        if (node->refs > 0){
+            scan_black(interp, node);
+            continue;
+        }
+        node->color = WHITE;
+        each_child(interp, node, scan_child);
+    }
+}
+
+static void white_child(Interpreter* interp, Literal* lit){
+    if (is_traced(lit)) push(interp, lit->heap);
+}
+
+static void collect_white(Interpreter* interp, Heap* head){
+    HeapState* heap = &interp->heap;
+    push(interp, head);
+    while (heap->work_count){
+        Heap* node = heap->work[--heap->work_count];
+        if (node->color != WHITE || node->buffered) continue;
+        node->color = BLACK;
+        append(&heap->garbage, &heap->garbage_count, &heap->garbage_capacity, node);
+        each_child(interp, node, white_child);
+    }
+}
+
+// Values of garbage that are not part of it: strings and counted values
+// the collector does not trace. References between garbage were already
+// taken away by mark_gray().
+static void release_untraced(Interpreter* interp, Literal* lit){
+    if (!is_traced(lit)) release_literal(interp, lit);
+}
+
+void heap_collect(Interpreter* interp){
+    HeapState* heap = &interp->heap;
+    if (!heap->root_count) return;
+    uint64_t start = timer_ns();
+    int count = heap->root_count;
+    int kept = 0;
+    for (int i = 0; i < count; i++){
+        Heap* head = heap->roots[i];
+        if (head->color == PURPLE && head->refs > 0){
+            mark_gray(interp, head);
+            heap->roots[kept++] = head;
+            continue;
+        }
+        head->buffered = 0;
+        if (head->color == BLACK && head->refs == 0) free_storage(head);
+    }
+    for (int i = 0; i < kept; i++) scan(interp, heap->roots[i]);
+    heap->garbage_count = 0;
+    for (int i = 0; i < kept; i++){
+        heap->roots[i]->buffered = 0;
+        collect_white(interp, heap->roots[i]);
+    }
+    heap->root_count = 0;
+
+    for (int i = 0; i < heap->garbage_count; i++){
+        each_child(interp, heap->garbage[i], release_untraced);
+        release_class(interp, heap->garbage[i]);
+    }
+    for (int i = 0; i < heap->garbage_count; i++) free_storage(heap->garbage[i]);
+
+    interp->stats.cycle_collections++;
+    interp->stats.cycle_freed += heap->garbage_count;
+    stats_pause(&interp->stats, timer_ns() - start);
+
+    // the buffers are empty again; give them back so an idle interpreter
+    // keeps nothing
+    heap_state_free(heap);
+}
+
+void heap_state_free(HeapState* heap){
+    free(heap->roots);
+    free(heap->work);
+    free(heap->garbage);
+    free(heap->dying);
+    heap->roots = heap->work = heap->garbage = heap->dying = NULL;
+    heap->root_capacity = heap->work_capacity = heap->garbage_capacity = heap->dying_capacity = 0;
+    heap->root_count = heap->work_count = heap->garbage_count = heap->dying_count = 0;
+}
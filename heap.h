@@ -0,0 +1,115 @@
+// heap.h
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stddef.h>
+#include "memory.h"
+
+typedef enum {
+    HEAP_LIST,
+    HEAP_DICT,
+    HEAP_OBJECT,
+    HEAP_CLASS,
+    HEAP_FUNCTION,
+    // only under the generational collector (gc.h)
+    HEAP_STRING,
+    HEAP_BUFFER, // the storage of a list, dict or object
+    HEAP_FREE,   // old generation space not in use
+} HeapKind;
+
+// The header every reference-counted value starts with, so a Literal can
+// retain and release any of them through lit.heap. A variable, a stack
+// slot, a container element or a temporary with owns_str set holds one
+// reference; the value is freed as soon as the last one goes.
+//
+// Counting alone never frees a cycle, say a list that contains itself or
+// two objects pointing at each other. Lists, dicts and objects that are
+// released but stay alive become candidate roots, and once enough have
+// gathered, heap_collect() runs trial deletion over them (Bacon and
+// Rajan's synchronous cycle collector): it subtracts the references the
+// candidates' subgraph holds on itself, and whatever is left with no
+// count is garbage. Classes and functions never refer back to a value,
+// so they are not traced.
+//
+// With --gc=generational, lists, dicts, objects and strings are instead
+// allocated by the tracing collector in gc.h and carry this header
+// uncounted; classes and functions are counted either way.
+typedef struct Heap {
+    union {
+        int refs;      // counted values
+        unsigned size; // collected ones: bytes of the cell, header included
+    };
+    unsigned char kind;
+    unsigned char color;    // cycle collector state, or the collector's mark
+    unsigned char buffered; // listed as a candidate root, or remembered (gc.h)
+    unsigned char gen;      // GEN_COUNTED, or the generation of a collected value
+} Heap;
+
+enum {
+    GEN_COUNTED,
+    GEN_YOUNG,
+    GEN_OLD,
+    GEN_FORWARDED, // a young cell already copied out; the new address follows the header
+};
+
+// Candidates gathered before the next safe point runs the collector.
+#define HEAP_ROOTS_LIMIT 10000
+
+// The memory manager's state, one per interpreter (interp->heap), so an
+// interpreter can move between threads and take its candidates along.
+// The arrays are work lists rather than recursion, so a long chain of
+// values cannot overflow the C stack.
+typedef struct HeapState {
+    Heap** roots; // candidate roots
+    int root_count;
+    int root_capacity;
+    Heap** work; // traversals of the cycle collector
+    int work_count;
+    int work_capacity;
+    Heap** dying; // count reached zero, values yet to be released
+    int dying_count;
+    int dying_capacity;
+    int draining; // a heap_release() further up is emptying dying
+    Heap** garbage; // found by the running collection
+    int garbage_count;
+    int garbage_capacity;
+    int gc_pending; // an allocation asked the generational collector (gc.h) to run
+} HeapState;
+
+void heap_init(Heap* head, HeapKind kind);
+
+static inline void heap_retain(Heap* head){
+    if (head->kind == HEAP_FUNCTION) __atomic_add_fetch(&head->refs, 1, __ATOMIC_RELAXED); // see function.h
+    else if (head->gen == GEN_COUNTED) head->refs++;
+}
+
+void heap_release(Interpreter* interp, Heap* head);
+
+// Allocation for whichever memory manager is in use. heap_new() returns a
+// zeroed value of size bytes with its header set and one reference for
+// the caller; heap_buffer() is realloc() for the storage the value owner
+// points to. All return NULL when out of memory.
+void* heap_new(Interpreter* interp, HeapKind kind, size_t size);
+void* heap_buffer(Interpreter* interp, Heap* owner, void* old, size_t size);
+void heap_buffer_free(Heap* owner, void* buffer);
+char* heap_string(Interpreter* interp, size_t size); // owned by the Literal it goes in
+
+void gc_store(Interpreter* interp, Heap* holder, Literal* value);
+
+// The copy of value a list, dict or object keeps in one of its slots.
+static inline Literal heap_store(Interpreter* interp, Heap* holder, Literal value){
+    Literal copy = copy_literal(interp, value);
+    if (holder->gen != GEN_COUNTED) gc_store(interp, holder, &copy);
+    return copy;
+}
+
+// Frees the unreachable cycles among the candidates. Only run at safe
+// points, between statements and on loop back-edges, where every value
+// in use is held by something counted.
+void heap_collect(Interpreter* interp);
+void gc_collect(Interpreter* interp);
+void heap_state_free(HeapState* heap);
+
+// heap_safe_point() is in context.h.
+
+#endif
@@ -0,0 +1,133 @@
+// hooks.c
+#include <stdio.h>
+#include <string.h>
+#include "hooks.h"
+#include "bytecode.h"
+#include "interpreter.h"
+#include "stats.h"
+#include "context.h"
+
+#define MAX_OBSERVERS 8
+
+extern int debug;
+
+unsigned hook_mask = 0;
+
+static Observer observers[MAX_OBSERVERS];
+static int in_use[MAX_OBSERVERS];
+
+static void update_mask(){
+    hook_mask = 0;
+    for (int i = 0; i < MAX_OBSERVERS; i++){
+        if (!in_use[i]) continue;
+        Observer* o = &observers[i];
+        if (o->on_line) hook_mask |= HOOK_LINE;
+        if (o->on_tokens) hook_mask |= HOOK_TOKENS;
+        if (o->on_ast) hook_mask |= HOOK_AST;
+        if (o->on_statement) hook_mask |= HOOK_STATEMENT;
+        if (o->on_variable) hook_mask |= HOOK_VARIABLE;
+        if (o->on_bytecode) hook_mask |= HOOK_BYTECODE;
+    }
+}
+
+int observer_attach(const Observer* observer){
+    for (int i = 0; i < MAX_OBSERVERS; i++){
+        if (in_use[i]) continue;
+        observers[i] = *observer;
+        in_use[i] = 1;
+        update_mask();
+        return i;
+    }
+    return -1;
+}
+
+void observer_detach(int id){
+    if (id < 0 || id >= MAX_OBSERVERS) return;
+    in_use[id] = 0;
+    update_mask();
+}
+
+void hook_line(Interpreter* interp, const char* text){
+    for (int i = 0; i < MAX_OBSERVERS; i++)
+        if (in_use[i] && observers[i].on_line) observers[i].on_line(observers[i].ctx, interp, text);
+}
+
+void hook_tokens(Interpreter* interp, Token* tokens, int count){
+    for (int i = 0; i < MAX_OBSERVERS; i++)
+        if (in_use[i] && observers[i].on_tokens) observers[i].on_tokens(observers[i].ctx, interp, tokens, count);
+}
+
+void hook_ast(Interpreter* interp, ASTNode* root){
+    for (int i = 0; i < MAX_OBSERVERS; i++)
+        if (in_use[i] && observers[i].on_ast) observers[i].on_ast(observers[i].ctx, interp, root);
+}
+
+void hook_statement(Interpreter* interp, ASTNode* root){
+    for (int i = 0; i < MAX_OBSERVERS; i++)
+        if (in_use[i] && observers[i].on_statement) observers[i].on_statement(observers[i].ctx, interp, root);
+}
+
+void hook_variable(Interpreter* interp, const char* name, Literal value){
+    for (int i = 0; i < MAX_OBSERVERS; i++)
+        if (in_use[i] && observers[i].on_variable) observers[i].on_variable(observers[i].ctx, interp, name, value);
+}
+
+void hook_bytecode(Interpreter* interp, ASTNode* loop, Chunk* chunk){
+    for (int i = 0; i < MAX_OBSERVERS; i++)
+        if (in_use[i] && observers[i].on_bytecode) observers[i].on_bytecode(observers[i].ctx, interp, loop, chunk);
+}
+
+// The 'debug' statement attaches this observer
+
+static void debug_line(void* ctx, Interpreter* interp, const char* text){
+    (void)ctx;
+    fprintf(interp->out, "%s, %d\n", text, (int)strlen(text));
+}
+
+static void debug_tokens(void* ctx, Interpreter* interp, Token* tokens, int count){
+    (void)ctx;
+    fprintf(interp->out, "Tokens:\n");
+    print_tokens_debug(interp->out, tokens, count);
+}
+
+static void debug_ast(void* ctx, Interpreter* interp, ASTNode* root){
+    (void)ctx;
+    fprintf(interp->out, "\nAST:\n");
+    print_ast_debug(interp->out, root, 0, 0);
+}
+
+static void debug_statement(void* ctx, Interpreter* interp, ASTNode* root){
+    (void)ctx;
+    (void)root;
+    fprintf(interp->out, "\nVariables:\n");
+    get_variables(interp);
+}
+
+static void debug_bytecode(void* ctx, Interpreter* interp, ASTNode* loop, Chunk* chunk){
+    (void)ctx;
+    (void)loop;
+    fprintf(interp->out, "\nBytecode:\n");
+    print_chunk_debug(interp->out, chunk);
+}
+
+static const Observer debug_observer = {
+    .on_line = debug_line,
+    .on_tokens = debug_tokens,
+    .on_ast = debug_ast,
+    .on_statement = debug_statement,
+    .on_bytecode = debug_bytecode,
+};
+
+static int debug_id = -1;
+int debug_locked = 0;
+
+void debug_set(int level){
+    if (debug_locked) return;
+    debug = level;
+    if (level >= 2) stats_enabled = 1;
+    if (level && debug_id < 0) debug_id = observer_attach(&debug_observer);
+    if (!level && debug_id >= 0){
+        observer_detach(debug_id);
+        debug_id = -1;
+    }
+}
@@ -0,0 +1,57 @@
+// hooks.h
+#ifndef HOOKS_H
+#define HOOKS_H
+
+#include "lexer.h"
+#include "ast.h"
+#include "memory.h"
+
+typedef struct Chunk Chunk;
+typedef struct Interpreter Interpreter;
+
+// Observers are told about interpreter events. Any callback may be NULL;
+// ctx is passed back unchanged, interp is the interpreter the event
+// happened in. Observers are shared by every interpreter in the process.
+typedef struct {
+    void (*on_line)(void* ctx, Interpreter* interp, const char* text);           // script line about to be tokenized
+    void (*on_tokens)(void* ctx, Interpreter* interp, Token* tokens, int count); // a line was tokenized
+    void (*on_ast)(void* ctx, Interpreter* interp, ASTNode* root);               // a top-level statement was parsed
+    void (*on_statement)(void* ctx, Interpreter* interp, ASTNode* root);         // ... and has finished running
+    void (*on_variable)(void* ctx, Interpreter* interp, const char* name, Literal value); // a variable was assigned
+    void (*on_bytecode)(void* ctx, Interpreter* interp, ASTNode* loop, Chunk* chunk);     // a hot loop was compiled
+    void* ctx;
+} Observer;
+
+enum {
+    HOOK_LINE = 1 << 0,
+    HOOK_TOKENS = 1 << 1,
+    HOOK_AST = 1 << 2,
+    HOOK_STATEMENT = 1 << 3,
+    HOOK_VARIABLE = 1 << 4,
+    HOOK_BYTECODE = 1 << 5,
+};
+
+// Events at least one attached observer listens to
+extern unsigned hook_mask;
+
+int observer_attach(const Observer* observer); // returns an id, -1 if full
+void observer_detach(int id);
+void debug_set(int level); // the 'debug N' statement
+extern int debug_locked; // --batch: scripts run side by side, 'debug N' is ignored
+
+void hook_line(Interpreter* interp, const char* text);
+void hook_tokens(Interpreter* interp, Token* tokens, int count);
+void hook_ast(Interpreter* interp, ASTNode* root);
+void hook_statement(Interpreter* interp, ASTNode* root);
+void hook_variable(Interpreter* interp, const char* name, Literal value);
+void hook_bytecode(Interpreter* interp, ASTNode* loop, Chunk* chunk);
+
+// Release builds (-DNDEBUG) drop the hooks entirely; otherwise a hook
+// costs one test of hook_mask when nobody is listening.
+#ifdef NDEBUG
+#define HOOK(event, call) ((void)0)
+#else
+#define HOOK(event, call) do { if (hook_mask & (event)) call; } while (0)
+#endif
+
+#endif
@@ -6,104 +6,147 @@
 #include "ast.h"
 #include "interpreter.h"
 #include "memory.h"
+#include "list.h"
+#include "dict.h"
+#include "function.h"
+#include "heap.h"
+#include "object.h"
 #include "error_handling.h"
-// #include "debug_alloc.h"
+#include "context.h"
+#include "tier.h"
+#include "optimize.h"
+#include "profile.h"
+#include "stats.h"
+#include "trace.h"
+#include "timer.h"
+#include "debug_alloc.h"
 
 extern const char* AST_node_name(ASTNodeType type);
 
-void print_literal(Literal lit){
+// A value as it appears inside a list or dict, without a newline
+void fprint_value(FILE* out, Literal lit){
     switch (lit.datatype) {
-        case INT: printf("%d\n", lit.numeric); break;
-        case FLOAT: printf("%f\n", lit.floating_point); break;
-        case STRING: printf("\'%s\'\n", lit.string); break;
-        case BOOLEAN: {
-            if (lit.boolean){
-                printf("True\n"); break;
-            }
-            printf("False\n"); break;
-        }
+        case INT: fprintf(out, "%d", lit.numeric); break;
+        case FLOAT: fprintf(out, "%f", lit.floating_point); break;
+        case STRING: fprintf(out, "\'%s\'", lit.string); break;
+        case BOOLEAN: fputs(lit.boolean ? "True" : "False", out); break;
+        case LIST: fprint_list(out, lit.list); break;
+        case DICT: fprint_dict(out, lit.dict); break;
+        case FUNCTION: fprintf(out, "<function %s>", lit.function->name); break;
+        case CLASS: fprintf(out, "<class \'%s\'>", lit.cls->name); break;
+        case OBJECT: fprint_object(out, lit.object); break;
+        default: fputs("None", out); break;
     }
 }
 
+void fprint_literal(FILE* out, Literal lit){
+    if (lit.datatype == NONE || lit.datatype == ERROR) return;
+    fprint_value(out, lit);
+    fputc('\n', out);
+}
+
+void print_literal(Literal lit){
+    fprint_literal(stdout, lit);
+}
+
 int is_truthy(Literal val) {
     switch (val.datatype) {
         case BOOLEAN: return val.boolean != 0;
         case INT: return val.numeric != 0;
         case FLOAT: return val.floating_point != 0.0;
         case STRING: return val.string && strlen(val.string) > 0;
+        case LIST: return val.list->count > 0;
+        case DICT: return val.dict->count > 0;
         case NONE: return 0;
         default: return 0;
     }
 }
 
-ASTNode* operate(ASTNode* node){
-    Literal left_val, right_val, result;
-    left_val.owns_str = 0;
-    right_val.owns_str = 0;
-    result.owns_str = 0;
-    ASTNode* temp = malloc(sizeof(ASTNode));
+const char* datatype_name(DataType type) {
+    switch (type) {
+        case NONE: return "NoneType";
+        case INT: return "int";
+        case FLOAT: return "float";
+        case STRING: return "str";
+        case BOOLEAN: return "bool";
+        case LIST: return "list";
+        case DICT: return "dict";
+        case FUNCTION: return "function";
+        case CLASS: return "type";
+        case OBJECT: return "object";
+        default: return "unknown";
+    }
+}
 
-    // Resolve left value
-    if (node->operate.left->type == AST_OPERATOR) {
-        node->operate.left = operate(node->operate.left);
+// Equality of dict keys and of the elements 'in' looks for: numbers by
+// value whatever their type, strings by content, anything else by identity.
+int values_equal(Literal a, Literal b){
+    int a_num = a.datatype == INT || a.datatype == FLOAT || a.datatype == BOOLEAN;
+    int b_num = b.datatype == INT || b.datatype == FLOAT || b.datatype == BOOLEAN;
+    if (a_num && b_num){
+        if (a.datatype == FLOAT || b.datatype == FLOAT){
+            float l = a.datatype == FLOAT ? a.floating_point : a.datatype == INT ? (float)a.numeric : (float)a.boolean;
+            float r = b.datatype == FLOAT ? b.floating_point : b.datatype == INT ? (float)b.numeric : (float)b.boolean;
+            return l == r;
+        }
+        return (a.datatype == INT ? a.numeric : a.boolean) == (b.datatype == INT ? b.numeric : b.boolean);
     }
-    switch (node->operate.left->type){
-        case AST_IDENTIFIER:
-            Literal lit = get_variable(node->operate.left->name);
-            if(lit.datatype == ERROR){
-                free(temp);
-                return NULL;
-            }
-            left_val = copy_literal(lit);
-            break;
-        case AST_NONE:
-        case AST_NUMERIC: 
-        case AST_FLOATING_POINT: 
-        case AST_BOOLEAN: 
-        case AST_STRING: 
-            left_val = copy_literal(node->operate.left->literal);
-            break;
-        default: goto type_error;
+    if (a.datatype != b.datatype) return 0;
+    switch (a.datatype){
+        case STRING: return strcmp(a.string, b.string) == 0;
+        case LIST: return a.list == b.list;
+        case DICT: return a.dict == b.dict;
+        case FUNCTION: return a.function == b.function;
+        case CLASS: return a.cls == b.cls;
+        case OBJECT: return a.object == b.object;
+        case NONE: return 1;
+        default: return 0;
     }
+}
 
-    // Resolve right value
-    if (node->operate.right->type == AST_OPERATOR) {
-        node->operate.right = operate(node->operate.right);
-    }
-    switch (node->operate.right->type){
-        case AST_IDENTIFIER:
-            Literal lit = get_variable(node->operate.right->name);
-            if(lit.datatype == ERROR){
-                free(temp);
-                return NULL;
-            }
-            right_val = copy_literal(lit);
+// item in container: a key of a dict, an element of a list or a substring
+static int contains(Interpreter* interp, Literal item, Literal container){
+    switch (container.datatype){
+        case DICT:
+            return dict_contains(interp, container.dict, item);
+        case LIST:
+            return list_contains(container.list, item);
+        case STRING:
+            if (item.datatype == STRING) return strstr(container.string, item.string) != NULL;
             break;
-        case AST_NONE:
-        case AST_NUMERIC: 
-        case AST_FLOATING_POINT: 
-        case AST_BOOLEAN: 
-        case AST_STRING:
-            right_val = copy_literal(node->operate.right->literal);
+        default:
             break;
-        default:  
-            goto type_error;
     }
+    char msg[255];
+    sprintf(msg, "Unsupported operand type(s) for \'in\': \'%s\' and \'%s\'", datatype_name(item.datatype), datatype_name(container.datatype));
+    raiseError(interp, TYPE_ERROR, msg);
+    return 0;
+}
+
+// Applies a binary operator to two resolved values. The operands are only
+// borrowed; a string result is always owned by the caller (owns_str = 1).
+// Raises an error if the operation is not supported.
+void binary_op(Interpreter* interp, char op, Literal left_val, Literal right_val, Literal* out){
+    Literal result;
+    result.owns_str = 0;
+    stats_op(&interp->stats, op, left_val.datatype, right_val.datatype);
 
-    char op = node->operate.op;
-    
-    //Check for zero_division error
     switch (op){
         case '/': {
             switch (right_val.datatype){
-                case INT: if(right_val.numeric == 0); goto zero_division_error;
-                case FLOAT: if(right_val.floating_point == 0.0); goto zero_division_error;
-                case BOOLEAN: if(right_val.boolean == 0); goto zero_division_error;
-                default:break;
+                case INT: if (right_val.numeric == 0) goto zero_division_error; break;
+                case FLOAT: if (right_val.floating_point == 0.0) goto zero_division_error; break;
+                case BOOLEAN: if (right_val.boolean == 0) goto zero_division_error; break;
+                default: break;
             }
             break;
         }
         case '&': case '|': case '!': goto andornot;
+        case 'i':
+            result.datatype = BOOLEAN;
+            result.boolean = contains(interp, left_val, right_val);
+            *out = result;
+            return;
     }
 
     // Numeric & Boolean operation
@@ -145,14 +188,15 @@ ASTNode* operate(ASTNode* node){
         if (op == '+') {
             size_t len_l = strlen(left_val.string);
             size_t len_r = strlen(right_val.string);
-            char *buf = malloc(len_l + len_r + 1);
+            char *buf = heap_string(interp, len_l + len_r + 1);
             if (buf == NULL) {
-                raiseError(MEMORY_ERROR, "Memory allocation failed");
-                return NULL;
+                raiseError(interp, MEMORY_ERROR, "Memory allocation failed");
+                return;
             }
             memcpy(buf, left_val.string, len_l);
             memcpy(buf + len_l, right_val.string, len_r);
             buf[len_l + len_r] = '\0'; // Null-terminate the string
+            stats_string(&interp->stats, len_l + len_r + 1, len_l + len_r);
     
             result.string = buf;
             result.owns_str = 1;
@@ -162,24 +206,20 @@ ASTNode* operate(ASTNode* node){
     } else if (left_val.datatype == STRING && right_val.datatype == INT) {
         result.datatype = STRING;
         if (op == '*') {
-            if (right_val.numeric > 0){
-                size_t len_l = strlen(left_val.string);  
-                char *buf = malloc((len_l * right_val.numeric) + 1);
-                if (buf == NULL) {
-                    raiseError(MEMORY_ERROR, "Memory allocation failed");
-                    return NULL;
-                }
-                size_t k = 0;
-                while (k < (size_t)right_val.numeric) {
-                    memcpy(buf + (len_l * k), left_val.string, len_l);
-                    k++;
-                }
-                buf[len_l * right_val.numeric] = '\0'; // Null-terminate the string
-                result.string = buf;
-                result.owns_str = 1;
-            } else {
-                result.string = "";
+            size_t count = right_val.numeric > 0 ? (size_t)right_val.numeric : 0;
+            size_t len_l = strlen(left_val.string);  
+            char *buf = heap_string(interp, (len_l * count) + 1);
+            if (buf == NULL) {
+                raiseError(interp, MEMORY_ERROR, "Memory allocation failed");
+                return;
+            }
+            for (size_t k = 0; k < count; k++) {
+                memcpy(buf + (len_l * k), left_val.string, len_l);
             }
+            buf[len_l * count] = '\0'; // Null-terminate the string
+            stats_string(&interp->stats, len_l * count + 1, len_l * count);
+            result.string = buf;
+            result.owns_str = 1;
         } else {
             goto type_error;
         }
@@ -188,20 +228,12 @@ ASTNode* operate(ASTNode* node){
     else {
         type_error:
             char msg[255];
-            if (left_val.owns_str) {
-                free(left_val.string);
-            }
-            if (right_val.owns_str) {
-                free(right_val.string);
-            }  
-            sprintf(msg, "Unsupported operand type(s) for \'%c\': \'%c\' and \'%c\'", op, left_val.datatype, right_val.datatype);
-            raiseError(TYPE_ERROR, msg);
-            free(temp);
-            return NULL;
+            sprintf(msg, "Unsupported operand type(s) for \'%c\': \'%s\' and \'%s\'", op, datatype_name(left_val.datatype), datatype_name(right_val.datatype));
+            raiseError(interp, TYPE_ERROR, msg);
+            return;
         zero_division_error:
-            raiseError(ZERO_DIVISION_ERROR, "Division by zero");
-            free(temp);
-            return NULL;
+            raiseError(interp, ZERO_DIVISION_ERROR, "Division by zero");
+            return;
         //Comparative Operation
         comparative_operation: 
             float l = (left_val.datatype == FLOAT) ? left_val.floating_point : (left_val.datatype == INT) ? (float)left_val.numeric : (float)left_val.boolean;
@@ -221,16 +253,16 @@ ASTNode* operate(ASTNode* node){
             switch (op){
                 case '&':
                     if (left_true == 0) {
-                        result = copy_literal(left_val);
+                        result = copy_literal(interp, left_val);
                     }else{
-                        result = copy_literal(right_val);
+                        result = copy_literal(interp, right_val);
                     }
                     break;
                 case '|':
                     if (left_true != 0) {
-                        result = copy_literal(left_val);
+                        result = copy_literal(interp, left_val);
                     }else{
-                        result = copy_literal(right_val);
+                        result = copy_literal(interp, right_val);
                     }
                     break;
                 case '!':
@@ -240,33 +272,395 @@ ASTNode* operate(ASTNode* node){
             }
     }
 
-    switch (result.datatype){
-        case INT: temp->type = AST_NUMERIC; break;
-        case FLOAT: temp->type = AST_FLOATING_POINT; break;
-        case STRING: temp->type = AST_STRING; break;
-        case BOOLEAN: temp->type = AST_BOOLEAN; break;
-        default:break;
+    *out = result;
+}
+
+// target[index]. The operands are borrowed and out is owned by the caller.
+void index_get(Interpreter* interp, Literal target, Literal index, Literal* out){
+    if (target.datatype == LIST){
+        list_get(interp, target.list, index, out);
+        return;
     }
-    temp->literal = result;
-    
-    if (left_val.owns_str) {
-        free(left_val.string);
+    if (target.datatype == DICT){
+        dict_get(interp, target.dict, index, out);
+        return;
     }
-    if (right_val.owns_str) {
-        free(right_val.string);
-    } 
-    
-    return temp;
+    if (target.datatype == STRING && (index.datatype == INT || index.datatype == BOOLEAN)){
+        int len = strlen(target.string);
+        int i = index.datatype == INT ? index.numeric : index.boolean;
+        if (i < 0) i += len;
+        if ((unsigned)i >= (unsigned)len){
+            raiseError(interp, INDEX_ERROR, "String index out of range");
+            return;
+        }
+        char* buf = heap_string(interp, 2);
+        if (!buf){
+            raiseError(interp, MEMORY_ERROR, "Memory allocation failed");
+            return;
+        }
+        buf[0] = target.string[i];
+        buf[1] = '\0';
+        stats_string(&interp->stats, 2, 1);
+        out->datatype = STRING;
+        out->string = buf;
+        out->owns_str = 1;
+        return;
+    }
+    char msg[255];
+    if (target.datatype == STRING){
+        sprintf(msg, "String indices must be integers, not \'%s\'", datatype_name(index.datatype));
+    }else{
+        sprintf(msg, "\'%s\' object is not subscriptable", datatype_name(target.datatype));
+    }
+    raiseError(interp, TYPE_ERROR, msg);
+}
+
+// target[index] = value, or target[index] op= value
+void index_assign(Interpreter* interp, char op, Literal target, Literal index, Literal value){
+    if (target.datatype == DICT){
+        if (op == '='){
+            dict_set(interp, target.dict, index, value);
+            return;
+        }
+        Literal* old = temp_push(interp);
+        dict_get(interp, target.dict, index, old);
+        Literal* result = temp_push(interp);
+        binary_op(interp, op, *old, value, result);
+        dict_set(interp, target.dict, index, *result);
+        release_literal(interp, old);
+        release_literal(interp, result);
+        interp->temp_top -= 2;
+        return;
+    }
+    if (target.datatype != LIST){
+        char msg[255];
+        sprintf(msg, "\'%s\' object does not support item assignment", datatype_name(target.datatype));
+        raiseError(interp, TYPE_ERROR, msg);
+        return;
+    }
+    if (op == '='){
+        list_set(interp, target.list, index, value);
+        return;
+    }
+    Literal* old = temp_push(interp);
+    list_get(interp, target.list, index, old);
+    Literal* result = temp_push(interp);
+    binary_op(interp, op, *old, value, result);
+    list_set(interp, target.list, index, *result);
+    release_literal(interp, old);
+    release_literal(interp, result);
+    interp->temp_top -= 2;
+}
+
+// Runs a builtin on borrowed arguments; a method gets its object as
+// args[0]. Raises for names that are not builtins.
+void call_builtin(Interpreter* interp, Builtin builtin, const char* name, int method, Literal* args, int count, Literal* out){
+    char msg[255];
+    out->owns_str = 0;
+    switch (builtin){
+        case BUILTIN_LEN:
+            if (count != 1) goto arity_error;
+            out->datatype = INT;
+            if (args[0].datatype == LIST){
+                out->numeric = args[0].list->count;
+            }else if (args[0].datatype == DICT){
+                out->numeric = args[0].dict->count;
+            }else if (args[0].datatype == STRING){
+                out->numeric = strlen(args[0].string);
+            }else{
+                sprintf(msg, "Object of type \'%s\' has no len()", datatype_name(args[0].datatype));
+                raiseError(interp, TYPE_ERROR, msg);
+            }
+            return;
+        case BUILTIN_APPEND:
+            if (args[0].datatype != LIST) break;
+            if (count != 2) goto arity_error;
+            list_append(interp, args[0].list, args[1]);
+            out->datatype = NONE;
+            return;
+        default:
+            break;
+    }
+    if (method){
+        sprintf(msg, "\'%s\' object has no method \'%s\'", datatype_name(args[0].datatype), name);
+        raiseError(interp, TYPE_ERROR, msg);
+    }else{
+        snprintf(msg, sizeof msg, "Undefined function -> %s", name);
+        raiseError(interp, NAME_ERROR, msg);
+    }
+    return;
+
+    arity_error:
+        sprintf(msg, "%s() takes exactly one argument (%d given)", name, count - method);
+        raiseError(interp, TYPE_ERROR, msg);
+}
+
+// Checks the arguments of range() and stores start, stop and step in
+// bounds; a single argument is the stop.
+void range_bounds(Interpreter* interp, const Literal* args, int count, int* bounds){
+    bounds[0] = 0;
+    bounds[2] = 1;
+    for (int i = 0; i < count; i++){
+        int value;
+        switch (args[i].datatype){
+            case INT: value = args[i].numeric; break;
+            case BOOLEAN: value = args[i].boolean; break;
+            default: {
+                char msg[255];
+                sprintf(msg, "range() arguments must be integers, not \'%s\'", datatype_name(args[i].datatype));
+                raiseError(interp, TYPE_ERROR, msg);
+                return;
+            }
+        }
+        bounds[count == 1 ? 1 : i] = value;
+    }
+    if (bounds[2] == 0) raiseError(interp, VALUE_ERROR, "range() arg 3 must not be zero");
+}
+
+// Resolves an expression node to a value without modifying the tree.
+// The caller owns out; errors unwind to the enclosing error frame.
+void eval_expression(Interpreter* interp, ASTNode* node, Literal* out){
+    switch (node->type){
+        case AST_IDENTIFIER:
+            *out = copy_literal(interp, get_variable(interp, node->name));
+            return;
+        case AST_LOCAL:
+            *out = copy_literal(interp, get_local(interp, node->local.slot, node->local.name));
+            return;
+        case AST_NONE:
+        case AST_NUMERIC: 
+        case AST_FLOATING_POINT: 
+        case AST_BOOLEAN: 
+        case AST_STRING: 
+            *out = copy_literal(interp, node->literal);
+            return;
+        case AST_OPERATOR: {
+            Literal* left_val = temp_push(interp);
+            eval_expression(interp, node->operate.left, left_val);
+            Literal* right_val = temp_push(interp);
+            eval_expression(interp, node->operate.right, right_val);
+            binary_op(interp, node->operate.op, *left_val, *right_val, out);
+            release_literal(interp, left_val);
+            release_literal(interp, right_val);
+            interp->temp_top -= 2;
+            return;
+        }
+        case AST_LIST: {
+            int mark = interp->temp_top;
+            for (int i = 0; i < node->list.count; i++){
+                eval_expression(interp, node->list.items[i], temp_push(interp));
+            }
+            out->list = list_from(interp, &interp->temps[mark], node->list.count);
+            out->datatype = LIST;
+            out->owns_str = 1;
+            temps_unwind(interp, mark);
+            return;
+        }
+        case AST_DICT: {
+            int mark = interp->temp_top;
+            for (int i = 0; i < node->list.count; i++){
+                eval_expression(interp, node->list.items[i], temp_push(interp));
+            }
+            out->dict = dict_from(interp, &interp->temps[mark], node->list.count / 2);
+            out->datatype = DICT;
+            out->owns_str = 1;
+            temps_unwind(interp, mark);
+            return;
+        }
+        case AST_INDEX: {
+            Literal* target = temp_push(interp);
+            eval_expression(interp, node->index.target, target);
+            Literal* index = temp_push(interp);
+            eval_expression(interp, node->index.index, index);
+            index_get(interp, *target, *index, out);
+            release_literal(interp, target);
+            release_literal(interp, index);
+            interp->temp_top -= 2;
+            return;
+        }
+        case AST_ATTR: {
+            Literal* target = temp_push(interp);
+            eval_expression(interp, node->attr.object, target);
+            attr_get(interp, *target, node->attr.name, node->attr.site, out);
+            release_literal(interp, target);
+            interp->temp_top--;
+            return;
+        }
+        case AST_CALL: {
+            if (node->call.builtin == BUILTIN_NONE && !node->call.method){
+                // the arguments are evaluated straight into the new frame
+                Literal callee;
+                int base = call_begin(interp, node->call.name, &callee);
+                for (int i = 0; i < node->call.count; i++){
+                    Literal arg;
+                    eval_expression(interp, node->call.args[i], &arg);
+                    stack_push(interp, arg);
+                }
+                call_end(interp, callee, base, out);
+                return;
+            }
+            int mark = interp->temp_top;
+            int first = 0;
+            if (node->call.method){
+                Literal* self = temp_push(interp);
+                eval_expression(interp, node->call.args[0], self);
+                if (self->datatype == OBJECT){
+                    // the frame takes over the object as 'self'
+                    int base = interp->stack_top;
+                    stack_push(interp, *self);
+                    interp->temp_top--;
+                    for (int i = 1; i < node->call.count; i++){
+                        Literal arg;
+                        eval_expression(interp, node->call.args[i], &arg);
+                        stack_push(interp, arg);
+                    }
+                    call_method(interp, node->call.name, node->call.site, base, out);
+                    return;
+                }
+                first = 1;
+            }
+            for (int i = first; i < node->call.count; i++){
+                eval_expression(interp, node->call.args[i], temp_push(interp));
+            }
+            call_builtin(interp, node->call.builtin, node->call.name, node->call.method,
+                         &interp->temps[mark], node->call.count, out);
+            temps_unwind(interp, mark);
+            return;
+        }
+        case AST_CACHED: {
+            CacheSlot* slot = &interp->cse_slots[node->cached.slot];
+            if (slot->valid){
+                *out = copy_literal(interp, slot->value);
+                return;
+            }
+            eval_expression(interp, node->cached.expr, out);
+            slot = &interp->cse_slots[node->cached.slot];
+            slot->value = copy_literal(interp, *out);
+            slot->valid = 1;
+            return;
+        }
+        case AST_SCOPE:
+            eval_expression(interp, node->scope.body, out);
+            cse_clear(interp, node->scope.first, node->scope.count);
+            return;
+        default: {
+            char msg[255];
+            sprintf(msg, "Unsupported operand -> %s", AST_node_name(node->type));
+            raiseError(interp, TYPE_ERROR, msg);
+            return;
+        }
+    }
+}
+
+// Runs a while loop and its else clause; the tree-walker's iteration
+// count is stored in *iterations.
+static int eval_while(Interpreter* interp, ASTNode* node, uint64_t* iterations){
+    uint64_t count = 0;
+    int result = 0;
+    if (node->construct.chunk){
+        result = tier_run(interp, node);
+        goto done;
+    }
+    ASTNode* condn = node->construct.condition;
+    Literal lit;
+    while(1){
+        eval_expression(interp, condn, &lit);
+        int truthy = is_truthy(lit);
+        release_literal(interp, &lit);
+        if(truthy) {
+            count++;
+            int flow = eval(interp, node->construct.code);
+            if(flow){
+                if (flow == FLOW_RETURN) result = flow;
+                break;
+            }
+            if(tier_back_edge(interp, node)){
+                result = tier_run(interp, node);
+                break;
+            }
+        }else{
+            result = eval(interp, node->construct.next);
+            break;
+        }
+    }
+    done:
+        *iterations = count;
+        return result;
+}
+
+static void set_counter(Interpreter* interp, ASTNode* node, int value){
+    if (node->construct.slot >= 0) set_int_local(interp, node->construct.slot, value);
+    else set_int_variable(interp, node->construct.name, value);
+}
+
+// Runs a for loop and its else clause. The counter lives in a C int; the
+// variable is written on every iteration only if the body uses it, and
+// otherwise once, when the loop is left.
+static int eval_for(Interpreter* interp, ASTNode* node, uint64_t* iterations){
+    uint64_t count = 0;
+    int result = 0;
+    if (node->construct.chunk){
+        result = tier_run(interp, node);
+        goto done;
+    }
+    ASTNode* range = node->construct.condition;
+    int mark = interp->temp_top;
+    for (int i = 0; i < range->call.count; i++){
+        eval_expression(interp, range->call.args[i], temp_push(interp));
+    }
+    int bounds[3];
+    range_bounds(interp, &interp->temps[mark], range->call.count, bounds);
+    temps_unwind(interp, mark);
+
+    ASTNode* body = node->construct.code;
+    if (node->construct.reads < 0 && !body->block.lazy) node->construct.reads = uses_variable(body, node->construct.name);
+    int reads = node->construct.reads != 0;
+    int i = bounds[0], stop = bounds[1], step = bounds[2];
+    if (step > 0 ? i >= stop : i <= stop){
+        result = eval(interp, node->construct.next);
+        goto done;
+    }
+    while(1){
+        if (reads) set_counter(interp, node, i);
+        count++;
+        int flow = eval(interp, body);
+        if (flow == FLOW_RETURN){
+            result = flow;
+            goto done;
+        }
+        if (flow) break;
+        if(tier_back_edge(interp, node)){
+            result = tier_resume(interp, node, i, stop, step);
+            goto done;
+        }
+        long long next = (long long)i + step;
+        if (step > 0 ? next >= stop : next <= stop){
+            if (!reads) set_counter(interp, node, i);
+            result = eval(interp, node->construct.next);
+            goto done;
+        }
+        i = (int)next;
+    }
+    if (!reads) set_counter(interp, node, i); // left by 'break'
+    done:
+        *iterations = count;
+        return result;
 }
 
-int eval(ASTNode* node) {
+// Stores value to the variable or, inside a function, the local slot.
+static inline void assign(Interpreter* interp, ASTNode* node, Literal value){
+    if (node->assign.slot >= 0) set_local(interp, node->assign.slot, value);
+    else set_variable(interp, node->assign.name, value);
+}
+
+int eval(Interpreter* interp, ASTNode* node) {
     if (node != NULL){
         switch (node->type) {
             case AST_NUMERIC:
             case AST_FLOATING_POINT:
             case AST_STRING:
             case AST_BOOLEAN:
-                print_literal(node->literal);
+                fprint_literal(interp->out, node->literal);
                 break;
 
             case AST_NONE:
@@ -274,85 +668,129 @@ int eval(ASTNode* node) {
                 break;
 
             case AST_BREAK:
-                return 1;
+                return FLOW_BREAK;
+
+            case AST_RETURN: {
+                Literal value;
+                value.datatype = NONE;
+                value.owns_str = 0;
+                if (node->ret.value) eval_expression(interp, node->ret.value, &value);
+                interp->returned = value;
+                return FLOW_RETURN;
+            }
 
-            case AST_IDENTIFIER:{
-                Literal lit = get_variable(node->name);
-                if (lit.datatype != ERROR) print_literal(lit);
+            case AST_DEF: {
+                Literal value;
+                value.datatype = FUNCTION;
+                value.owns_str = 0;
+                value.function = node->function;
+                set_variable(interp, node->function->name, value);
                 break;
             }
 
+            case AST_CLASS: {
+                Literal value;
+                value.datatype = CLASS;
+                value.owns_str = 1;
+                value.cls = class_new(interp, node);
+                set_variable(interp, node->classdef.name, value);
+                release_literal(interp, &value);
+                break;
+            }
+
+            case AST_LOCAL:
+                fprint_literal(interp->out, get_local(interp, node->local.slot, node->local.name));
+                break;
+
+            case AST_IDENTIFIER:
+                fprint_literal(interp->out, get_variable(interp, node->name));
+                break;
+
             case AST_PRINT:
-                eval(node->print.value); break;
+                eval(interp, node->print.value); break;
 
             case AST_BLOCK:
+                if (node->block.lazy) parse_lazy_block(interp, node);
                 for(int i = 0; i < node->block.count; i++){
-                    if(eval(node->block.statements[i])) return 1;
+                    int flow = eval_statement(interp, node->block.statements[i]);
+                    if(flow) return flow;
                 }
                 break;
 
             case AST_IF:
             case AST_ELIF:{
-                ASTNode* condn = node->construct.condition;
                 Literal lit;
-                if (condn->type == AST_OPERATOR){
-                    ASTNode* temp = operate(condn);
-                    if (!temp) break;
-                    lit = copy_literal(temp->literal);
-                    ast_free(temp);
-                } else if (condn->type == AST_IDENTIFIER){
-                    lit = get_variable(condn->name);
-                } else {
-                    lit = copy_literal(condn->literal);
-                }
-                if (is_truthy(lit)){
-                    if(eval(node->construct.code)) return 1;
-                } else {
-                    if(eval(node->construct.next)) return 1;
-                }
-                if(lit.owns_str) free(lit.string);
-                break;
+                eval_expression(interp, node->construct.condition, &lit);
+                int truthy = is_truthy(lit);
+                release_literal(interp, &lit);
+                return eval(interp, truthy ? node->construct.code : node->construct.next);
             }
 
             case AST_ELSE:
-                if(eval(node->construct.code)) return 1;    
-                break;
+                return eval(interp, node->construct.code);
             
             case AST_WHILE:{
-                ASTNode* condn = node->construct.condition;
+                uint64_t iterations;
+                if (!tracing) return eval_while(interp, node, &iterations);
+                uint64_t start = timer_ns();
+                uint64_t back_edges = interp->tier_stats.back_edges;
+                int result = eval_while(interp, node, &iterations);
+                trace_event("while", "loop", start, timer_ns(), node->line, iterations, interp->tier_stats.back_edges - back_edges);
+                return result;
+            }
+
+            case AST_FOR:{
+                uint64_t iterations;
+                if (!tracing) return eval_for(interp, node, &iterations);
+                uint64_t start = timer_ns();
+                uint64_t back_edges = interp->tier_stats.back_edges;
+                int result = eval_for(interp, node, &iterations);
+                trace_event("for", "loop", start, timer_ns(), node->line, iterations, interp->tier_stats.back_edges - back_edges);
+                return result;
+            }
+
+            case AST_OPERATOR:
+            case AST_CACHED:
+            case AST_LIST:
+            case AST_DICT:
+            case AST_INDEX:
+            case AST_ATTR:
+            case AST_CALL: {
                 Literal lit;
-                while(1){
-                    if (condn->type == AST_OPERATOR){
-                        ASTNode* temp = operate(condn);
-                        if (!temp) break;
-                        lit = copy_literal(temp->literal);
-                        ast_free(temp);
-                    } else if (condn->type == AST_IDENTIFIER){
-                        lit = get_variable(condn->name);
-                    } else {
-                        lit = copy_literal(condn->literal);
-                    }
-                    if(is_truthy(lit)) {
-                        if(eval(node->construct.code)) break;
-                    }else{
-                        if(eval(node->construct.next)) return 1;
-                        break;
-                    }
-                    if(lit.owns_str) free(lit.string);
-                }
-                if(lit.owns_str) free(lit.string);
+                eval_expression(interp, node, &lit);
+                fprint_literal(interp->out, lit);
+                release_literal(interp, &lit);
                 break;
             }
 
-            case AST_OPERATOR: {
-                ASTNode* temp = operate(node);
-                if (!temp) break;
-                eval(temp);
-                if(temp->literal.owns_str) free(temp->literal.string);
-                free(temp);
+            case AST_INDEX_ASSIGN: {
+                Literal* target = temp_push(interp);
+                eval_expression(interp, node->index.target, target);
+                Literal* index = temp_push(interp);
+                eval_expression(interp, node->index.index, index);
+                Literal* value = temp_push(interp);
+                eval_expression(interp, node->index.value, value);
+                index_assign(interp, node->index.op, *target, *index, *value);
+                temps_unwind(interp, interp->temp_top - 3);
                 break;
             }
 
+            case AST_ATTR_ASSIGN: {
+                Literal* target = temp_push(interp);
+                eval_expression(interp, node->attr.object, target);
+                Literal* value = temp_push(interp);
+                eval_expression(interp, node->attr.value, value);
+                attr_set(interp, node->attr.op, *target, node->attr.name, node->attr.site, *value);
+                temps_unwind(interp, interp->temp_top - 2);
+                break;
+            }
+
+            case AST_SCOPE: {
+                int result = eval(interp, node->scope.body);
+                cse_clear(interp, node->scope.first, node->scope.count);
+                return result;
+            }
+
             case AST_ASSIGNMENT:{
                 ASTNode* sub_node = node->assign.value;
                 switch (sub_node->type) {
@@ -361,29 +799,32 @@ int eval(ASTNode* node) {
                     case AST_FLOATING_POINT:
                     case AST_STRING:
                     case AST_BOOLEAN:
-                        set_variable(node->assign.name, sub_node->literal);
+                        assign(interp, node, sub_node->literal);
                         break;
                 
                     case AST_OPERATOR:
-                        ASTNode* temp1 = operate(sub_node);
-                        if(!temp1)break;
-                        ASTNode* temp2 = malloc(sizeof(ASTNode));
-                        temp2->type = AST_ASSIGNMENT;
-                        temp2->assign.name=node->assign.name;
-                        temp2->assign.value = temp1;
-                        eval(temp2);
-                        if(temp1->literal.datatype == STRING) free(temp1->literal.string);
-                        free(temp1);
-                        if(temp2->literal.datatype == STRING) free(temp2->literal.string);
-                        free(temp2);
+                    case AST_CACHED:
+                    case AST_SCOPE:
+                    case AST_LIST:
+                    case AST_DICT:
+                    case AST_INDEX:
+                    case AST_ATTR:
+                    case AST_CALL: {
+                        Literal result;
+                        eval_expression(interp, sub_node, &result);
+                        assign(interp, node, result);
+                        release_literal(interp, &result);
                         break;
+                    }
                     case AST_IDENTIFIER:
-                        Literal lit = get_variable(sub_node->name);
-                        if (lit.datatype != ERROR) set_variable(node->assign.name, lit);
+                        assign(interp, node, get_variable(interp, sub_node->name));
+                        break;
+                    case AST_LOCAL:
+                        assign(interp, node, get_local(interp, sub_node->local.slot, sub_node->local.name));
                         break;
                     default:
                         printf("%s node\n", AST_node_name(sub_node->type));
-                        raiseError(ASSIGNMENT_ERROR, "Unsupported assignment type");
+                        raiseError(interp, ASSIGNMENT_ERROR, "Unsupported assignment type");
                         break;
                 }
                 break;
@@ -391,4 +832,36 @@ int eval(ASTNode* node) {
         }
     }
     return 0;
-}
\ No newline at end of file
+}
+
+// Runs one statement, recording its line for error locations and, with
+// --profile, for the SIGPROF handler. The start of a statement is a safe
+// point for the cycle collector and for publishing --stats-fd counters.
+int eval_statement(Interpreter* interp, ASTNode* node) {
+    interp->stats.statements++;
+    heap_safe_point(interp);
+    stats_safe_point(interp);
+    int line = interp->error_line;
+    interp->error_line = node->line;
+    int result;
+    if (!profiling){
+        result = eval(interp, node);
+    }else{
+        int depth = profile_push(node->line);
+        result = eval(interp, node);
+        profile_depth = depth;
+    }
+    interp->error_line = line;
+    return result;
+}
+
+// Runs a top-level statement inside an error frame. Returns 0 if it raised
+// an error; the frame has already released its temporaries.
+int eval_toplevel(Interpreter* interp, ASTNode* node) {
+    ErrorFrame frame;
+    error_push(interp, &frame);
+    if (setjmp(frame.env)) return 0;
+    eval_statement(interp, node);
+    error_pop(interp, &frame);
+    return 1;
+}
@@ -2,7 +2,31 @@
 #ifndef INTERPRETER_H
 #define INTERPRETER_H
 
+#include <stdio.h>
+
+typedef struct Interpreter Interpreter;
+
 void print_literal(Literal lit);
-int eval(ASTNode* node);
+void fprint_value(FILE* out, Literal lit);
+void fprint_literal(FILE* out, Literal lit); // print statements go to interp->out
+const char* datatype_name(DataType type);
+int is_truthy(Literal val);
+int values_equal(Literal a, Literal b);
+void binary_op(Interpreter* interp, char op, Literal left_val, Literal right_val, Literal* out);
+void eval_expression(Interpreter* interp, ASTNode* node, Literal* out);
+void index_get(Interpreter* interp, Literal target, Literal index, Literal* out);
+void index_assign(Interpreter* interp, char op, Literal target, Literal index, Literal value);
+void range_bounds(Interpreter* interp, const Literal* args, int count, int* bounds);
+void call_builtin(Interpreter* interp, Builtin builtin, const char* name, int method, Literal* args, int count, Literal* out);
+// What eval() returns: how control leaves the statement.
+enum {
+    FLOW_NEXT,
+    FLOW_BREAK,
+    FLOW_RETURN, // the value is in interp->returned
+};
+
+int eval(Interpreter* interp, ASTNode* node);
+int eval_statement(Interpreter* interp, ASTNode* node);
+int eval_toplevel(Interpreter* interp, ASTNode* node);
 
-#endif
\ No newline at end of file
+#endif
@@ -3,37 +3,65 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "lexer.h"
 #include "error_handling.h"
-// #include "debug_alloc.h"
+#include "context.h"
+#include "stats.h"
+#include "hooks.h"
+#include "scan.h"
+#include "debug_alloc.h"
 
 #define MAX_TOKENS 1000
 
-Token* tokens;
-int token_count = 0;
+const char* keywords[] = {"exit","print","if","elif","else","True",
+                        "False","None","debug","and","or","not","pass",
+                        "while","for","break","in","def","return","class"}; 
+const int num_keywords = sizeof(keywords) / sizeof(keywords[0]);
 
-extern int error;
-extern int debug;
-extern int current;
+int debug = 0;
+int lex_jobs = 1;
 
-extern char *keywords[];
-extern const int num_keywords;
+// Lines lexed ahead must look exactly as if tokenize() had run when the
+// parser reached them, so a line whose lexing has side effects (an error
+// message, 'debug N') is skipped and lexed then instead.
+static void lex_error(Interpreter* interp, ErrorType type, char* msg){
+    if (interp->lexing_ahead){
+        interp->error = 1;
+        return;
+    }
+    raiseError(interp, type, msg);
+}
 
+const unsigned char char_class[256] = {
+    ['\t'] = CC_SPACE, ['\n'] = CC_SPACE, ['\v'] = CC_SPACE,
+    ['\f'] = CC_SPACE, ['\r'] = CC_SPACE, [' '] = CC_SPACE,
+    ['0' ... '9'] = CC_DIGIT,
+    ['A' ... 'Z'] = CC_ALPHA, ['a' ... 'z'] = CC_ALPHA, ['_'] = CC_ALPHA,
+};
+
+// Callers only pass lengths within s
 char* strndup(const char* s, size_t n) {
     char* out = malloc(n + 1);
     if (!out) return NULL;
-    strncpy(out, s, n);
+    memcpy(out, s, n);
     out[n] = '\0';
     return out;
 }
 
-char* process_str(const char* s, size_t len, int size){
+char* process_str(Interpreter* interp, const char* s, size_t len, int size){
     char* out = malloc(size + 1);
     if (!out) return NULL;
     char* p = out;
     const char* end = s + len;
     while (s < end) {
-        if (*s == '\\' && s + 1 < end) {
+        const char* run = scan_string(s, end, '\\');
+        memcpy(p, s, run - s);
+        p += run - s;
+        s = run;
+        if (s == end) break;
+        if (s + 1 < end) {
             s++;
             switch (*s) {
                 case 'n':  *p++ = '\n'; break;
@@ -45,7 +73,8 @@ char* process_str(const char* s, size_t len, int size){
                 default:
                     char msg[255];
                     sprintf(msg,"Invalid escape sequence ->\'\\%c\'",*s);
-                    raiseError(LITERAL_ERROR,msg);
+                    free(out);
+                    lex_error(interp, LITERAL_ERROR,msg);
                     return NULL;
             }
             s++;
@@ -54,42 +83,38 @@ char* process_str(const char* s, size_t len, int size){
             *p++ = *s++;
         }
     }
+    *p = '\0';
     return out;
 }
 
-int is_keyword(const char* str) {
+static int word_is(const char* start, int len, const char* word) {
+    return strncmp(start, word, len) == 0 && word[len] == '\0';
+}
+
+int is_keyword(const char* start, int len) {
     for (int i = 0; i < num_keywords; i++) {
-        if (strcmp(str, keywords[i]) == 0) {
+        if (word_is(start, len, keywords[i])) {
             return 1;
         }
     }
     return 0;
 }
 
-int is_bool(const char* str) {
-    if (strcmp(str, "True") == 0 || strcmp(str, "False") == 0) {
-        return 1;
-    }
-    return 0;
+int is_bool(const char* start, int len) {
+    return word_is(start, len, "True") || word_is(start, len, "False");
 }
 
-int is_andor(const char* str) {
-    if (strcmp(str, "and") == 0 || strcmp(str, "or") == 0) {
-        return 1;
-    }
-    return 0;
+int is_andor(const char* start, int len) {
+    return word_is(start, len, "and") || word_is(start, len, "or");
 }
 
-int is_none(const char* str) {
-    if (strcmp(str, "None") == 0) {
-        return 1;
-    }
-    return 0;
+int is_none(const char* start, int len) {
+    return word_is(start, len, "None");
 }
 
-void print_tokens_debug(){
-    for (int i = 0; i < token_count; i++) {
-        printf("%s(%s)\n", token_name(tokens[i].type), tokens[i].text);
+void print_tokens_debug(FILE* out, Token* tokens, int count){
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "%s(%s)\n", token_name(tokens[i].type), tokens[i].text);
     }
 }
 
@@ -106,151 +131,208 @@ const char* token_name(TokenType type) {
         case TOKEN_RPAREN: return "R_PAREN";
         case TOKEN_BRACE_OPEN: return "L_BRACE";
         case TOKEN_BRACE_CLOSE: return "R_BRACE";
+        case TOKEN_BRACKET_OPEN: return "L_BRACKET";
+        case TOKEN_BRACKET_CLOSE: return "R_BRACKET";
         case TOKEN_KEYWORD: return "KEYWORD";
         case TOKEN_EOF: return "EOF";
         case TOKEN_INDENT: return "INDENT";
         case TOKEN_SEMICOLON: return "SEMI_COLON";
         case TOKEN_COLON: return "COLON";
+        case TOKEN_COMMA: return "COMMA";
+        case TOKEN_DOT: return "DOT";
         default: return "UNKNOWN";
     }
 }
 
-void add_token(TokenType type, const char* start, int length) {
-    Token* tok = &tokens[token_count++];
+// Takes ownership of text
+static void add_token_text(Interpreter* interp, TokenType type, char* text) {
+    Token* tok = &interp->tokens[interp->token_count++];
+    interp->stats.tokens++;
     tok->type = type;
-    tok->text = strndup(start, length);
+    tok->text = text;
+}
+
+void add_token(Interpreter* interp, TokenType type, const char* start, int length) {
+    add_token_text(interp, type, strndup(start, length));
+}
+
+void allocate_tokens(Interpreter* interp){
+    interp->tokens = malloc(sizeof(Token) * MAX_TOKENS);
 }
 
-void allocate_tokens(){
-    tokens = malloc(sizeof(Token) * MAX_TOKENS);
+void reset_tokens(Interpreter* interp) {
+    for (int i = 0; i < interp->token_count; i++) {
+        free(interp->tokens[i].text);
+        interp->tokens[i].text = NULL;
+    }
+    free(interp->tokens);
+    interp->tokens = NULL;
+    interp->token_count = 0;
+    interp->error = 0;
+    interp->current = 0;
 }
 
-void reset_tokens() {
-    for (int i = 0; i < token_count; i++) {
-        free(tokens[i].text);
-        tokens[i].text = NULL;
+// Number of INDENT tokens tokenize() would emit for the start of a line.
+int count_indent(const char* src) {
+    int indent = 0, spaces = 0;
+    for (const char* p = src; *p; p++) {
+        if (*p == '\t') {
+            indent++;
+        } else if (is_class(*p, CC_SPACE)) {
+            if (++spaces == 4) {
+                spaces = 0;
+                indent++;
+            }
+        } else {
+            break;
+        }
     }
-    free(tokens);
-    tokens = NULL;
-    token_count = 0;
-    error = 0;
-    current = 0;
+    return indent;
+}
+
+static int follows_operand(Interpreter* interp){
+    if (interp->token_count == 0) return 0;
+    TokenType prev = interp->tokens[interp->token_count - 1].type;
+    return prev == TOKEN_IDENTIFIER || prev == TOKEN_STRING || prev == TOKEN_RPAREN ||
+           prev == TOKEN_BRACKET_CLOSE || prev == TOKEN_BRACE_CLOSE;
 }
 
-void tokenize(const char* src) {
+void tokenize(Interpreter* interp, const char* src) {
     const char* p = src;
+    const char* end = src + strlen(src);
     int spaces = 0;
 
     while (*p) {
         if(*p == '\t'){
-            add_token(TOKEN_INDENT,"",0);
+            add_token(interp, TOKEN_INDENT,"",0);
             p++; continue;
         }
 
-        if (isspace(*p)) {
+        if (*p == ' ') {
+            // every fourth space in a row is an INDENT
+            const char* run = scan_spaces(p, end);
+            spaces += run - p;
+            p = run;
+            for (; spaces >= 4; spaces -= 4) add_token(interp, TOKEN_INDENT,"",0);
+            continue;
+        }
+
+        if (is_class(*p, CC_SPACE)) {
             spaces++;
             if (spaces == 4){
                 spaces = 0;
-                add_token(TOKEN_INDENT,"",0);
+                add_token(interp, TOKEN_INDENT,"",0);
             }
             p++; continue;
         }
 
         spaces = 0;
 
-        if (isalpha(*p) || *p == '_') {
+        if (is_class(*p, CC_ALPHA)) {
             const char* start = p;
-            while (isalnum(*p) || *p == '_') p++;
+            p = scan_ident(p, end);
             int len = p - start;
-            char* str = strndup(start, len);
-            if (is_keyword(str)) {
-                if (is_bool(str)){
-                    add_token(TOKEN_BOOLEAN, start, len);
-                }else if (is_none(str)){
-                    add_token(TOKEN_NONE, start, len);
-                }else if (is_andor(str)){
-                    char* op = (strcmp(str, "and") == 0) ? "&" : "|";
-                    add_token(TOKEN_OPERATOR, op, 1);
-                }else if (strcmp(str, "not") == 0){
-                    add_token(TOKEN_OPERATOR, "!", 1);
-                }else if(strcasecmp(str,"debug") == 0){
+            if (is_keyword(start, len)) {
+                if (is_bool(start, len)){
+                    add_token(interp, TOKEN_BOOLEAN, start, len);
+                }else if (is_none(start, len)){
+                    add_token(interp, TOKEN_NONE, start, len);
+                }else if (is_andor(start, len)){
+                    char* op = word_is(start, len, "and") ? "&" : "|";
+                    add_token(interp, TOKEN_OPERATOR, op, 1);
+                }else if (word_is(start, len, "not")){
+                    add_token(interp, TOKEN_OPERATOR, "!", 1);
+                }else if (word_is(start, len, "in")){
+                    add_token(interp, TOKEN_OPERATOR, "i", 1);
+                }else if(word_is(start, len, "debug")){
+                    if (interp->lexing_ahead){
+                        interp->error = 1;
+                        break;
+                    }
                     p++;
                     switch (*p){
-                    case '1': debug = 1; break;
-                    case '0': debug = 0; break;
+                    case '2': debug_set(2); break;
+                    case '1': debug_set(1); break;
+                    case '0': debug_set(0); break;
                     default:    
-                        raiseError(SYNTAX_ERROR, "Improper command parameters");
+                        lex_error(interp, SYNTAX_ERROR, "Improper command parameters");
                         break;
                     }    
                     break;
                 }else{
-                    add_token(TOKEN_KEYWORD, start, len);
+                    add_token(interp, TOKEN_KEYWORD, start, len);
                 }
             } else {
-                add_token(TOKEN_IDENTIFIER, start, len);
+                add_token(interp, TOKEN_IDENTIFIER, start, len);
             }
-            free(str);
             continue;
         }
 
-        if (isdigit(*p) || *p == '.') {
+        if (*p == '.' && !is_class(p[1], CC_DIGIT) && follows_operand(interp)) {
+            add_token(interp, TOKEN_DOT, p, 1); // a.append(...)
+            p++; continue;
+        }
+
+        if (is_class(*p, CC_DIGIT) || *p == '.') {
             const char* start = p;
             int fp = 0;
             if (*p == '.') {
                 fp++;
                 p++;
-                if (!isdigit(*p)) {
-                    raiseError(VALUE_ERROR, "Improper floating point literal (dot not followed by digit)");
+                if (!is_class(*p, CC_DIGIT)) {
+                    lex_error(interp, VALUE_ERROR, "Improper floating point literal (dot not followed by digit)");
                     break;
                 }
-                while (isdigit(*p) || *p == '.'){ 
-                    p++;
-                    if (*p == '.') fp++;
-                }
-            } else {
-                while (isdigit(*p) || *p == '.'){ 
-                    p++;
-                    if (*p == '.') fp++;
-                }
+            }
+            p = scan_digits(p, end);
+            while (*p == '.') {
+                fp++;
+                p = scan_digits(p + 1, end);
             }
         
             if (fp > 1) {
-                raiseError(VALUE_ERROR, "Improper floating point literal (multiple dots)");
+                lex_error(interp, VALUE_ERROR, "Improper floating point literal (multiple dots)");
                 break;
             }
         
             if (fp == 1) {
-                add_token(TOKEN_FLOATING_POINT, start, p - start);
+                add_token(interp, TOKEN_FLOATING_POINT, start, p - start);
             } else {
-                add_token(TOKEN_NUMERIC, start, p - start);
+                add_token(interp, TOKEN_NUMERIC, start, p - start);
             }
             continue;
         }
         
         if (*p == '\"' || *p == '\'') {
             int chr = 0;
+            int escapes = 0;
             char quote_type = *p;           // Either ' or "
             const char* start = p + 1;      // Skip opening quote
             p++;
             
             // Go until we find the matching quote or end of string
-            while (*p && *p != quote_type) {
-                if (*p == '\\' && *(p+1)) { // Handle escaped characters
-                    p += 2; // skip \"
-                } else {
-                    p++;
-                }
+            while (1) {
+                const char* run = scan_string(p, end, quote_type);
+                chr += run - p;
+                p = run;
+                if (*p != '\\') break;
+                escapes = 1;
+                p += p[1] ? 2 : 1; // an escape is one character of the value
                 chr++;
             }
         
             if (*p == quote_type) {
-                const char* str = process_str(start, p - start, chr);
-                if (!str) break;
-                add_token(TOKEN_STRING, str, chr);
+                if (!escapes) {
+                    add_token(interp, TOKEN_STRING, start, chr);
+                } else {
+                    char* str = process_str(interp, start, p - start, chr);
+                    if (!str) break;
+                    add_token_text(interp, TOKEN_STRING, str);
+                }
                 p++; // Skip closing quote
                 continue;
             } else {
-                raiseError(LITERAL_ERROR,"Unterminated string literal");
+                lex_error(interp, LITERAL_ERROR,"Unterminated string literal");
                 break;
             }
         }
@@ -259,85 +341,219 @@ void tokenize(const char* src) {
             case '=': 
                 if(*(p+1) == '='){
                     char *op = "e";
-                    add_token(TOKEN_OPERATOR, op, 1);
+                    add_token(interp, TOKEN_OPERATOR, op, 1);
                     p++;
                 }else{
-                    add_token(TOKEN_ASSIGN, p, 1); 
+                    add_token(interp, TOKEN_ASSIGN, p, 1); 
                 }
                 break;
             case '!': 
                 if(*(p+1) == '='){
                     char *op = "n";
-                    add_token(TOKEN_OPERATOR, op, 1);
+                    add_token(interp, TOKEN_OPERATOR, op, 1);
                     p++;
                 }else{
-                    add_token(TOKEN_UNKNOWN, p, 1); 
-                    raiseError(SYNTAX_ERROR, "Improper token used");
+                    add_token(interp, TOKEN_UNKNOWN, p, 1); 
+                    lex_error(interp, SYNTAX_ERROR, "Improper token used");
                 }
                 break;
             case '>': 
                 if(*(p+1) == '='){
                     char *op = "g";
-                    add_token(TOKEN_OPERATOR, op, 1);
+                    add_token(interp, TOKEN_OPERATOR, op, 1);
                     p++;
                 }else{
-                    add_token(TOKEN_OPERATOR, p, 1); 
+                    add_token(interp, TOKEN_OPERATOR, p, 1); 
                 }
                 break;
             case '<': 
                 if(*(p+1) == '='){
                     char *op = "l";
-                    add_token(TOKEN_OPERATOR, op, 1);
+                    add_token(interp, TOKEN_OPERATOR, op, 1);
                     p++;
                 }else{
-                    add_token(TOKEN_OPERATOR, p, 1); 
+                    add_token(interp, TOKEN_OPERATOR, p, 1); 
                 }
                 break;
             case '+': 
                 if(*(p+1) == '='){
-                    add_token(TOKEN_ASSIGN, p, 1);
+                    add_token(interp, TOKEN_ASSIGN, p, 1);
                     p++;
                 }else{
-                    add_token(TOKEN_OPERATOR, p, 1); 
+                    add_token(interp, TOKEN_OPERATOR, p, 1); 
                 }
                 break;
             case '-': 
                 if(*(p+1) == '='){
-                    add_token(TOKEN_ASSIGN, p, 1);
+                    add_token(interp, TOKEN_ASSIGN, p, 1);
                     p++;
                 }else{
-                    add_token(TOKEN_OPERATOR, p, 1); 
+                    add_token(interp, TOKEN_OPERATOR, p, 1); 
                 }
                 break;
             case '*':  
                 if(*(p+1) == '='){
-                    add_token(TOKEN_ASSIGN, p, 1);
+                    add_token(interp, TOKEN_ASSIGN, p, 1);
                     p++;
                 }else{
-                    add_token(TOKEN_OPERATOR, p, 1); 
+                    add_token(interp, TOKEN_OPERATOR, p, 1); 
                 }
                 break;
             case '/':  
                 if(*(p+1) == '='){
-                    add_token(TOKEN_ASSIGN, p, 1);
+                    add_token(interp, TOKEN_ASSIGN, p, 1);
                     p++;
                 }else{
-                    add_token(TOKEN_OPERATOR, p, 1); 
+                    add_token(interp, TOKEN_OPERATOR, p, 1); 
                 }
                 break;
-            case '(': add_token(TOKEN_LPAREN, p, 1); break;
-            case ')': add_token(TOKEN_RPAREN, p, 1); break;
-            case '{': add_token(TOKEN_BRACE_OPEN, p, 1); break;
-            case '}': add_token(TOKEN_BRACE_CLOSE, p, 1); break;
-            case ';': add_token(TOKEN_SEMICOLON, p, 1); break;
-            case ':': add_token(TOKEN_COLON, p, 1); break;
+            case '(': add_token(interp, TOKEN_LPAREN, p, 1); break;
+            case ')': add_token(interp, TOKEN_RPAREN, p, 1); break;
+            case '{': add_token(interp, TOKEN_BRACE_OPEN, p, 1); break;
+            case '}': add_token(interp, TOKEN_BRACE_CLOSE, p, 1); break;
+            case '[': add_token(interp, TOKEN_BRACKET_OPEN, p, 1); break;
+            case ']': add_token(interp, TOKEN_BRACKET_CLOSE, p, 1); break;
+            case ',': add_token(interp, TOKEN_COMMA, p, 1); break;
+            case ';': add_token(interp, TOKEN_SEMICOLON, p, 1); break;
+            case ':': add_token(interp, TOKEN_COLON, p, 1); break;
             default:
-                add_token(TOKEN_UNKNOWN, p, 1); 
-                raiseError(SYNTAX_ERROR, "Improper token used");
+                add_token(interp, TOKEN_UNKNOWN, p, 1); 
+                lex_error(interp, SYNTAX_ERROR, "Improper token used");
                 break;
         }
         p++;
     }
 
-    add_token(TOKEN_EOF, "", 0);
-}
\ No newline at end of file
+    add_token(interp, TOKEN_EOF, "", 0);
+}
+// Tokens for script line index, into an empty buffer (allocate_tokens()):
+// the ones lex_lines() prepared if there are any, else tokenize() now.
+void tokenize_line(Interpreter* interp, int index){
+    LineTokens* line = interp->lexed ? &interp->lexed->lines[index] : NULL;
+    if (!line || !line->tokens){
+        tokenize(interp, interp->lines[index]);
+        return;
+    }
+    // the texts move to the buffer; a line is only handed out once
+    memcpy(interp->tokens + interp->token_count, line->tokens, sizeof(Token) * line->count);
+    interp->token_count += line->count;
+    interp->stats.tokens += line->count;
+    line->tokens = NULL;
+}
+
+typedef struct {
+    char** lines;
+    LineTokens* out;
+    int first;
+    int last;
+    Token* chunk;
+    pthread_t thread;
+} LexWorker;
+
+// Lexes lines first..last into one growing buffer. Offsets are kept until
+// the end since the buffer may move.
+static void* lex_worker(void* arg){
+    LexWorker* w = arg;
+    Interpreter* scratch = calloc(1, sizeof(Interpreter));
+    int* offsets = malloc(sizeof(int) * (w->last - w->first + 1));
+    int capacity = MAX_TOKENS * 4;
+    Token* chunk = malloc(sizeof(Token) * capacity);
+    if (!scratch || !offsets || !chunk) goto done;
+    scratch->lexing_ahead = 1;
+    for (int i = w->first; i < w->last; i++) offsets[i - w->first] = -1;
+
+    int used = 0;
+    for (int i = w->first; i < w->last; i++){
+        if (used + MAX_TOKENS > capacity){
+            capacity *= 2;
+            Token* tmp = realloc(chunk, sizeof(Token) * capacity);
+            if (!tmp) break;
+            chunk = tmp;
+        }
+        scratch->tokens = chunk + used;
+        scratch->token_count = 0;
+        scratch->error = 0;
+        tokenize(scratch, w->lines[i]);
+        if (scratch->error){
+            for (int t = 0; t < scratch->token_count; t++) free(scratch->tokens[t].text);
+            offsets[i - w->first] = -1;
+            continue;
+        }
+        offsets[i - w->first] = used;
+        w->out[i].count = scratch->token_count;
+        used += scratch->token_count;
+    }
+    for (int i = w->first; i < w->last; i++){
+        int offset = offsets[i - w->first];
+        if (offset >= 0 && w->out[i].count) w->out[i].tokens = chunk + offset;
+    }
+    w->chunk = chunk;
+    chunk = NULL;
+    done:
+        free(chunk);
+        free(offsets);
+        free(scratch);
+        return NULL;
+}
+
+// Tokenizes all lines of a script on up to jobs threads, each taking a
+// contiguous run of lines of about the same size in bytes. Lines are
+// lexed independently (strings end on their line and every line starts
+// its own indentation), so any line boundary is a valid split and the
+// result is what tokenize() gives line by line. NULL if out of memory.
+LexedLines* lex_lines(char** lines, int count, int jobs){
+    if (jobs <= 0) jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs > count / 64) jobs = count / 64; // not worth a thread below that
+    if (jobs < 1) jobs = 1;
+    LexedLines* lexed = calloc(1, sizeof(LexedLines));
+    LineTokens* out = calloc(count ? count : 1, sizeof(LineTokens));
+    LexWorker* workers = calloc(jobs, sizeof(LexWorker));
+    Token** chunks = calloc(jobs, sizeof(Token*));
+    if (!lexed || !out || !workers || !chunks){
+        free(lexed);
+        free(out);
+        free(workers);
+        free(chunks);
+        return NULL;
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < count; i++) total += strlen(lines[i]) + 1;
+    size_t bytes = 0;
+    int line = 0;
+    for (int w = 0; w < jobs; w++){
+        workers[w] = (LexWorker){ .lines = lines, .out = out, .first = line };
+        size_t target = total * (w + 1) / jobs;
+        while (line < count && (bytes < target || w == jobs - 1)) bytes += strlen(lines[line++]) + 1;
+        workers[w].last = line;
+    }
+
+    int started = 0;
+    for (int w = 1; w < jobs; w++){
+        if (pthread_create(&workers[w].thread, NULL, lex_worker, &workers[w]) != 0) break;
+        started = w;
+    }
+    lex_worker(&workers[0]);
+    for (int w = 1; w <= started; w++) pthread_join(workers[w].thread, NULL);
+    // a worker that failed leaves its lines to tokenize()
+    for (int w = 0; w < jobs; w++) chunks[w] = workers[w].chunk;
+    free(workers);
+
+    lexed->lines = out;
+    lexed->count = count;
+    lexed->chunks = chunks;
+    lexed->chunk_count = jobs;
+    return lexed;
+}
+
+void free_lexed_lines(LexedLines* lexed){
+    if (!lexed) return;
+    for (int i = 0; i < lexed->count; i++){
+        LineTokens* line = &lexed->lines[i];
+        for (int t = 0; line->tokens && t < line->count; t++) free(line->tokens[t].text);
+    }
+    for (int c = 0; c < lexed->chunk_count; c++) free(lexed->chunks[c]);
+    free(lexed->chunks);
+    free(lexed->lines);
+    free(lexed);
+}
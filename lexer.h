@@ -19,10 +19,14 @@ typedef enum {
     TOKEN_RPAREN,
     TOKEN_BRACE_OPEN,
     TOKEN_BRACE_CLOSE,
+    TOKEN_BRACKET_OPEN,
+    TOKEN_BRACKET_CLOSE,
     //
     TOKEN_ASSIGN,
     TOKEN_COLON,
     TOKEN_SEMICOLON,
+    TOKEN_COMMA,
+    TOKEN_DOT,
     TOKEN_UNKNOWN
 } TokenType;
 
@@ -31,18 +35,41 @@ typedef struct {
     char* text;
 } Token;
 
+typedef struct Interpreter Interpreter;
+
+// Tokens of one script line, prepared ahead by lex_lines()
+typedef struct {
+    Token* tokens; // NULL: left for tokenize() (errors, 'debug N')
+    int count;
+} LineTokens;
+
+typedef struct {
+    LineTokens* lines;
+    int count;
+    Token** chunks; // one buffer per worker; the lines point into them
+    int chunk_count;
+} LexedLines;
+
+extern int lex_jobs; // --lex-jobs=N: threads lex_lines() may use, 0 = one per core
+
 char* strndup(const char* s, size_t n);
 
-void print_tokens_debug();
+void print_tokens_debug(FILE* out, Token* tokens, int count);
 
-void add_token(TokenType type, const char* start, int length);
+void add_token(Interpreter* interp, TokenType type, const char* start, int length);
 
-void allocate_tokens();
+void allocate_tokens(Interpreter* interp);
 
-void reset_tokens();
+void reset_tokens(Interpreter* interp);
 
 const char* token_name(TokenType type);
 
-void tokenize(const char* src);
+int count_indent(const char* src);
+
+void tokenize(Interpreter* interp, const char* src);
+void tokenize_line(Interpreter* interp, int index);
+
+LexedLines* lex_lines(char** lines, int count, int jobs);
+void free_lexed_lines(LexedLines* lexed);
 
 #endif
\ No newline at end of file
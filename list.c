@@ -0,0 +1,187 @@
+// list.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lexer.h"
+#include "ast.h"
+#include "list.h"
+#include "memory.h"
+#include "interpreter.h"
+#include "error_handling.h"
+#include "context.h"
+#include "debug_alloc.h"
+
+static ListKind kind_of(Literal value){
+    switch (value.datatype){
+        case INT: return LIST_INT;
+        case FLOAT: return LIST_FLOAT;
+        case BOOLEAN: return LIST_BOOL;
+        default: return LIST_BOXED;
+    }
+}
+
+static size_t element_size(ListKind kind){
+    switch (kind){
+        case LIST_INT: return sizeof(int);
+        case LIST_FLOAT: return sizeof(float);
+        case LIST_BOOL: return sizeof(unsigned char);
+        default: return sizeof(Literal);
+    }
+}
+
+// Element i, borrowed: a boxed string or list still belongs to the list.
+static inline Literal element(List* list, int i){
+    Literal lit;
+    lit.owns_str = 0;
+    switch (list->kind){
+        case LIST_INT: lit.datatype = INT; lit.numeric = list->ints[i]; break;
+        case LIST_FLOAT: lit.datatype = FLOAT; lit.floating_point = list->floats[i]; break;
+        case LIST_BOOL: lit.datatype = BOOLEAN; lit.boolean = list->bools[i]; break;
+        default: lit = list->items[i]; lit.owns_str = 0; break;
+    }
+    return lit;
+}
+
+// Stores a copy of value, whose type already matches the storage.
+static inline void put(Interpreter* interp, List* list, int i, Literal value){
+    switch (list->kind){
+        case LIST_INT: list->ints[i] = value.numeric; break;
+        case LIST_FLOAT: list->floats[i] = value.floating_point; break;
+        case LIST_BOOL: list->bools[i] = value.boolean != 0; break;
+        default: list->items[i] = heap_store(interp, &list->head, value); break;
+    }
+}
+
+// Room for at least needed elements, doubling so appends are amortized O(1).
+static int reserve(Interpreter* interp, List* list, int needed){
+    if (needed <= list->capacity) return 1;
+    int capacity = list->capacity ? list->capacity * 2 : 8;
+    if (capacity < needed) capacity = needed;
+    void* tmp = heap_buffer(interp, &list->head, list->data, element_size(list->kind) * capacity);
+    if (!tmp) return 0;
+    list->data = tmp;
+    list->capacity = capacity;
+    return 1;
+}
+
+static int box(Interpreter* interp, List* list){
+    int capacity = list->capacity > list->count ? list->capacity : list->count + 1;
+    Literal* items = heap_buffer(interp, &list->head, NULL, sizeof(Literal) * capacity);
+    if (!items) return 0;
+    for (int i = 0; i < list->count; i++) items[i] = element(list, i);
+    heap_buffer_free(&list->head, list->data);
+    list->items = items;
+    list->capacity = capacity;
+    list->kind = LIST_BOXED;
+    return 1;
+}
+
+// Makes room for a value of the given kind, boxing the list if needed.
+static int accept(Interpreter* interp, List* list, ListKind kind){
+    if (kind == list->kind || list->kind == LIST_BOXED) return 1;
+    if (list->count == 0){
+        // still empty: take the type of the first element
+        heap_buffer_free(&list->head, list->data);
+        list->data = NULL;
+        list->capacity = 0;
+        list->kind = kind;
+        return 1;
+    }
+    return box(interp, list);
+}
+
+static int list_index(Interpreter* interp, List* list, Literal index){
+    int i;
+    switch (index.datatype){
+        case INT: i = index.numeric; break;
+        case BOOLEAN: i = index.boolean; break;
+        default: {
+            char msg[255];
+            sprintf(msg, "List indices must be integers, not \'%s\'", datatype_name(index.datatype));
+            raiseError(interp, TYPE_ERROR, msg);
+            return -1;
+        }
+    }
+    if (i < 0) i += list->count;
+    if ((unsigned)i >= (unsigned)list->count){
+        raiseError(interp, INDEX_ERROR, "List index out of range");
+        return -1;
+    }
+    return i;
+}
+
+// A new list holding copies of values, with one reference for the caller.
+List* list_from(Interpreter* interp, const Literal* values, int count){
+    List* list = heap_new(interp, HEAP_LIST, sizeof(List));
+    if (!list) goto out_of_memory;
+    list->kind = count > 0 ? kind_of(values[0]) : LIST_INT;
+    for (int i = 1; i < count; i++){
+        if (kind_of(values[i]) != list->kind){
+            list->kind = LIST_BOXED;
+            break;
+        }
+    }
+    if (!reserve(interp, list, count)){
+        heap_release(interp, &list->head);
+        goto out_of_memory;
+    }
+    for (int i = 0; i < count; i++) put(interp, list, i, values[i]);
+    list->count = count;
+    return list;
+
+    out_of_memory:
+        raiseError(interp, MEMORY_ERROR, "Out of memory");
+        return NULL;
+}
+
+void list_append(Interpreter* interp, List* list, Literal value){
+    if (!accept(interp, list, kind_of(value)) || !reserve(interp, list, list->count + 1)){
+        raiseError(interp, MEMORY_ERROR, "Out of memory");
+        return;
+    }
+    put(interp, list, list->count, value);
+    list->count++;
+}
+
+void list_get(Interpreter* interp, List* list, Literal index, Literal* out){
+    int i = list_index(interp, list, index);
+    Literal lit = element(list, i);
+    *out = list->kind == LIST_BOXED ? copy_literal(interp, lit) : lit;
+}
+
+void list_set(Interpreter* interp, List* list, Literal index, Literal value){
+    int i = list_index(interp, list, index);
+    if (!accept(interp, list, kind_of(value))){
+        raiseError(interp, MEMORY_ERROR, "Out of memory");
+        return;
+    }
+    if (list->kind != LIST_BOXED){
+        put(interp, list, i, value);
+        return;
+    }
+    Literal old = list->items[i];
+    put(interp, list, i, value);
+    release_literal(interp, &old);
+}
+
+int list_contains(List* list, Literal value){
+    for (int i = 0; i < list->count; i++){
+        if (values_equal(element(list, i), value)) return 1;
+    }
+    return 0;
+}
+
+void fprint_list(FILE* out, List* list){
+    if (list->printing){
+        fputs("[...]", out);
+        return;
+    }
+    list->printing = 1;
+    fputc('[', out);
+    for (int i = 0; i < list->count; i++){
+        if (i > 0) fputs(", ", out);
+        fprint_value(out, element(list, i));
+    }
+    fputc(']', out);
+    list->printing = 0;
+}
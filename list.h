@@ -0,0 +1,44 @@
+// list.h
+#ifndef LIST_H
+#define LIST_H
+
+#include <stdio.h>
+#include "memory.h"
+#include "heap.h"
+
+// Element storage. A list stays an unboxed array while every element has
+// the same type; the first element of another type boxes it for good.
+typedef enum {
+    LIST_INT,
+    LIST_FLOAT,
+    LIST_BOOL,
+    LIST_BOXED,
+} ListKind;
+
+// Lists are shared by reference and counted (heap.h).
+typedef struct List {
+    Heap head;
+    ListKind kind;
+    int count;
+    int capacity;
+    int printing; // inside fprint_list(), so a cycle prints as [...]
+    union {
+        void* data;
+        int* ints;
+        float* floats;
+        unsigned char* bools;
+        Literal* items; // own their strings and list references
+    };
+} List;
+
+List* list_from(Interpreter* interp, const Literal* values, int count);
+
+void list_append(Interpreter* interp, List* list, Literal value);
+void list_get(Interpreter* interp, List* list, Literal index, Literal* out); // out is owned
+void list_set(Interpreter* interp, List* list, Literal index, Literal value);
+
+int list_contains(List* list, Literal value);
+
+void fprint_list(FILE* out, List* list);
+
+#endif
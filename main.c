@@ -9,177 +9,189 @@
 #include "interpreter.h"
 #include "colors.h"
 #include "error_handling.h"
-// #include "debug_alloc.h"
-
-#define INITIAL_LINE_CAPACITY 100
-#define MAX_LINE_LENGTH 1024
-
-extern int error;
-
-const char* keywords[] = {"exit","print","if","elif","else","True",
-                        "False","None","debug","and","or","not","pass",
-                        "while","break"}; 
-const int num_keywords = sizeof(keywords) / sizeof(keywords[0]);
-
-char **lines;
-
-int debug = 0;
-int current_line = 0;
-int script_ = 0;
-int line_count;
-
-void rstrip(char* str) {
-    int len = strlen(str);
-    while (len > 0 && isspace((unsigned char)str[len - 1])) {
-        str[--len] = '\0';
-    }
-}
-
-int interactive(){
+#include "context.h"
+#include "minipy.h"
+#include "timer.h"
+#include "tier.h"
+#include "bytecode.h"
+#include "optimize.h"
+#include "perf.h"
+#include "profile.h"
+#include "stats.h"
+#include "trace.h"
+#include "hooks.h"
+#include "batch.h"
+#include "gc.h"
+#include "debug_alloc.h"
+
+extern int debug;
+
+int interactive(Interpreter* interp){
     char input[255];
+    int line = 0;
     while (1) {
         printf(MAG ">>> " RESET);
         if (!fgets(input, sizeof input, stdin)) break;
         input[strcspn(input, "\r\n")] = '\0';
+        line++;
         
         if (strlen(input) == 0) continue;
 
-        allocate_tokens();
-        tokenize(input);
-        
-        if (debug){ printf("Tokens:\n"); print_tokens_debug();} //for debugging Tokens
-
-        if (strcasecmp(input, "exit") == 0) {
-            reset_tokens();
-            break;
-        }
-
-        if (error) goto end;
+        if (strcasecmp(input, "exit") == 0) break;
 
-        while (peek().type != TOKEN_EOF) {
-            ASTNode* root = parse_statement(NULL);
-            if (error){ ast_free(root); goto end;}
-            if (debug){ printf("\nAST:\n"); print_ast_debug(root,0,0);} //for debugging AST
-            eval(root);
-            ast_free(root);
-            if (error) goto end;
-            if (debug){ printf("\nVariables:\n"); get_variables();} //for debugging Variable Table
-        }
-        end:
-            reset_tokens();
+        minipy_run_line(interp, input, line);
     }    
     return 0;
 }
 
-char **load_lines(const char *path, int *line_count_out) {
-    FILE *file = fopen(path, "r");
-    if (!file) {
-        perror("Failed to open file");
-        return NULL;
-    }
-
-    int capacity = INITIAL_LINE_CAPACITY;
-    char **lines = malloc(capacity * sizeof(char *));
-    if (!lines) {
-        perror("Failed to allocate memory for lines");
-        fclose(file);
-        return NULL;
+int main(int argc, char *argv[]){
+    char *path = NULL;
+    char *pair_profile = NULL;
+    char *perf_report = NULL;
+    char *folded = NULL;
+    int profile = 0;
+    int show_stats = 0;
+    int stats_fd = -1;
+    int stats_interval = 1000;
+    char *trace_path = NULL;
+    char *batch = NULL;
+    int jobs = 0;
+    int generational = 0;
+    int gc_nursery = 0; // kB, 0 for the default
+    int gc_old = 0;     // MB
+    int huge_pages = 0;
+    if (getenv("MINIPY_TRACK_ALLOC")) alloc_tracking = 1;
+    Interpreter* interp = minipy_create();
+    if (!interp){
+        fprintf(stderr, "Out of memory\n");
+        return 1;
     }
-
-    char buffer[MAX_LINE_LENGTH];
-    int count = 0;
-
-    while (fgets(buffer, sizeof(buffer), file)) {
-        // Remove trailing newline if present
-        buffer[strcspn(buffer, "\r\n")] = 0;
-        rstrip(buffer);
-        if (strlen(buffer) == 0) continue; 
-        // printf("%s %d\n", buffer,strlen(buffer));
-        // Allocate memory for the line
-        lines[count] = malloc(strlen(buffer) + 1);
-        if (!lines[count]) {
-            perror("Failed to allocate memory for a line");
-            break;
-        }
-        strcpy(lines[count], buffer);
-        count++;
-
-        // Resize array if needed
-        if (count >= capacity) {
-            capacity *= 2;
-            char **new_lines = realloc(lines, capacity * sizeof(char *));
-            if (!new_lines) {
-                perror("Failed to reallocate memory for lines");
-                break;
+    for (int i = 1; i < argc; i++){
+        if (strncmp(argv[i], "--tier-threshold=", 17) == 0){
+            tier_config.loop_threshold = atoi(argv[i] + 17);
+        }else if (strcmp(argv[i], "--lazy") == 0){
+            interp->lazy_parse = 1;
+        }else if (strcmp(argv[i], "--check") == 0){
+            interp->check_only = 1;
+        }else if (strcmp(argv[i], "--no-optimize") == 0){
+            optimize_enabled = 0;
+        }else if (strcmp(argv[i], "--no-peephole") == 0){
+            peephole_enabled = 0;
+        }else if (strncmp(argv[i], "--pair-profile=", 15) == 0){
+            pair_profile = argv[i] + 15;
+            pair_profile_enabled = 1;
+        }else if (strcmp(argv[i], "--profile") == 0){
+            profile = 1;
+            folded = "profile.folded";
+        }else if (strncmp(argv[i], "--profile=", 10) == 0){
+            profile = 1;
+            folded = argv[i] + 10;
+        }else if (strcmp(argv[i], "--stats") == 0){
+            show_stats = 1;
+            stats_enabled = 1;
+        }else if (strncmp(argv[i], "--stats-fd=", 11) == 0){
+            stats_fd = atoi(argv[i] + 11);
+            stats_enabled = 1;
+        }else if (strncmp(argv[i], "--stats-interval=", 17) == 0){
+            stats_interval = atoi(argv[i] + 17);
+        }else if (strncmp(argv[i], "--trace=", 8) == 0){
+            trace_path = argv[i] + 8;
+        }else if (strcmp(argv[i], "--track-alloc") == 0){
+            alloc_tracking = 1;
+        }else if (strncmp(argv[i], "--perf-counters=", 16) == 0){
+            perf_report = argv[i] + 16;
+        }else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc){
+            batch = argv[++i];
+        }else if (strncmp(argv[i], "--batch=", 8) == 0){
+            batch = argv[i] + 8;
+        }else if (strncmp(argv[i], "--lex-jobs=", 11) == 0){
+            lex_jobs = atoi(argv[i] + 11);
+        }else if (strncmp(argv[i], "--jobs=", 7) == 0){
+            jobs = atoi(argv[i] + 7);
+        }else if (strcmp(argv[i], "--gc=generational") == 0){
+            generational = 1;
+        }else if (strcmp(argv[i], "--gc=refcount") == 0){
+            generational = 0;
+        }else if (strncmp(argv[i], "--gc-nursery=", 13) == 0){
+            gc_nursery = atoi(argv[i] + 13);
+            if (gc_nursery < GC_MIN_NURSERY){
+                fprintf(stderr, "--gc-nursery is at least %d kB, using that\n", GC_MIN_NURSERY);
+                gc_nursery = GC_MIN_NURSERY;
             }
-            lines = new_lines;
+        }else if (strncmp(argv[i], "--gc-old=", 9) == 0){
+            gc_old = atoi(argv[i] + 9);
+            if (gc_old < 0) gc_old = 0;
+        }else if (strcmp(argv[i], "--gc-huge-pages") == 0){
+            huge_pages = 1;
+        }else if (strncmp(argv[i], "--fusion-report=", 16) == 0){
+            return fusion_report(argv[i] + 16) ? 0 : 1;
+        }else{
+            path = argv[i];
         }
     }
 
-    fclose(file);
-
-    if (line_count_out) {
-        *line_count_out = count;
+    if (interp->check_only) interp->lazy_parse = 0; // syntax errors hide in unparsed bodies
+    minipy_set_gc(interp, generational, gc_nursery, gc_old, huge_pages);
+
+    // these follow a single interpreter
+    if (batch && (profile || trace_path || perf_report || show_stats || stats_fd >= 0)){
+        fprintf(stderr, "--batch ignores --profile, --trace, --stats and --perf-counters\n");
+        profile = 0;
+        trace_path = NULL;
+        perf_report = NULL;
+        show_stats = 0;
+        stats_fd = -1;
     }
 
-    return lines;
-}
-
-void free_lines(char **lines, int line_count) {
-    for (int i = 0; i < line_count; i++) {
-        free(lines[i]);
+    if (perf_report && perf_open() == 0){
+        fprintf(stderr, "perf counters unavailable, reporting phase times only\n");
     }
-    free(lines);
-}
-
-int script(char *path){
-    lines = load_lines("code.sap", &line_count);
-
-    if (!lines) return 1;
-    
-    while(current_line < line_count){
-        char* input = lines[current_line];
-        if (debug) printf("%s, %d\n",input, strlen(input));
-        current_line++;
-
-        if (strlen(input) == 0) continue;
-
-        allocate_tokens();
-        tokenize(input);
-        
-        if (debug){ printf("Tokens:\n"); print_tokens_debug();} //for debugging Tokens
-
-        if (strcasecmp(input, "exit") == 0) {
-            reset_tokens();
-            break;
-        }
 
-        if (error) goto end;
+    if (profile && !path && !batch){
+        fprintf(stderr, "--profile needs a script\n");
+        profile = 0;
+    }
+    if (profile && !profile_start(path, folded)){
+        fprintf(stderr, "profiler unavailable\n");
+        profile = 0;
+    }
 
-        while (peek().type != TOKEN_EOF) {
-            ASTNode* root = parse_statement(NULL);
-            if (error){ ast_free(root); goto end;}
-            if (debug){ printf("\nAST:\n"); print_ast_debug(root,0,0);} //for debugging AST
-            eval(root);
-            ast_free(root);
-            if (error) goto end;
-            if (debug){ printf("\nVariables:\n"); get_variables();} //for debugging Variable Table
-        }
-        reset_tokens();
+    if (stats_fd >= 0 && !stats_stream(interp, stats_fd, stats_interval)){
+        fprintf(stderr, "could not start the stats stream\n");
+        stats_fd = -1;
     }
-    end:
-        exit(1);
-    free_lines(lines, line_count);
-    return 0;
-}
 
-int main(int argc, char *argv[]){
-    if(argc > 1){
-        char *path = argv[1];
-        script_ = 1;
-        script(path);
+    if (trace_path) trace_start(trace_path);
+
+    int status = 0;
+    if(batch){
+        status = batch_run(batch, jobs, interp);
+    }else if(path){
+        status = minipy_run_file(interp, path);
     }else{
-        interactive();
+        interactive(interp);
     }
-    return 0;
+    if (profile){
+        profile_stop();
+        fflush(stdout);
+        profile_report(stderr);
+    }
+    trace_stop();
+    if (stats_fd >= 0) stats_stream_stop();
+    if (debug >= 2) tier_print_stats(interp);
+    if (debug >= 2 || show_stats) stats_print(interp);
+    if (pair_profile) write_pair_profile(pair_profile);
+    if (perf_report){
+        FILE* out = fopen(perf_report, "w");
+        if (out){
+            perf_write(out);
+            fclose(out);
+        }else{
+            perror("Failed to write perf counters");
+        }
+        perf_close();
+    }
+    minipy_destroy(interp);
+    alloc_report(stderr);
+    return status;
 }
\ No newline at end of file
@@ -6,16 +6,46 @@
 #include "lexer.h"
 #include "ast.h"
 #include "memory.h"
+#include "list.h"
+#include "dict.h"
+#include "function.h"
+#include "heap.h"
+#include "gc.h"
 #include "error_handling.h"
+#include "context.h"
 #include "interpreter.h"
-// #include "debug_alloc.h"
+#include "stats.h"
+#include "hooks.h"
+#include "debug_alloc.h"
 
-Variable* symbol_table = NULL;
+void temps_overflow(Interpreter* interp){
+    raiseError(interp, MEMORY_ERROR, "Expression too deeply nested");
+}
 
-#include <stdlib.h>
-#include <string.h>
+void temps_unwind(Interpreter* interp, int mark){
+    while (interp->temp_top > mark){
+        release_literal(interp, &interp->temps[--interp->temp_top]);
+    }
+}
+
+// The value stack holding the locals of running calls (function.h). It
+// grows by doubling; code holding a position in it keeps the index, not a
+// pointer, across anything that may call a function.
+void stack_grow(Interpreter* interp){
+    int capacity = interp->stack_capacity ? interp->stack_capacity * 2 : 256;
+    Literal* tmp = realloc(interp->stack, sizeof(Literal) * capacity);
+    if (!tmp) raiseError(interp, MEMORY_ERROR, "Out of memory");
+    interp->stack = tmp;
+    interp->stack_capacity = capacity;
+}
+
+void stack_unwind(Interpreter* interp, int mark){
+    while (interp->stack_top > mark){
+        release_literal(interp, &interp->stack[--interp->stack_top]);
+    }
+}
 
-Literal copy_literal(const Literal src) {
+Literal copy_literal(Interpreter* interp, const Literal src) {
     Literal dest;
     dest.datatype = src.datatype;
     dest.owns_str = 0;
@@ -29,62 +59,170 @@ Literal copy_literal(const Literal src) {
         case BOOLEAN: // boolean
             dest.boolean = src.boolean;
             break;
-        case STRING: // string
-            dest.string = strdup(src.string);
+        case STRING: { // string
+            if (interp->gc_config.enabled){
+                // collected strings are never changed in place, so they are shared
+                dest.string = gc_share_string(interp, src.string);
+                if (!dest.string) raiseError(interp, MEMORY_ERROR, "Out of memory");
+                dest.owns_str = 1;
+                break;
+            }
+            size_t len = strlen(src.string);
+            dest.string = malloc(len + 1);
+            memcpy(dest.string, src.string, len + 1);
+            dest.owns_str = 1;
+            stats_string(&interp->stats, len + 1, len);
+            break;
+        }
+        case LIST:
+        case DICT:
+        case FUNCTION:
+        case CLASS:
+        case OBJECT:
+            dest.heap = src.heap;
+            heap_retain(dest.heap);
             dest.owns_str = 1;
             break;
     }
     return dest;
 }
 
-void set_variable(const char* name, Literal lit) {
-    Variable* var = symbol_table;
-    Literal literal;
-    if(lit.datatype == STRING){
-        literal.datatype = STRING;
-        literal.string = strdup(lit.string);
-        literal.owns_str = 0;
-    }else{
-        literal = lit;
+// Drops the string or reference a value owns. Every holder of a value,
+// variables included, owns it exactly when owns_str is set.
+void release_literal(Interpreter* interp, Literal* lit){
+    if (!lit->owns_str) return;
+    if (lit->datatype == STRING){
+        if (!interp->gc_config.enabled) free(lit->string);
     }
+    else heap_release(interp, lit->heap);
+    lit->owns_str = 0;
+}
+
+void set_variable(Interpreter* interp, const char* name, Literal lit) {
+    Variable* var = interp->symbol_table;
+    Literal literal = copy_literal(interp, lit);
+    uint64_t probes = 0;
     while (var != NULL) {
+        probes++;
         if (strcmp(var->name, name) == 0) {
-            if(var->literal.datatype == STRING) free(var->literal.string);
+            stats_lookup(&interp->stats, probes);
+            Literal old = var->literal;
             var->literal = literal;
+            release_literal(interp, &old);
+            HOOK(HOOK_VARIABLE, hook_variable(interp, var->name, literal));
             return;
         }
         var = var->next;
     }
+    stats_lookup(&interp->stats, probes);
 
     // Not found, add new
     Variable* new_var = malloc(sizeof(Variable));
     new_var->name = strdup(name);
     new_var->literal = literal;
-    new_var->next = symbol_table;
-    symbol_table = new_var;
+    new_var->next = interp->symbol_table;
+    interp->symbol_table = new_var;
+    HOOK(HOOK_VARIABLE, hook_variable(interp, new_var->name, literal));
+}
+
+// Stores an int, overwriting the value in place when the variable already
+// holds one. Used for the counter of a for loop.
+void set_int_variable(Interpreter* interp, const char* name, int value){
+    Variable* var = find_variable(interp, name);
+    if (var && var->literal.datatype == INT){
+        var->literal.numeric = value;
+        HOOK(HOOK_VARIABLE, hook_variable(interp, var->name, var->literal));
+        return;
+    }
+    Literal lit;
+    lit.datatype = INT;
+    lit.owns_str = 0;
+    lit.numeric = value;
+    set_variable(interp, name, lit);
 }
 
-Literal get_variable(const char* name) {
-    Variable* var = symbol_table;
+// Locals are slots of the running call's frame. Unlike variables they hold
+// owned values, released with release_literal() when the call returns.
+Literal get_local(Interpreter* interp, int slot, const char* name){
+    Literal lit = interp->stack[interp->frame + slot];
+    if (lit.datatype == ERROR){
+        char msg[255];
+        snprintf(msg, sizeof msg, "Undefined variable -> %s", name);
+        raiseError(interp, NAME_ERROR, msg);
+    }
+    lit.owns_str = 0;
+    return lit;
+}
+
+void set_local(Interpreter* interp, int slot, Literal literal){
+    Literal* local = &interp->stack[interp->frame + slot];
+    Literal old = *local;
+    *local = copy_literal(interp, literal);
+    release_literal(interp, &old);
+}
+
+void set_int_local(Interpreter* interp, int slot, int value){
+    Literal* local = &interp->stack[interp->frame + slot];
+    release_literal(interp, local);
+    local->datatype = INT;
+    local->numeric = value;
+}
+
+// Like get_variable() but returns the entry itself and raises nothing.
+Variable* find_variable(Interpreter* interp, const char* name) {
+    Variable* var = interp->symbol_table;
+    uint64_t probes = 0;
     while (var != NULL) {
+        probes++;
         if (strcmp(var->name, name) == 0) {
-            return var->literal;
+            stats_lookup(&interp->stats, probes);
+            return var;
         }
         var = var->next;
     }
+    stats_lookup(&interp->stats, probes);
+    return NULL;
+}
+
+Literal get_variable(Interpreter* interp, const char* name) {
+    Variable* var = interp->symbol_table;
+    uint64_t probes = 0;
+    while (var != NULL) {
+        probes++;
+        if (strcmp(var->name, name) == 0) {
+            stats_lookup(&interp->stats, probes);
+            Literal lit = var->literal;
+            lit.owns_str = 0;
+            return lit;
+        }
+        var = var->next;
+    }
+    stats_lookup(&interp->stats, probes);
     char msg[255] = "Undefined variable -> ";
     strcat(msg,name);
-    raiseError(NAME_ERROR, msg);
+    raiseError(interp, NAME_ERROR, msg);
     Literal lit;
     lit.datatype = ERROR;
     return lit;
 }
 
-void get_variables(){
-    Variable* var = symbol_table;
+void get_variables(Interpreter* interp){
+    FILE* out = interp->out;
+    Variable* var = interp->symbol_table;
     while (var != NULL) {
-        printf("%s: ", var->name);
-        print_literal(var->literal);
+        fprintf(out, "%s: ", var->name);
+        fprint_literal(out, var->literal);
         var = var->next;
     }
-}
\ No newline at end of file
+}
+void free_variables(Interpreter* interp){
+    Variable* var = interp->symbol_table;
+    while (var != NULL) {
+        Variable* next = var->next;
+        release_literal(interp, &var->literal);
+        free(var->name);
+        free(var);
+        var = next;
+    }
+    interp->symbol_table = NULL;
+}
@@ -2,23 +2,43 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 
+typedef struct Interpreter Interpreter;
+typedef struct List List;
+typedef struct Dict Dict;
+typedef struct Function Function;
+typedef struct Class Class;
+typedef struct Object Object;
+typedef struct Heap Heap;
+
 typedef enum {
     NONE,
     INT,
     FLOAT,
     STRING,
     BOOLEAN,
-    ERROR,
+    LIST,
+    DICT,
+    FUNCTION,
+    CLASS,
+    OBJECT,
+    ERROR, // also marks a local that has not been assigned yet
+
 } DataType;
 
 typedef struct Literal{
     DataType datatype;
-    int owns_str;
+    int owns_str; // set when the holder owns its string or reference; see release_literal()
     union {
         int numeric; // for NUMERIC
         float floating_point; // for FLOATING_POINT
         char* string;// for STRING
         int boolean;// for BOOLEAN
+        List* list; // for LIST
+        Dict* dict; // for DICT
+        Function* function; // for FUNCTION
+        Class* cls; // for CLASS
+        Object* object; // for OBJECT
+        Heap* heap; // any of the counted ones above (heap.h)
     };
 } Literal;
 
@@ -28,11 +48,27 @@ typedef struct Variable {
     struct Variable* next;
 } Variable;
 
-extern Variable* symbol_table;
+// Operands held while the rest of an expression is evaluated (temp_push()
+// in context.h). If an error unwinds past them, the error frame releases
+// the strings they own. A line holds at most 1000 tokens, so expressions
+// never nest deeper than this.
+#define MAX_TEMPS 4096
+
+void temps_overflow(Interpreter* interp);
+void temps_unwind(Interpreter* interp, int mark);
+void stack_grow(Interpreter* interp);
+void stack_unwind(Interpreter* interp, int mark);
 
-Literal copy_literal(const Literal src);
-void set_variable(const char* name, Literal literal);
-Literal get_variable(const char* name);
-void get_variables();
+Literal copy_literal(Interpreter* interp, const Literal src);
+void release_literal(Interpreter* interp, Literal* lit);
+void set_variable(Interpreter* interp, const char* name, Literal literal);
+void set_int_variable(Interpreter* interp, const char* name, int value);
+Literal get_variable(Interpreter* interp, const char* name);
+Variable* find_variable(Interpreter* interp, const char* name);
+Literal get_local(Interpreter* interp, int slot, const char* name); // borrowed, like get_variable()
+void set_local(Interpreter* interp, int slot, Literal literal);
+void set_int_local(Interpreter* interp, int slot, int value);
+void get_variables(Interpreter* interp);
+void free_variables(Interpreter* interp);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,392 @@
+// minipy.c
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "lexer.h"
+#include "ast.h"
+#include "memory.h"
+#include "interpreter.h"
+#include "error_handling.h"
+#include "context.h"
+#include "heap.h"
+#include "minipy.h"
+#include "timer.h"
+#include "optimize.h"
+#include "tier.h"
+#include "perf.h"
+#include "trace.h"
+#include "hooks.h"
+#include "debug_alloc.h"
+
+#define INITIAL_LINE_CAPACITY 100
+#define MAX_LINE_LENGTH 1024
+
+// Top-level statements of a compiled script. Nothing writes to them once
+// minipy_compile_*() returns: bodies are parsed eagerly and every loop is
+// either compiled or marked as staying on the tree-walker.
+struct Program {
+    ASTNode** statements;
+    int count;
+    int capacity;
+    int slot_count; // CSE slots the largest statement needs
+};
+
+typedef struct {
+    char** lines;
+    int* numbers;
+    int count;
+    int capacity;
+} Lines;
+
+static void rstrip(char* str) {
+    int len = strlen(str);
+    while (len > 0 && isspace((unsigned char)str[len - 1])) {
+        str[--len] = '\0';
+    }
+}
+
+// Keeps a copy of a non-blank line. Returns 0 if out of memory.
+static int add_line(Lines* out, char* text, int number) {
+    text[strcspn(text, "\r\n")] = 0;
+    rstrip(text);
+    if (strlen(text) == 0) return 1;
+    if (out->count == out->capacity) {
+        int capacity = out->capacity ? out->capacity * 2 : INITIAL_LINE_CAPACITY;
+        char** new_lines = realloc(out->lines, capacity * sizeof(char*));
+        if (!new_lines) return 0;
+        out->lines = new_lines;
+        int* new_numbers = realloc(out->numbers, capacity * sizeof(int));
+        if (!new_numbers) return 0;
+        out->numbers = new_numbers;
+        out->capacity = capacity;
+    }
+    char* line = malloc(strlen(text) + 1);
+    if (!line) return 0;
+    strcpy(line, text);
+    out->lines[out->count] = line;
+    out->numbers[out->count] = number;
+    out->count++;
+    return 1;
+}
+
+static void free_lines(Lines* lines) {
+    for (int i = 0; i < lines->count; i++) {
+        free(lines->lines[i]);
+    }
+    free(lines->lines);
+    free(lines->numbers);
+}
+
+static int load_lines(const char* path, Lines* out) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        perror("Failed to open file");
+        return 0;
+    }
+
+    char buffer[MAX_LINE_LENGTH];
+    int number = 0;
+    while (fgets(buffer, sizeof(buffer), file)) {
+        number++;
+        if (!add_line(out, buffer, number)) {
+            perror("Failed to allocate memory for lines");
+            break;
+        }
+    }
+
+    fclose(file);
+    return 1;
+}
+
+static void split_lines(const char* source, Lines* out) {
+    char buffer[MAX_LINE_LENGTH];
+    int number = 0;
+    while (*source) {
+        size_t len = strcspn(source, "\n");
+        size_t copy = len < sizeof buffer - 1 ? len : sizeof buffer - 1;
+        memcpy(buffer, source, copy);
+        buffer[copy] = '\0';
+        number++;
+        if (!add_line(out, buffer, number)) break;
+        source += len;
+        if (*source == '\n') source++;
+    }
+}
+
+// --trace: one event per phase of a top-level statement, inside one for
+// the statement itself.
+static void trace_statement(int line, uint64_t parse, uint64_t optimize, uint64_t execute, uint64_t end){
+    trace_event("parse", "phase", parse, optimize, line, -1, -1);
+    trace_event("optimize", "phase", optimize, execute, line, -1, -1);
+    trace_event("execute", "phase", execute, end, line, -1, -1);
+    trace_event("statement", "statement", parse, end, line, -1, -1);
+}
+
+// Keeps an optimized statement for minipy_run_program(). Returns 0 if out
+// of memory.
+static int add_statement(Interpreter* interp, Program* program, ASTNode* root){
+    if (program->count == program->capacity){
+        int capacity = program->capacity ? program->capacity * 2 : 16;
+        ASTNode** tmp = realloc(program->statements, sizeof(ASTNode*) * capacity);
+        if (!tmp) return 0;
+        program->statements = tmp;
+        program->capacity = capacity;
+    }
+    tier_freeze(interp, root);
+    if (interp->slot_count > program->slot_count) program->slot_count = interp->slot_count;
+    program->statements[program->count++] = root;
+    return 1;
+}
+
+// Tokenizes one line and runs the statements on it, or adds them to
+// program when it is not NULL; a block statement reads its body from the
+// script or from stdin. Returns 0 on an error.
+static int run_line(Interpreter* interp, const char* input, int line, Program* program){
+    allocate_tokens(interp);
+    interp->error_line = interp->script ? line : 0;
+    if (perf_enabled) perf_begin();
+    uint64_t lex_start = tracing ? timer_ns() : 0;
+    if (interp->script) tokenize_line(interp, interp->current_line - 1);
+    else tokenize(interp, input);
+    if (tracing) trace_event("tokenize", "phase", lex_start, timer_ns(), line, -1, -1);
+    if (perf_enabled) perf_end(PHASE_LEX);
+
+    HOOK(HOOK_TOKENS, hook_tokens(interp, interp->tokens, interp->token_count));
+
+    if (interp->error) goto fail;
+
+    while (peek(interp).type != TOKEN_EOF) {
+        if (perf_enabled) perf_begin();
+        uint64_t parse_start = tracing ? timer_ns() : 0;
+        ASTNode* root = parse_statement(interp, NULL);
+        if (interp->error){ ast_free(root); goto fail;}
+        uint64_t optimize_start = tracing ? timer_ns() : 0;
+        root = optimize(interp, root);
+        if (perf_enabled) perf_end(PHASE_PARSE);
+        HOOK(HOOK_AST, hook_ast(interp, root));
+        if (interp->check_only){ ast_free(root); cse_release(interp); continue;}
+        if (program){
+            int added = add_statement(interp, program, root);
+            cse_release(interp);
+            if (!added){
+                ast_free(root);
+                raiseError(interp, MEMORY_ERROR, "Out of memory");
+                goto fail;
+            }
+            continue;
+        }
+        if (perf_enabled) perf_begin();
+        uint64_t start = timer_ns();
+        if (!eval_toplevel(interp, root)){ ast_free(root); cse_release(interp); goto fail;}
+        uint64_t finish = timer_ns();
+        interp->tier_stats.eval_ns += finish - start;
+        if (tracing) trace_statement(root->line ? root->line : line, parse_start, optimize_start, start, finish);
+        if (perf_enabled) perf_end(PHASE_EVAL);
+        HOOK(HOOK_STATEMENT, hook_statement(interp, root));
+        ast_free(root);
+        cse_release(interp);
+    }
+    reset_tokens(interp);
+    return 1;
+    fail:
+        reset_tokens(interp);
+        return 0;
+}
+
+static int run_script(Interpreter* interp, Lines* lines, Program* program){
+    interp->lines = lines->lines;
+    interp->line_numbers = lines->numbers;
+    interp->line_count = lines->count;
+    interp->current_line = 0;
+    interp->script = 1;
+    interp->last_error.message[0] = '\0';
+    if (lex_jobs != 1){
+        if (perf_enabled) perf_begin();
+        uint64_t lex_start = tracing ? timer_ns() : 0;
+        interp->lexed = lex_lines(lines->lines, lines->count, lex_jobs);
+        if (tracing) trace_event("tokenize", "phase", lex_start, timer_ns(), 0, -1, -1);
+        if (perf_enabled) perf_end(PHASE_LEX);
+    }
+
+    int status = 0;
+    while (interp->current_line < interp->line_count){
+        char* input = interp->lines[interp->current_line];
+        HOOK(HOOK_LINE, hook_line(interp, input));
+        interp->current_line++;
+
+        if (strcasecmp(input, "exit") == 0) break;
+
+        if (!run_line(interp, input, interp->line_numbers[interp->current_line - 1], program)){
+            status = 1;
+            break;
+        }
+    }
+
+    free_lexed_lines(interp->lexed);
+    interp->lexed = NULL;
+    interp->lines = NULL;
+    interp->line_numbers = NULL;
+    interp->line_count = 0;
+    interp->current_line = 0;
+    free_lines(lines);
+    return status;
+}
+
+int minipy_run_file(Interpreter* interp, const char* path){
+    Lines lines = {0};
+    if (!load_lines(path, &lines)) return 1;
+    return run_script(interp, &lines, NULL);
+}
+
+int minipy_run_string(Interpreter* interp, const char* source){
+    Lines lines = {0};
+    split_lines(source, &lines);
+    return run_script(interp, &lines, NULL);
+}
+
+int minipy_run_line(Interpreter* interp, const char* text, int line){
+    interp->script = 0;
+    interp->last_error.message[0] = '\0';
+    return run_line(interp, text, line, NULL) ? 0 : 1;
+}
+
+// Parses with interp but leaves its variables alone.
+static Program* compile_lines(Interpreter* interp, Lines* lines){
+    Program* program = calloc(1, sizeof(Program));
+    if (!program){
+        free_lines(lines);
+        return NULL;
+    }
+    int lazy_parse = interp->lazy_parse;
+    int check_only = interp->check_only;
+    interp->lazy_parse = 0;
+    interp->check_only = 0;
+    int status = run_script(interp, lines, program);
+    interp->lazy_parse = lazy_parse;
+    interp->check_only = check_only;
+    if (status){
+        minipy_program_free(program);
+        return NULL;
+    }
+    return program;
+}
+
+Program* minipy_compile_file(Interpreter* interp, const char* path){
+    Lines lines = {0};
+    if (!load_lines(path, &lines)) return NULL;
+    return compile_lines(interp, &lines);
+}
+
+Program* minipy_compile_string(Interpreter* interp, const char* source){
+    Lines lines = {0};
+    split_lines(source, &lines);
+    return compile_lines(interp, &lines);
+}
+
+int minipy_run_program(Interpreter* interp, const Program* program){
+    interp->error = 0;
+    interp->last_error.message[0] = '\0';
+    if (!cse_reserve(interp, program->slot_count)){
+        raiseError(interp, MEMORY_ERROR, "Out of memory");
+        return 1;
+    }
+    int status = 0;
+    for (int i = 0; i < program->count; i++){
+        ASTNode* root = program->statements[i];
+        interp->error_line = root->line;
+        uint64_t start = timer_ns();
+        if (!eval_toplevel(interp, root)){
+            status = 1;
+            break;
+        }
+        interp->tier_stats.eval_ns += timer_ns() - start;
+        HOOK(HOOK_STATEMENT, hook_statement(interp, root));
+    }
+    cse_release(interp);
+    return status;
+}
+
+void minipy_program_free(Program* program){
+    if (!program) return;
+    for (int i = 0; i < program->count; i++) ast_free(program->statements[i]);
+    free(program->statements);
+    free(program);
+}
+
+void minipy_set_int(Interpreter* interp, const char* name, int value){
+    set_variable(interp, name, (Literal){ .datatype = INT, .numeric = value });
+}
+
+void minipy_set_float(Interpreter* interp, const char* name, double value){
+    set_variable(interp, name, (Literal){ .datatype = FLOAT, .floating_point = value });
+}
+
+void minipy_set_string(Interpreter* interp, const char* name, const char* value){
+    set_variable(interp, name, (Literal){ .datatype = STRING, .string = (char*)value });
+}
+
+int minipy_get_int(Interpreter* interp, const char* name, int* out){
+    Variable* var = find_variable(interp, name);
+    if (!var || var->literal.datatype != INT) return 0;
+    *out = var->literal.numeric;
+    return 1;
+}
+
+int minipy_get_float(Interpreter* interp, const char* name, double* out){
+    Variable* var = find_variable(interp, name);
+    if (!var || var->literal.datatype != FLOAT) return 0;
+    *out = var->literal.floating_point;
+    return 1;
+}
+
+const Error* minipy_error(Interpreter* interp){
+    return interp->last_error.message[0] ? &interp->last_error : NULL;
+}
+
+Interpreter* minipy_create(){
+    Interpreter* interp = calloc(1, sizeof(Interpreter));
+    if (!interp) return NULL;
+    interp->temps = malloc(sizeof(Literal) * MAX_TEMPS);
+    if (!interp->temps){
+        free(interp);
+        return NULL;
+    }
+    interp->out = stdout;
+    return interp;
+}
+
+void minipy_set_output(Interpreter* interp, FILE* out){
+    interp->out = out ? out : stdout;
+}
+
+void minipy_set_gc(Interpreter* interp, int generational, size_t nursery_kb, size_t old_mb, int huge_pages){
+    interp->gc_config = (GcConfig){
+        .enabled = generational,
+        .nursery_size = nursery_kb << 10,
+        .old_size = old_mb << 20,
+        .huge_pages = huge_pages,
+    };
+}
+
+void minipy_reset(Interpreter* interp){
+    free_variables(interp);
+    heap_collect(interp);
+    interp->error = 0;
+    interp->last_error.message[0] = '\0';
+}
+
+void minipy_destroy(Interpreter* interp){
+    if (!interp) return;
+    reset_tokens(interp);
+    cse_release(interp);
+    free(interp->cse_slots);
+    free_variables(interp);
+    heap_collect(interp);
+    gc_destroy(interp);
+    heap_state_free(&interp->heap);
+    caches_free(interp);
+    free(interp->temps);
+    free(interp->stack);
+    free(interp);
+}
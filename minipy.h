@@ -0,0 +1,52 @@
+// minipy.h
+#ifndef MINIPY_H
+#define MINIPY_H
+
+#include <stdio.h>
+#include "error_handling.h"
+
+// Embedding API. Interpreters share nothing but the process-wide settings,
+// so any number of them can run at once, each in its own thread. A single
+// interpreter must only be used by one thread at a time.
+typedef struct Interpreter Interpreter;
+typedef struct Program Program;
+
+Interpreter* minipy_create(); // NULL if out of memory
+void minipy_destroy(Interpreter* interp);
+void minipy_reset(Interpreter* interp); // forget all variables, e.g. before the next script
+void minipy_set_output(Interpreter* interp, FILE* out); // print output and error messages; NULL = stdout
+
+// Memory manager: reference counting by default, or the generational
+// collector with a nursery of nursery_kb and an old generation of up to
+// old_mb, optionally on huge pages. 0 takes the default size. Only before
+// the interpreter's first run.
+void minipy_set_gc(Interpreter* interp, int generational, size_t nursery_kb, size_t old_mb, int huge_pages);
+
+// Run a whole script. Variables persist across runs on the same
+// interpreter. Return 0 on success, 1 if the script raised an error.
+int minipy_run_file(Interpreter* interp, const char* path);
+int minipy_run_string(Interpreter* interp, const char* source);
+
+// One line typed at the prompt; block bodies are read from stdin.
+int minipy_run_line(Interpreter* interp, const char* text, int line);
+
+// Compile once, run many times: a program is parsed, optimized and its
+// loops compiled by minipy_compile_*(), then only read, so any number of
+// interpreters may run it at the same time. Errors are reported on interp,
+// whose variables are not touched. NULL on error.
+Program* minipy_compile_file(Interpreter* interp, const char* path);
+Program* minipy_compile_string(Interpreter* interp, const char* source);
+int minipy_run_program(Interpreter* interp, const Program* program); // 0 on success, 1 on error
+void minipy_program_free(Program* program); // once no interpreter is running it
+
+// Inputs and results of a run. The getters return 0 if the variable is
+// missing or has another type.
+void minipy_set_int(Interpreter* interp, const char* name, int value);
+void minipy_set_float(Interpreter* interp, const char* name, double value);
+void minipy_set_string(Interpreter* interp, const char* name, const char* value);
+int minipy_get_int(Interpreter* interp, const char* name, int* out);
+int minipy_get_float(Interpreter* interp, const char* name, double* out);
+
+const Error* minipy_error(Interpreter* interp); // last error, NULL if the last run succeeded
+
+#endif
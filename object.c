@@ -0,0 +1,308 @@
+// object.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lexer.h"
+#include "ast.h"
+#include "object.h"
+#include "function.h"
+#include "memory.h"
+#include "interpreter.h"
+#include "error_handling.h"
+#include "context.h"
+#include "stats.h"
+#include "gc.h"
+#include "debug_alloc.h"
+
+// An object never reserves more inline slots than this; the rest go to a
+// separate array.
+#define MAX_INLINE_SLOTS 32
+
+static Shape* shape_new(Interpreter* interp, Shape* parent, const char* name){
+    Shape* shape = calloc(1, sizeof(Shape));
+    if (!shape) return NULL;
+    if (name && !(shape->name = strdup(name))){
+        free(shape);
+        return NULL;
+    }
+    shape->id = ++interp->shape_count;
+    shape->parent = parent;
+    shape->count = parent ? parent->count + 1 : 0;
+    return shape;
+}
+
+static void shape_free(Shape* shape){
+    for (int i = 0; i < shape->transition_count; i++) shape_free(shape->transitions[i]);
+    free(shape->transitions);
+    free(shape->name);
+    free(shape);
+}
+
+// The shape an object of this shape takes when it gains name. Objects
+// that add the same attributes in the same order end up sharing it.
+static Shape* shape_transition(Interpreter* interp, Shape* shape, const char* name){
+    for (int i = 0; i < shape->transition_count; i++){
+        if (strcmp(shape->transitions[i]->name, name) == 0) return shape->transitions[i];
+    }
+    if (shape->transition_count == shape->transition_capacity){
+        int capacity = shape->transition_capacity ? shape->transition_capacity * 2 : 2;
+        Shape** tmp = realloc(shape->transitions, sizeof(Shape*) * capacity);
+        if (!tmp) goto out_of_memory;
+        shape->transitions = tmp;
+        shape->transition_capacity = capacity;
+    }
+    Shape* next = shape_new(interp, shape, name);
+    if (!next) goto out_of_memory;
+    shape->transitions[shape->transition_count++] = next;
+    return next;
+
+    out_of_memory:
+        raiseError(interp, MEMORY_ERROR, "Out of memory");
+        return NULL;
+}
+
+// The slot holding name in an object of this shape, or -1.
+static int shape_slot(Shape* shape, const char* name){
+    for (; shape->parent; shape = shape->parent){
+        if (strcmp(shape->name, name) == 0) return shape->count - 1;
+    }
+    return -1;
+}
+
+Function* class_method(Class* cls, const char* name){
+    for (int i = 0; i < cls->method_count; i++){
+        if (strcmp(cls->methods[i]->name, name) == 0) return cls->methods[i];
+    }
+    return NULL;
+}
+
+// The methods are the functions the class body defines; a later def of
+// the same name replaces an earlier one.
+static int add_method(Class* cls, Function* fn){
+    for (int i = 0; i < cls->method_count; i++){
+        if (strcmp(cls->methods[i]->name, fn->name) == 0){
+            function_release(cls->methods[i]);
+            heap_retain(&fn->head);
+            cls->methods[i] = fn;
+            return 1;
+        }
+    }
+    Function** tmp = realloc(cls->methods, sizeof(Function*) * (cls->method_count + 1));
+    if (!tmp) return 0;
+    cls->methods = tmp;
+    heap_retain(&fn->head);
+    cls->methods[cls->method_count++] = fn;
+    return 1;
+}
+
+Class* class_new(Interpreter* interp, ASTNode* node){
+    Class* cls = calloc(1, sizeof(Class));
+    if (!cls) goto out_of_memory;
+    heap_init(&cls->head, HEAP_CLASS);
+    cls->inline_slots = 4;
+    cls->name = strdup(node->classdef.name);
+    cls->root = shape_new(interp, NULL, NULL);
+    if (!cls->name || !cls->root) goto fail;
+    ASTNode* body = node->classdef.body;
+    for (int i = 0; i < body->block.count; i++){
+        ASTNode* stmt = body->block.statements[i];
+        if (stmt->type == AST_DEF && !add_method(cls, stmt->function)) goto fail;
+    }
+    cls->init = class_method(cls, "__init__");
+    return cls;
+
+    fail:
+        class_release(cls);
+    out_of_memory:
+        raiseError(interp, MEMORY_ERROR, "Out of memory");
+        return NULL;
+}
+
+void class_release(Class* cls){
+    if (--cls->head.refs > 0) return;
+    for (int i = 0; i < cls->method_count; i++) function_release(cls->methods[i]);
+    free(cls->methods);
+    if (cls->root) shape_free(cls->root);
+    free(cls->name);
+    free(cls);
+}
+
+Object* object_new(Interpreter* interp, Class* cls){
+    Object* obj = heap_new(interp, HEAP_OBJECT, sizeof(Object) + sizeof(Literal) * cls->inline_slots);
+    if (!obj){
+        raiseError(interp, MEMORY_ERROR, "Out of memory");
+        return NULL;
+    }
+    obj->cls = cls;
+    if (obj->head.gen == GEN_COUNTED) heap_retain(&cls->head);
+    else gc_pin(interp, &cls->head);
+    obj->shape = cls->root;
+    obj->capacity = cls->inline_slots;
+    obj->slots = obj->inline_slots;
+    return obj;
+}
+
+// Room for the slot the next attribute goes in. Later instances of the
+// class reserve as many inline slots as this one came to need.
+static void object_grow(Interpreter* interp, Object* obj){
+    int count = obj->shape->count + 1;
+    if (count <= obj->capacity) return;
+    int capacity = obj->capacity * 2;
+    Literal* slots;
+    if (obj->slots == obj->inline_slots){
+        slots = heap_buffer(interp, &obj->head, NULL, sizeof(Literal) * capacity);
+        if (slots) memcpy(slots, obj->slots, sizeof(Literal) * obj->shape->count);
+    } else {
+        slots = heap_buffer(interp, &obj->head, obj->slots, sizeof(Literal) * capacity);
+    }
+    if (!slots){
+        raiseError(interp, MEMORY_ERROR, "Out of memory");
+        return;
+    }
+    obj->slots = slots;
+    obj->capacity = capacity;
+    if (count > obj->cls->inline_slots) obj->cls->inline_slots = count < MAX_INLINE_SLOTS ? count : MAX_INLINE_SLOTS;
+}
+
+static InlineCache* cache_at(Interpreter* interp, int site){
+    if (site < interp->cache_capacity) return &interp->caches[site];
+    int capacity = interp->cache_capacity ? interp->cache_capacity : 16;
+    while (capacity <= site) capacity *= 2;
+    InlineCache* tmp = realloc(interp->caches, sizeof(InlineCache) * capacity);
+    if (!tmp){
+        raiseError(interp, MEMORY_ERROR, "Out of memory");
+        return NULL;
+    }
+    memset(tmp + interp->cache_capacity, 0, sizeof(InlineCache) * (capacity - interp->cache_capacity));
+    interp->caches = tmp;
+    interp->cache_capacity = capacity;
+    return &interp->caches[site];
+}
+
+// The entry of the site's cache for this shape, or -1 after a miss.
+static inline int cache_probe(Interpreter* interp, InlineCache* cache, Shape* shape){
+    for (int i = 0; i < cache->count; i++){
+        if (cache->shapes[i] == shape->id){
+            if (stats_enabled) interp->stats.cache_hits++;
+            return i;
+        }
+    }
+    if (stats_enabled) interp->stats.cache_misses++;
+    return -1;
+}
+
+static inline void cache_fill(InlineCache* cache, Shape* shape, int slot, Shape* next){
+    if (cache->count == CACHE_WAYS) return; // megamorphic: the rest are looked up every time
+    cache->shapes[cache->count] = shape->id;
+    cache->slots[cache->count] = slot;
+    cache->next[cache->count] = next;
+    cache->count++;
+}
+
+static void no_attribute(Interpreter* interp, Literal target, const char* name){
+    char msg[255];
+    const char* type = target.datatype == OBJECT ? target.object->cls->name : datatype_name(target.datatype);
+    if (target.datatype == OBJECT && class_method(target.object->cls, name)){
+        snprintf(msg, sizeof msg, "Method \'%.80s\' of \'%.80s\' object can only be called", name, type);
+        raiseError(interp, TYPE_ERROR, msg);
+    }
+    snprintf(msg, sizeof msg, "\'%.80s\' object has no attribute \'%.80s\'", type, name);
+    raiseError(interp, ATTRIBUTE_ERROR, msg);
+}
+
+void attr_get(Interpreter* interp, Literal target, const char* name, int site, Literal* out){
+    if (target.datatype != OBJECT) no_attribute(interp, target, name);
+    Object* obj = target.object;
+    InlineCache* cache = cache_at(interp, site);
+    int i = cache_probe(interp, cache, obj->shape);
+    int slot;
+    if (i >= 0){
+        slot = cache->slots[i];
+    } else {
+        slot = shape_slot(obj->shape, name);
+        cache_fill(cache, obj->shape, slot, NULL);
+    }
+    if (slot < 0) no_attribute(interp, target, name);
+    *out = copy_literal(interp, obj->slots[slot]);
+}
+
+// target.name = value, or target.name op= value. Storing an attribute the
+// object does not have yet moves it to the next shape; the site caches
+// that transition along with the slot.
+void attr_set(Interpreter* interp, char op, Literal target, const char* name, int site, Literal value){
+    if (target.datatype != OBJECT){
+        char msg[255];
+        snprintf(msg, sizeof msg, "\'%s\' object has no attribute \'%.200s\'", datatype_name(target.datatype), name);
+        raiseError(interp, ATTRIBUTE_ERROR, msg);
+    }
+    Object* obj = target.object;
+    InlineCache* cache = cache_at(interp, site);
+    int i = cache_probe(interp, cache, obj->shape);
+    int slot;
+    Shape* next;
+    if (i >= 0){
+        slot = cache->slots[i];
+        next = cache->next[i];
+    } else {
+        slot = shape_slot(obj->shape, name);
+        next = NULL;
+        if (slot < 0){
+            slot = obj->shape->count;
+            next = shape_transition(interp, obj->shape, name);
+        }
+        cache_fill(cache, obj->shape, slot, next);
+    }
+
+    if (op != '='){
+        if (next) no_attribute(interp, target, name);
+        Literal* result = temp_push(interp);
+        binary_op(interp, op, obj->slots[slot], value, result);
+        Literal old = obj->slots[slot];
+        obj->slots[slot] = heap_store(interp, &obj->head, *result);
+        release_literal(interp, &old);
+        temps_unwind(interp, interp->temp_top - 1);
+        return;
+    }
+    if (next){
+        object_grow(interp, obj);
+        obj->slots[slot] = heap_store(interp, &obj->head, value);
+        obj->shape = next;
+        return;
+    }
+    Literal old = obj->slots[slot];
+    obj->slots[slot] = heap_store(interp, &obj->head, value);
+    release_literal(interp, &old);
+}
+
+// The method a call site on obj runs, cached by shape like attributes:
+// every shape belongs to one class.
+Function* method_find(Interpreter* interp, Object* obj, const char* name, int site){
+    InlineCache* cache = cache_at(interp, site);
+    int i = cache_probe(interp, cache, obj->shape);
+    int index;
+    if (i >= 0){
+        index = cache->slots[i];
+    } else {
+        index = -1;
+        for (int m = 0; m < obj->cls->method_count; m++){
+            if (strcmp(obj->cls->methods[m]->name, name) == 0) index = m;
+        }
+        cache_fill(cache, obj->shape, index, NULL);
+    }
+    if (index < 0){
+        char msg[255];
+        snprintf(msg, sizeof msg, "\'%.80s\' object has no method \'%.80s\'", obj->cls->name, name);
+        raiseError(interp, ATTRIBUTE_ERROR, msg);
+    }
+    return obj->cls->methods[index];
+}
+
+void caches_free(Interpreter* interp){
+    free(interp->caches);
+    interp->caches = NULL;
+    interp->cache_capacity = 0;
+}
+
+void fprint_object(FILE* out, Object* obj){
+    fprintf(out, "<%s object>", obj->cls->name);
+}
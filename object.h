@@ -0,0 +1,77 @@
+// object.h
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <stdio.h>
+#include "memory.h"
+#include "heap.h"
+
+typedef struct ASTNode ASTNode;
+
+// Hidden classes. An object starts at its class's root shape and follows a
+// transition each time it gains an attribute, so objects given the same
+// attributes in the same order share a shape and keep each attribute in
+// the same slot. A shape names the attribute it added and points to its
+// parent, so the chain from a shape lists every attribute in slot order.
+// The shapes of a class form a tree owned by the class.
+typedef struct Shape {
+    unsigned id; // unique within the interpreter, what inline caches compare
+    struct Shape* parent;
+    char* name;  // the attribute this shape added, NULL at the root
+    int count;   // attributes of an object with this shape; name is in slot count - 1
+    struct Shape** transitions;
+    int transition_count;
+    int transition_capacity;
+} Shape;
+
+// Made each time a class statement runs, and counted (heap.h).
+typedef struct Class {
+    Heap head;
+    char* name;
+    Shape* root;
+    Function** methods;
+    int method_count;
+    Function* init; // __init__, NULL if the class has none
+    int inline_slots; // slots a new instance reserves inline: the most any instance has needed
+} Class;
+
+// Instances are shared by reference and counted like lists. The slots
+// are part of the object's own allocation until it outgrows them.
+typedef struct Object {
+    Heap head;
+    Class* cls;
+    Shape* shape;
+    int capacity;
+    Literal* slots; // inline_slots, or a larger array once outgrown
+    Literal inline_slots[];
+} Object;
+
+#define CACHE_WAYS 4
+
+// The inline cache of one attribute access or method call site, kept per
+// interpreter in interp->caches and numbered by the parser. It maps the
+// shapes seen at the site to the slot (or method) they resolve to: one
+// entry is monomorphic, more are polymorphic. A site that sees more than
+// CACHE_WAYS shapes looks the others up along the shape chain.
+typedef struct InlineCache {
+    unsigned shapes[CACHE_WAYS];
+    int slots[CACHE_WAYS];        // -1 for an attribute the shape does not have
+    struct Shape* next[CACHE_WAYS]; // for a store adding the attribute: the shape after it
+    int count;
+} InlineCache;
+
+Class* class_new(Interpreter* interp, ASTNode* node); // from an AST_CLASS, one reference for the caller
+void class_release(Class* cls); // for heap_release()
+
+Object* object_new(Interpreter* interp, Class* cls); // one reference for the caller
+
+void attr_get(Interpreter* interp, Literal target, const char* name, int site, Literal* out); // out is owned
+void attr_set(Interpreter* interp, char op, Literal target, const char* name, int site, Literal value);
+Function* method_find(Interpreter* interp, Object* obj, const char* name, int site);
+Function* class_method(Class* cls, const char* name); // NULL if the class has none by that name
+
+void fprint_object(FILE* out, Object* obj);
+
+void caches_free(Interpreter* interp);
+
+#endif
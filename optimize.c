@@ -0,0 +1,458 @@
+// optimize.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lexer.h"
+#include "ast.h"
+#include "function.h"
+#include "optimize.h"
+#include "error_handling.h"
+#include "context.h"
+#include "debug_alloc.h"
+
+int optimize_enabled = 1;
+
+// Every operator handled by binary_op() is pure: the result depends only on
+// the operand values, and the only effects are allocating the result and
+// raising an error, which is itself a function of the operands.
+//   + - * /          numeric arithmetic, str + str, str * int
+//   > < g e l n      numeric comparisons
+//   & | !            and / or / not, returning one of the operands
+// Since cached values are computed where the expression originally stood
+// (see AST_CACHED in eval_expression()), an expression that raises does so
+// at the same point and with the same message as without the optimizer.
+static int is_pure_op(char op){
+    switch (op){
+        case '+': case '-': case '*': case '/':
+        case '>': case '<': case 'g': case 'e': case 'l': case 'n':
+        case '&': case '|': case '!':
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int new_slot(Interpreter* interp){
+    if (interp->slot_count == interp->slot_capacity){
+        int capacity = interp->slot_capacity ? interp->slot_capacity * 2 : 16;
+        CacheSlot* tmp = realloc(interp->cse_slots, sizeof(CacheSlot) * capacity);
+        if (!tmp) return -1;
+        interp->cse_slots = tmp;
+        interp->slot_capacity = capacity;
+    }
+    interp->cse_slots[interp->slot_count].valid = 0;
+    return interp->slot_count++;
+}
+
+void cse_clear(Interpreter* interp, int first, int count){
+    for (int i = first; i < first + count; i++){
+        if (interp->cse_slots[i].valid) release_literal(interp, &interp->cse_slots[i].value);
+        interp->cse_slots[i].valid = 0;
+    }
+}
+
+// Called once the tree owning the slots has been freed.
+void cse_release(Interpreter* interp){
+    cse_clear(interp, 0, interp->slot_count);
+    interp->slot_count = 0;
+}
+
+// Empty slots for a tree another interpreter optimized. Returns 0 if out
+// of memory.
+int cse_reserve(Interpreter* interp, int count){
+    cse_release(interp);
+    for (int i = 0; i < count; i++){
+        if (new_slot(interp) < 0) return 0;
+    }
+    return 1;
+}
+
+static ASTNode* wrap_cached(Interpreter* interp, ASTNode* expr, int slot){
+    ASTNode* node = new_node(interp);
+    if (!node) return expr;
+    node->type = AST_CACHED;
+    node->line = expr->line;
+    node->cached.expr = expr;
+    node->cached.slot = slot;
+    return node;
+}
+
+static ASTNode* wrap_scope(Interpreter* interp, ASTNode* body, int first, int count){
+    ASTNode* node = new_node(interp);
+    if (!node) return body;
+    node->type = AST_SCOPE;
+    node->line = body->line;
+    node->scope.body = body;
+    node->scope.first = first;
+    node->scope.count = count;
+    return node;
+}
+
+// An expression made only of literals, variables and pure operators.
+static int is_pure(ASTNode* node){
+    if (!node) return 0;
+    switch (node->type){
+        case AST_NONE: case AST_NUMERIC: case AST_FLOATING_POINT:
+        case AST_STRING: case AST_BOOLEAN: case AST_IDENTIFIER: case AST_CACHED:
+            return 1;
+        case AST_OPERATOR:
+            return is_pure_op(node->operate.op) && is_pure(node->operate.left) && is_pure(node->operate.right);
+        default:
+            return 0;
+    }
+}
+
+static int same_expr(ASTNode* a, ASTNode* b){
+    if (a->type != b->type) return 0;
+    switch (a->type){
+        case AST_NONE: return 1;
+        case AST_NUMERIC: return a->literal.numeric == b->literal.numeric;
+        case AST_FLOATING_POINT: return memcmp(&a->literal.floating_point, &b->literal.floating_point, sizeof(float)) == 0;
+        case AST_BOOLEAN: return a->literal.boolean == b->literal.boolean;
+        case AST_STRING: return strcmp(a->literal.string, b->literal.string) == 0;
+        case AST_IDENTIFIER: return strcmp(a->name, b->name) == 0;
+        case AST_CACHED: return a->cached.slot == b->cached.slot;
+        case AST_OPERATOR:
+            return a->operate.op == b->operate.op &&
+                   same_expr(a->operate.left, b->operate.left) &&
+                   same_expr(a->operate.right, b->operate.right);
+        default: return 0;
+    }
+}
+
+static int expr_size(ASTNode* node){
+    if (node->type != AST_OPERATOR) return 1;
+    return 1 + expr_size(node->operate.left) + expr_size(node->operate.right);
+}
+
+typedef struct {
+    ASTNode*** items;
+    int count;
+    int capacity;
+} PosList;
+
+static void push_pos(PosList* list, ASTNode** pos){
+    if (list->count == list->capacity){
+        int capacity = list->capacity ? list->capacity * 2 : 16;
+        ASTNode*** tmp = realloc(list->items, sizeof(ASTNode**) * capacity);
+        if (!tmp) return;
+        list->items = tmp;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = pos;
+}
+
+// Operator subtrees of an expression; cached subtrees are opaque.
+static void collect_operators(ASTNode** pos, PosList* list){
+    ASTNode* node = *pos;
+    if (!node || node->type != AST_OPERATOR) return;
+    push_pos(list, pos);
+    collect_operators(&node->operate.left, list);
+    collect_operators(&node->operate.right, list);
+}
+
+// Common-subexpression elimination inside one expression. Operators are
+// strict (both sides are always evaluated, left first), so the first
+// occurrence of a repeated subtree always computes the shared value.
+static void cse_expression(Interpreter* interp, ASTNode** pos){
+    if (!*pos || !is_pure(*pos)) return;
+    int first = interp->slot_count;
+    while (1){
+        PosList list = {0};
+        collect_operators(pos, &list);
+        ASTNode** best = NULL;
+        int best_size = 0;
+        for (int i = 0; i < list.count; i++){
+            int size = expr_size(*list.items[i]);
+            if (size <= best_size) continue;
+            for (int j = i + 1; j < list.count; j++){
+                if (same_expr(*list.items[i], *list.items[j])){
+                    best = list.items[i];
+                    best_size = size;
+                    break;
+                }
+            }
+        }
+        if (!best){
+            free(list.items);
+            break;
+        }
+        int slot = new_slot(interp);
+        ASTNode* pattern = *best;
+        for (int i = 0; i < list.count && slot >= 0; i++){
+            ASTNode** p = list.items[i];
+            if (p != best && expr_size(*p) == best_size && same_expr(*p, pattern)) *p = wrap_cached(interp, *p, slot);
+        }
+        *best = wrap_cached(interp, *best, slot);
+        free(list.items);
+        if (slot < 0) break;
+    }
+    if (interp->slot_count > first) *pos = wrap_scope(interp, *pos, first, interp->slot_count - first);
+}
+
+typedef struct {
+    char** names;
+    int count;
+    int capacity;
+} NameSet;
+
+static int has_name(NameSet* set, const char* name){
+    for (int i = 0; i < set->count; i++){
+        if (strcmp(set->names[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+static void add_name(NameSet* set, char* name){
+    if (has_name(set, name)) return;
+    if (set->count == set->capacity){
+        int capacity = set->capacity ? set->capacity * 2 : 8;
+        char** tmp = realloc(set->names, sizeof(char*) * capacity);
+        if (!tmp) return;
+        set->names = tmp;
+        set->capacity = capacity;
+    }
+    set->names[set->count++] = name;
+}
+
+// Calls that may change a list in place. A list or dict is shared by every
+// variable it was assigned to, so its writes cannot be tied to a name.
+static int has_mutation(ASTNode* node){
+    if (!node) return 0;
+    switch (node->type){
+        case AST_CALL:
+            if (node->call.builtin != BUILTIN_LEN) return 1;
+            for (int i = 0; i < node->call.count; i++){
+                if (has_mutation(node->call.args[i])) return 1;
+            }
+            return 0;
+        case AST_OPERATOR:
+            return has_mutation(node->operate.left) || has_mutation(node->operate.right);
+        case AST_LIST:
+        case AST_DICT:
+            for (int i = 0; i < node->list.count; i++){
+                if (has_mutation(node->list.items[i])) return 1;
+            }
+            return 0;
+        case AST_INDEX:
+            return has_mutation(node->index.target) || has_mutation(node->index.index);
+        case AST_ATTR:
+        case AST_ATTR_ASSIGN:
+            return has_mutation(node->attr.object) || has_mutation(node->attr.value);
+        case AST_CACHED:
+            return has_mutation(node->cached.expr);
+        case AST_SCOPE:
+            return has_mutation(node->scope.body);
+        default:
+            return 0;
+    }
+}
+
+// Collects the variables a statement may assign. Returns 0 if that cannot
+// be known, e.g. because part of it has not been parsed yet or it changes
+// a list.
+static int collect_writes(ASTNode* node, NameSet* set){
+    if (!node) return 1;
+    switch (node->type){
+        case AST_ASSIGNMENT:
+            add_name(set, node->assign.name);
+            return !has_mutation(node->assign.value);
+        case AST_INDEX_ASSIGN:
+            return 0;
+        case AST_PRINT:
+            return !has_mutation(node->print.value);
+        case AST_BLOCK:
+            if (node->block.lazy) return 0;
+            for (int i = 0; i < node->block.count; i++){
+                if (!collect_writes(node->block.statements[i], set)) return 0;
+            }
+            return 1;
+        case AST_FOR:
+            add_name(set, node->construct.name);
+            // fall through
+        case AST_IF: case AST_ELIF: case AST_ELSE: case AST_WHILE:
+            return !has_mutation(node->construct.condition) &&
+                   collect_writes(node->construct.code, set) && collect_writes(node->construct.next, set);
+        case AST_SCOPE:
+            return collect_writes(node->scope.body, set);
+        case AST_DEF:
+            add_name(set, node->function->name);
+            return 1;
+        case AST_CLASS:
+            add_name(set, node->classdef.name);
+            return 1;
+        default:
+            return !has_mutation(node);
+    }
+}
+
+static int is_invariant(ASTNode* node, NameSet* writes){
+    switch (node->type){
+        case AST_IDENTIFIER: return !has_name(writes, node->name);
+        case AST_OPERATOR:
+            return is_invariant(node->operate.left, writes) && is_invariant(node->operate.right, writes);
+        default: return 1;
+    }
+}
+
+// Replaces the largest loop-invariant operator subtrees with cached nodes.
+// The value is still computed where the expression stands, on its first
+// evaluation inside the loop, and reused until the loop is left.
+static void hoist_expression(Interpreter* interp, ASTNode** pos, NameSet* writes){
+    ASTNode* node = *pos;
+    if (!node || node->type != AST_OPERATOR || !is_pure(node)) return;
+    if (is_invariant(node, writes)){
+        int slot = new_slot(interp);
+        if (slot >= 0) *pos = wrap_cached(interp, node, slot);
+        return;
+    }
+    hoist_expression(interp, &node->operate.left, writes);
+    hoist_expression(interp, &node->operate.right, writes);
+}
+
+static void hoist_statement(Interpreter* interp, ASTNode** pos, NameSet* writes){
+    ASTNode* node = *pos;
+    if (!node) return;
+    switch (node->type){
+        case AST_OPERATOR: hoist_expression(interp, pos, writes); break;
+        case AST_ASSIGNMENT: hoist_expression(interp, &node->assign.value, writes); break;
+        case AST_PRINT: hoist_expression(interp, &node->print.value, writes); break;
+        case AST_BLOCK:
+            for (int i = 0; i < node->block.count; i++) hoist_statement(interp, &node->block.statements[i], writes);
+            break;
+        case AST_IF: case AST_ELIF: case AST_WHILE: case AST_FOR:
+            hoist_expression(interp, &node->construct.condition, writes);
+            hoist_statement(interp, &node->construct.code, writes);
+            hoist_statement(interp, &node->construct.next, writes);
+            break;
+        case AST_ELSE:
+            hoist_statement(interp, &node->construct.code, writes);
+            break;
+        default:
+            break;
+    }
+}
+
+static void optimize_statement(Interpreter* interp, ASTNode** pos);
+
+static void optimize_loop(Interpreter* interp, ASTNode** pos){
+    ASTNode* node = *pos;
+    int first = interp->slot_count;
+
+    NameSet writes = {0};
+    // the range() of a for loop is evaluated once, before its variable changes
+    if (node->type == AST_FOR) add_name(&writes, node->construct.name);
+    if (!has_mutation(node->construct.condition) && collect_writes(node->construct.code, &writes)){
+        if (node->type == AST_WHILE) hoist_expression(interp, &node->construct.condition, &writes);
+        hoist_statement(interp, &node->construct.code, &writes);
+    }
+    free(writes.names);
+
+    cse_expression(interp, &node->construct.condition);
+    optimize_statement(interp, &node->construct.code);
+    optimize_statement(interp, &node->construct.next);
+    if (interp->slot_count > first) *pos = wrap_scope(interp, node, first, interp->slot_count - first);
+}
+
+static void optimize_statement(Interpreter* interp, ASTNode** pos){
+    ASTNode* node = *pos;
+    if (!node) return;
+    switch (node->type){
+        case AST_OPERATOR: cse_expression(interp, pos); break;
+        case AST_ASSIGNMENT: cse_expression(interp, &node->assign.value); break;
+        case AST_PRINT: cse_expression(interp, &node->print.value); break;
+        case AST_BLOCK:
+            for (int i = 0; i < node->block.count; i++) optimize_statement(interp, &node->block.statements[i]);
+            break;
+        case AST_IF: case AST_ELIF:
+            cse_expression(interp, &node->construct.condition);
+            optimize_statement(interp, &node->construct.code);
+            optimize_statement(interp, &node->construct.next);
+            break;
+        case AST_ELSE:
+            optimize_statement(interp, &node->construct.code);
+            break;
+        case AST_WHILE:
+        case AST_FOR:
+            optimize_loop(interp, pos);
+            break;
+        case AST_DEF:
+        case AST_CLASS:
+            // left alone: cse_slots belong to the interpreter, so recursive
+            // calls would share them
+            break;
+        default:
+            break;
+    }
+}
+
+// Whether a statement may read or assign the variable name. A call to a
+// function that is not a builtin might read any variable, and so might a
+// body that has not been parsed yet or a method call, which runs a method
+// of the object's class whatever its name.
+int uses_variable(ASTNode* node, const char* name){
+    if (!node) return 0;
+    switch (node->type){
+        case AST_IDENTIFIER:
+            return strcmp(node->name, name) == 0;
+        case AST_LOCAL:
+            return strcmp(node->local.name, name) == 0;
+        case AST_ASSIGNMENT:
+            return strcmp(node->assign.name, name) == 0 || uses_variable(node->assign.value, name);
+        case AST_RETURN:
+            return uses_variable(node->ret.value, name);
+        case AST_DEF:
+            return strcmp(node->function->name, name) == 0;
+        case AST_CLASS:
+            return strcmp(node->classdef.name, name) == 0;
+        case AST_ATTR:
+        case AST_ATTR_ASSIGN:
+            return uses_variable(node->attr.object, name) || uses_variable(node->attr.value, name);
+        case AST_OPERATOR:
+            return uses_variable(node->operate.left, name) || uses_variable(node->operate.right, name);
+        case AST_PRINT:
+            return uses_variable(node->print.value, name);
+        case AST_BLOCK:
+            if (node->block.lazy) return 1;
+            for (int i = 0; i < node->block.count; i++){
+                if (uses_variable(node->block.statements[i], name)) return 1;
+            }
+            return 0;
+        case AST_FOR:
+            if (strcmp(node->construct.name, name) == 0) return 1;
+            // fall through
+        case AST_IF: case AST_ELIF: case AST_ELSE: case AST_WHILE:
+            return uses_variable(node->construct.condition, name) ||
+                   uses_variable(node->construct.code, name) || uses_variable(node->construct.next, name);
+        case AST_CACHED:
+            return uses_variable(node->cached.expr, name);
+        case AST_SCOPE:
+            return uses_variable(node->scope.body, name);
+        case AST_LIST:
+        case AST_DICT:
+            for (int i = 0; i < node->list.count; i++){
+                if (uses_variable(node->list.items[i], name)) return 1;
+            }
+            return 0;
+        case AST_INDEX:
+        case AST_INDEX_ASSIGN:
+            return uses_variable(node->index.target, name) || uses_variable(node->index.index, name) ||
+                   uses_variable(node->index.value, name);
+        case AST_CALL:
+            if (node->call.builtin == BUILTIN_NONE || node->call.method) return 1;
+            for (int i = 0; i < node->call.count; i++){
+                if (uses_variable(node->call.args[i], name)) return 1;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+// Runs common-subexpression elimination and loop-invariant caching over a
+// parsed statement. Returns the (possibly wrapped) statement.
+ASTNode* optimize(Interpreter* interp, ASTNode* node){
+    if (!optimize_enabled || !node) return node;
+    optimize_statement(interp, &node);
+    return node;
+}
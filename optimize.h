@@ -0,0 +1,25 @@
+// optimize.h
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include "memory.h"
+
+typedef struct ASTNode ASTNode;
+typedef struct Interpreter Interpreter;
+
+typedef struct {
+    Literal value;
+    int valid;
+} CacheSlot;
+
+extern int optimize_enabled;
+
+// Slots are numbered per interpreter (interp->cse_slots)
+ASTNode* optimize(Interpreter* interp, ASTNode* node);
+void cse_clear(Interpreter* interp, int first, int count);
+void cse_release(Interpreter* interp);
+int cse_reserve(Interpreter* interp, int count);
+
+int uses_variable(ASTNode* node, const char* name);
+
+#endif
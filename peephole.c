@@ -0,0 +1,193 @@
+// peephole.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lexer.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "colors.h"
+#include "debug_alloc.h"
+
+int peephole_enabled = 1;
+int pair_profile_enabled = 0;
+unsigned long long pair_counts[OP_COUNT][OP_COUNT];
+
+static int is_comparison(char op){
+    switch (op){
+        case '>': case '<': case 'g': case 'e': case 'l': case 'n': return 1;
+        default: return 0;
+    }
+}
+
+static int is_jump(OpCode op){
+    return op == OP_JUMP || op == OP_JUMP_IF_FALSE || op == OP_LOOP;
+}
+
+// Fuses the common instruction sequences of loop code into single
+// dispatches. Only the first instruction of a sequence may be a jump
+// target; jumps are remapped to the shortened code afterwards.
+void peephole(Chunk* chunk){
+    int n = chunk->count;
+    char* target = calloc(n + 1, 1);
+    int* remap = malloc(sizeof(int) * (n + 1));
+    if (!target || !remap){
+        free(target);
+        free(remap);
+        return;
+    }
+    Instr* code = chunk->code;
+    for (int i = 0; i < n; i++){
+        if (is_jump(code[i].op)) target[code[i].arg] = 1;
+        if (code[i].op == OP_CACHE_LOAD) target[code[i].arg2] = 1;
+        if (code[i].op == OP_FOR_PREP || code[i].op == OP_FOR_LOOP) target[code[i].arg3] = 1;
+    }
+    target[chunk->resume] = 1;
+
+    int k = 0;
+    for (int i = 0; i < n; ){
+        remap[i] = k;
+        Instr in = code[i];
+        int interior_free = i + 3 < n && !target[i + 1] && !target[i + 2] && !target[i + 3];
+
+        // LOAD a; CONST c | LOAD b; BINARY cmp; JUMP_IF_FALSE -> TEST_VAR_*
+        if (interior_free && in.op == OP_LOAD &&
+            (code[i + 1].op == OP_CONST || code[i + 1].op == OP_LOAD) &&
+            code[i + 2].op == OP_BINARY && is_comparison(code[i + 2].binary) &&
+            code[i + 3].op == OP_JUMP_IF_FALSE) {
+            Instr fused = { code[i + 1].op == OP_CONST ? OP_TEST_VAR_CONST : OP_TEST_VAR_VAR,
+                            code[i + 2].binary, in.stmt, in.arg, code[i + 1].arg, code[i + 3].arg };
+            for (int j = i + 1; j < i + 4; j++) remap[j] = k;
+            chunk->lines[k] = chunk->lines[i];
+            code[k++] = fused;
+            i += 4;
+            continue;
+        }
+
+        // LOAD a; CONST c; BINARY +-*; STORE a -> UPDATE_VAR
+        if (interior_free && in.op == OP_LOAD && code[i + 1].op == OP_CONST &&
+            code[i + 2].op == OP_BINARY &&
+            (code[i + 2].binary == '+' || code[i + 2].binary == '-' || code[i + 2].binary == '*') &&
+            code[i + 3].op == OP_STORE && code[i + 3].arg == in.arg) {
+            Instr fused = { OP_UPDATE_VAR, code[i + 2].binary, in.stmt, in.arg, code[i + 1].arg, 0 };
+            for (int j = i + 1; j < i + 4; j++) remap[j] = k;
+            chunk->lines[k] = chunk->lines[i];
+            code[k++] = fused;
+            i += 4;
+            continue;
+        }
+
+        chunk->lines[k] = chunk->lines[i];
+        code[k++] = in;
+        i++;
+    }
+    remap[n] = k;
+
+    for (int i = 0; i < k; i++){
+        switch (code[i].op){
+            case OP_JUMP: case OP_JUMP_IF_FALSE: case OP_LOOP:
+                code[i].arg = remap[code[i].arg];
+                break;
+            case OP_TEST_VAR_CONST: case OP_TEST_VAR_VAR: case OP_FOR_PREP: case OP_FOR_LOOP:
+                code[i].arg3 = remap[code[i].arg3];
+                break;
+            case OP_CACHE_LOAD:
+                code[i].arg2 = remap[code[i].arg2];
+                break;
+            default:
+                break;
+        }
+    }
+    chunk->resume = remap[chunk->resume];
+    chunk->count = k;
+    free(target);
+    free(remap);
+}
+
+// Appends the pair counts of this run to a profile file, one
+// "PREV NEXT COUNT" line per pair that occurred.
+int write_pair_profile(const char* path){
+    FILE* file = fopen(path, "a");
+    if (!file){
+        perror("Failed to open pair profile");
+        return 0;
+    }
+    for (int a = 0; a < OP_COUNT; a++){
+        for (int b = 0; b < OP_COUNT; b++){
+            if (pair_counts[a][b]){
+                fprintf(file, "%s %s %llu\n", opcode_name(a), opcode_name(b), pair_counts[a][b]);
+            }
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+static int opcode_by_name(const char* name){
+    for (int op = 0; op < OP_COUNT; op++){
+        if (strcmp(opcode_name(op), name) == 0) return op;
+    }
+    return -1;
+}
+
+typedef struct {
+    int prev, next;
+    unsigned long long count;
+} PairCount;
+
+static int by_count(const void* a, const void* b){
+    unsigned long long x = ((const PairCount*)a)->count, y = ((const PairCount*)b)->count;
+    return (x < y) - (x > y);
+}
+
+static const char* fusion_note(int prev, int next){
+    if ((prev == OP_LOAD && (next == OP_CONST || next == OP_LOAD)) ||
+        (prev == OP_CONST && next == OP_BINARY) ||
+        (prev == OP_BINARY && (next == OP_JUMP_IF_FALSE || next == OP_STORE))) {
+        return "part of TEST_VAR_*/UPDATE_VAR";
+    }
+    return "candidate";
+}
+
+// Offline mode: merges one or more comma separated pair profiles and ranks
+// the pairs by the dispatches a fused instruction would save.
+int fusion_report(const char* paths){
+    static unsigned long long totals[OP_COUNT][OP_COUNT];
+    char* list = strdup(paths);
+    int ok = 1;
+    for (char* path = strtok(list, ","); path; path = strtok(NULL, ",")){
+        FILE* file = fopen(path, "r");
+        if (!file){
+            perror(path);
+            ok = 0;
+            continue;
+        }
+        char prev[32], next[32];
+        unsigned long long count;
+        while (fscanf(file, "%31s %31s %llu", prev, next, &count) == 3){
+            int a = opcode_by_name(prev), b = opcode_by_name(next);
+            if (a >= 0 && b >= 0) totals[a][b] += count;
+        }
+        fclose(file);
+    }
+    free(list);
+
+    PairCount pairs[OP_COUNT * OP_COUNT];
+    int count = 0;
+    unsigned long long dispatches = 0;
+    for (int a = 0; a < OP_COUNT; a++){
+        for (int b = 0; b < OP_COUNT; b++){
+            if (!totals[a][b]) continue;
+            pairs[count++] = (PairCount){ a, b, totals[a][b] };
+            dispatches += totals[a][b];
+        }
+    }
+    qsort(pairs, count, sizeof(PairCount), by_count);
+
+    printf(CYN "[FUSION REPORT]" RESET " %llu profiled dispatches\n", dispatches);
+    printf("%-16s %-16s %14s %8s  %s\n", "FIRST", "SECOND", "COUNT", "SAVED", "STATUS");
+    for (int i = 0; i < count && i < 20; i++){
+        printf("%-16s %-16s %14llu %7.2f%%  %s\n", opcode_name(pairs[i].prev), opcode_name(pairs[i].next),
+               pairs[i].count, 100.0 * pairs[i].count / dispatches, fusion_note(pairs[i].prev, pairs[i].next));
+    }
+    return ok;
+}
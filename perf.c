@@ -0,0 +1,133 @@
+// perf.c
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "perf.h"
+#include "timer.h"
+
+#define EVENT_COUNT 6
+
+static const char* event_names[EVENT_COUNT] = {
+    "cycles", "instructions", "branch-misses", "l1d-misses", "llc-misses", "page-faults"
+};
+static const char* phase_names[PHASE_COUNT] = { "lex", "parse", "eval" };
+
+typedef struct {
+    uint64_t value;
+    uint64_t enabled; // time the counter was enabled and actually running,
+    uint64_t running; // used to scale the value when the PMU is multiplexed
+} Reading;
+
+int perf_enabled = 0;
+
+static int fds[EVENT_COUNT];
+static Reading snapshot[EVENT_COUNT];
+static uint64_t snapshot_ns;
+static double totals[PHASE_COUNT][EVENT_COUNT];
+static uint64_t phase_ns[PHASE_COUNT];
+static int phase_calls[PHASE_COUNT];
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static int open_event(uint32_t type, uint64_t config){
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1; // works with perf_event_paranoid up to 2
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void read_event(int i, Reading* out){
+    if (fds[i] < 0 || read(fds[i], out, sizeof *out) != sizeof *out) memset(out, 0, sizeof *out);
+}
+
+int perf_open(){
+    uint64_t l1d = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    uint64_t llc = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    fds[0] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[1] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[2] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    fds[3] = open_event(PERF_TYPE_HW_CACHE, l1d);
+    fds[4] = open_event(PERF_TYPE_HW_CACHE, llc);
+    fds[5] = open_event(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+
+    int opened = 0;
+    for (int i = 0; i < EVENT_COUNT; i++){
+        if (fds[i] < 0) continue;
+        ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        opened++;
+    }
+    perf_enabled = 1; // phase timings are still collected without counters
+    return opened;
+}
+
+void perf_close(){
+    for (int i = 0; i < EVENT_COUNT; i++){
+        if (fds[i] >= 0) close(fds[i]);
+        fds[i] = -1;
+    }
+}
+#else
+static void read_event(int i, Reading* out){
+    memset(out, 0, sizeof *out);
+}
+
+int perf_open(){
+    for (int i = 0; i < EVENT_COUNT; i++) fds[i] = -1;
+    perf_enabled = 1;
+    return 0;
+}
+
+void perf_close(){}
+#endif
+
+void perf_begin(){
+    for (int i = 0; i < EVENT_COUNT; i++) read_event(i, &snapshot[i]);
+    snapshot_ns = timer_ns();
+}
+
+void perf_end(Phase phase){
+    phase_ns[phase] += timer_ns() - snapshot_ns;
+    phase_calls[phase]++;
+    for (int i = 0; i < EVENT_COUNT; i++){
+        Reading now;
+        read_event(i, &now);
+        double value = (double)(now.value - snapshot[i].value);
+        uint64_t running = now.running - snapshot[i].running;
+        uint64_t enabled = now.enabled - snapshot[i].enabled;
+        if (running > 0 && running < enabled) value *= (double)enabled / running;
+        totals[phase][i] += value;
+    }
+}
+
+void perf_write(FILE* out){
+    fprintf(out, "{\n  \"counters\": [");
+    for (int i = 0; i < EVENT_COUNT; i++){
+        fprintf(out, "%s\"%s\"", i ? ", " : "", event_names[i]);
+    }
+    fprintf(out, "],\n  \"available\": [");
+    for (int i = 0; i < EVENT_COUNT; i++){
+        fprintf(out, "%s%s", i ? ", " : "", fds[i] >= 0 ? "true" : "false");
+    }
+    fprintf(out, "],\n  \"phases\": {\n");
+    for (int p = 0; p < PHASE_COUNT; p++){
+        fprintf(out, "    \"%s\": {\"calls\": %d, \"ns\": %llu", phase_names[p], phase_calls[p],
+                (unsigned long long)phase_ns[p]);
+        for (int i = 0; i < EVENT_COUNT; i++){
+            if (fds[i] >= 0) fprintf(out, ", \"%s\": %.0f", event_names[i], totals[p][i]);
+            else fprintf(out, ", \"%s\": null", event_names[i]);
+        }
+        fprintf(out, "}%s\n", p + 1 < PHASE_COUNT ? "," : "");
+    }
+    fprintf(out, "  }\n}\n");
+}
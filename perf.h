@@ -0,0 +1,22 @@
+// perf.h
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdio.h>
+
+typedef enum {
+    PHASE_LEX,
+    PHASE_PARSE, // includes tokenizing the lines of nested blocks
+    PHASE_EVAL,
+    PHASE_COUNT
+} Phase;
+
+extern int perf_enabled;
+
+int perf_open();           // returns the number of counters that could be opened
+void perf_begin();         // snapshot the counters at the start of a phase
+void perf_end(Phase phase); // add everything since perf_begin() to the phase
+void perf_write(FILE* out); // JSON report, counters that are unavailable are null
+void perf_close();
+
+#endif
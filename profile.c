@@ -0,0 +1,222 @@
+// profile.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "profile.h"
+#include "colors.h"
+#include "debug_alloc.h"
+
+#define PROFILE_INTERVAL_US 1000
+#define STACK_TABLE_SIZE 16384 // distinct stacks, power of two
+
+// Samples are aggregated by the signal handler itself into a table that is
+// allocated up front, so the handler never calls malloc or stdio.
+typedef struct {
+    uint64_t count; // 0 = empty slot
+    int depth;
+    int lines[PROFILE_MAX_DEPTH];
+} StackEntry;
+
+volatile int profile_stack[PROFILE_MAX_DEPTH];
+volatile int profile_depth = 0;
+int profiling = 0;
+
+static StackEntry* stacks;
+static volatile uint64_t total_samples;
+static volatile uint64_t dropped_samples;
+static const char* script_file;
+static const char* folded_file;
+
+static void record_sample(){
+    int lines[PROFILE_MAX_DEPTH];
+    int depth = 0;
+    int n = profile_depth;
+    if (n > PROFILE_MAX_DEPTH) n = PROFILE_MAX_DEPTH;
+
+    // a block repeats its construct's line, keep one frame per line
+    uint64_t hash = 1469598103934665603ull;
+    for (int i = 0; i < n; i++){
+        int line = profile_stack[i];
+        if (depth > 0 && lines[depth - 1] == line) continue;
+        lines[depth++] = line;
+        hash = (hash ^ (uint32_t)line) * 1099511628211ull;
+    }
+
+    total_samples++;
+    size_t h = hash & (STACK_TABLE_SIZE - 1);
+    for (int probe = 0; probe < STACK_TABLE_SIZE; probe++){
+        StackEntry* e = &stacks[h];
+        if (e->count == 0){
+            e->depth = depth;
+            memcpy(e->lines, lines, depth * sizeof(int));
+            e->count = 1;
+            return;
+        }
+        if (e->depth == depth && memcmp(e->lines, lines, depth * sizeof(int)) == 0){
+            e->count++;
+            return;
+        }
+        h = (h + 1) & (STACK_TABLE_SIZE - 1);
+    }
+    dropped_samples++;
+}
+
+static char** load_source(int* count){
+    FILE* file = fopen(script_file, "r");
+    *count = 0;
+    if (!file) return NULL;
+    int capacity = 256;
+    char** source = malloc(capacity * sizeof(char*));
+    char buffer[1024];
+    while (fgets(buffer, sizeof buffer, file)){
+        buffer[strcspn(buffer, "\r\n")] = '\0';
+        char* text = buffer;
+        while (*text == ' ' || *text == '\t') text++;
+        if (*count == capacity){
+            capacity *= 2;
+            source = realloc(source, capacity * sizeof(char*));
+        }
+        source[(*count)++] = strdup(text);
+    }
+    fclose(file);
+    return source;
+}
+
+static const char* source_text(char** source, int count, int line){
+    if (line < 0) line = -line;
+    return line >= 1 && line <= count ? source[line - 1] : "";
+}
+
+static void write_folded(char** source, int count){
+    FILE* out = fopen(folded_file, "w");
+    if (!out){
+        perror("Failed to write folded stacks");
+        return;
+    }
+    const char* base = strrchr(script_file, '/');
+    base = base ? base + 1 : script_file;
+    for (int i = 0; i < STACK_TABLE_SIZE; i++){
+        StackEntry* e = &stacks[i];
+        if (!e->count) continue;
+        fprintf(out, "%s", base);
+        if (e->depth == 0) fprintf(out, ";[interpreter]");
+        for (int d = 0; d < e->depth; d++){
+            int line = e->lines[d];
+            fprintf(out, ";%d: ", line < 0 ? -line : line);
+            // ';' separates frames, so it cannot appear in a frame name
+            for (const char* c = source_text(source, count, line); *c; c++) fputc(*c == ';' ? ',' : *c, out);
+            if (line < 0) fprintf(out, " [bytecode]");
+        }
+        fprintf(out, " %llu\n", (unsigned long long)e->count);
+    }
+    fclose(out);
+}
+
+typedef struct {
+    int line;
+    uint64_t self;
+    uint64_t total;
+} LineSamples;
+
+static int compare_lines(const void* a, const void* b){
+    const LineSamples* x = a;
+    const LineSamples* y = b;
+    if (x->self != y->self) return x->self < y->self ? 1 : -1;
+    if (x->total != y->total) return x->total < y->total ? 1 : -1;
+    return x->line - y->line;
+}
+
+void profile_report(FILE* out){
+    if (!stacks) return;
+    int count;
+    char** source = load_source(&count);
+
+    // index 0 holds samples taken outside any statement (parsing, startup)
+    LineSamples* per_line = calloc(count + 1, sizeof(LineSamples));
+    for (int i = 0; i <= count; i++) per_line[i].line = i;
+    for (int i = 0; i < STACK_TABLE_SIZE; i++){
+        StackEntry* e = &stacks[i];
+        if (!e->count) continue;
+        int top = e->depth ? abs(e->lines[e->depth - 1]) : 0;
+        if (top <= count) per_line[top].self += e->count;
+        for (int d = 0; d < e->depth; d++){
+            int line = abs(e->lines[d]);
+            int seen = 0;
+            for (int k = 0; k < d; k++) seen |= abs(e->lines[k]) == line;
+            if (!seen && line <= count) per_line[line].total += e->count;
+        }
+    }
+    per_line[0].total = per_line[0].self;
+    qsort(per_line, count + 1, sizeof(LineSamples), compare_lines);
+
+    double total = total_samples ? (double)total_samples : 1.0;
+    fprintf(out, CYN "\n[PROFILE]" RESET " %llu samples every %d us",
+            (unsigned long long)total_samples, PROFILE_INTERVAL_US);
+    if (dropped_samples) fprintf(out, ", %llu dropped", (unsigned long long)dropped_samples);
+    fprintf(out, "\n%8s %7s %7s %6s  %s\n", "samples", "self", "total", "line", "source");
+    for (int i = 0; i <= count; i++){
+        LineSamples* l = &per_line[i];
+        if (!l->self && !l->total) continue;
+        if (l->line == 0){
+            fprintf(out, "%8llu %6.1f%% %6.1f%% %6s  [interpreter]\n", (unsigned long long)l->self,
+                    l->self * 100.0 / total, l->total * 100.0 / total, "-");
+        }else{
+            fprintf(out, "%8llu %6.1f%% %6.1f%% %6d  %s\n", (unsigned long long)l->self,
+                    l->self * 100.0 / total, l->total * 100.0 / total, l->line, source[l->line - 1]);
+        }
+    }
+
+    if (folded_file){
+        write_folded(source, count);
+        fprintf(out, "folded stacks written to %s\n", folded_file);
+    }
+
+    for (int i = 0; i < count; i++) free(source[i]);
+    free(source);
+    free(per_line);
+}
+
+#ifdef _WIN32
+int profile_start(const char* script_path, const char* folded_path){
+    fprintf(stderr, "--profile is not supported on this platform\n");
+    return 0;
+}
+
+void profile_stop(){}
+#else
+#include <signal.h>
+#include <sys/time.h>
+
+static void on_sigprof(int sig){
+    (void)sig;
+    record_sample();
+}
+
+int profile_start(const char* script_path, const char* folded_path){
+    stacks = calloc(STACK_TABLE_SIZE, sizeof(StackEntry));
+    if (!stacks) return 0;
+    script_file = script_path;
+    folded_file = folded_path;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = on_sigprof;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, NULL) != 0) return 0;
+
+    // ITIMER_PROF counts CPU time, so time blocked on output is not sampled
+    struct itimerval timer = { { 0, PROFILE_INTERVAL_US }, { 0, PROFILE_INTERVAL_US } };
+    if (setitimer(ITIMER_PROF, &timer, NULL) != 0) return 0;
+    profiling = 1;
+    return 1;
+}
+
+void profile_stop(){
+    profiling = 0;
+    struct itimerval timer = { { 0, 0 }, { 0, 0 } };
+    setitimer(ITIMER_PROF, &timer, NULL);
+    signal(SIGPROF, SIG_IGN);
+}
+#endif
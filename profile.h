@@ -0,0 +1,28 @@
+// profile.h
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+
+#define PROFILE_MAX_DEPTH 64
+
+// Lines of the statements being executed, innermost last. eval() pushes
+// and pops; the SIGPROF handler only reads. A negative line marks a loop
+// running in the bytecode tier, and vm_run() keeps the line of its current
+// statement in the frame above it.
+extern volatile int profile_stack[PROFILE_MAX_DEPTH];
+extern volatile int profile_depth;
+extern int profiling;
+
+int profile_start(const char* script_path, const char* folded_path);
+void profile_stop();
+void profile_report(FILE* out);
+
+static inline int profile_push(int line){
+    int depth = profile_depth;
+    if (depth < PROFILE_MAX_DEPTH) profile_stack[depth] = line;
+    profile_depth = depth + 1;
+    return depth;
+}
+
+#endif
@@ -0,0 +1,119 @@
+// scan.h
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Character classes for the lexer, the same as isspace/isalpha/isdigit in
+// the C locale. Bytes above 127 belong to no class.
+#define CC_SPACE 1
+#define CC_DIGIT 2
+#define CC_ALPHA 4 // letters and '_', which may start an identifier
+#define CC_IDENT (CC_ALPHA | CC_DIGIT)
+
+extern const unsigned char char_class[256];
+
+static inline int is_class(char c, int cls){
+    return char_class[(unsigned char)c] & cls;
+}
+
+// Each kernel returns the first position in [p, end) that ends the run,
+// or end. Vector loads never go past end; the tail is scanned a byte at a
+// time. AVX2 is used when the build enables it (-mavx2, -march=native),
+// SSE2 on any x86-64, plain C elsewhere.
+
+#if defined(__AVX2__)
+#define SCAN_WIDTH 32
+typedef __m256i scan_vec;
+#define scan_load(p) _mm256_loadu_si256((const __m256i*)(p))
+#define scan_set1(c) _mm256_set1_epi8(c)
+#define scan_eq(a, b) _mm256_cmpeq_epi8(a, b)
+#define scan_gt(a, b) _mm256_cmpgt_epi8(a, b)
+#define scan_and(a, b) _mm256_and_si256(a, b)
+#define scan_or(a, b) _mm256_or_si256(a, b)
+#define scan_mask(v) ((uint32_t)_mm256_movemask_epi8(v))
+#elif defined(__SSE2__)
+#define SCAN_WIDTH 16
+typedef __m128i scan_vec;
+#define scan_load(p) _mm_loadu_si128((const __m128i*)(p))
+#define scan_set1(c) _mm_set1_epi8(c)
+#define scan_eq(a, b) _mm_cmpeq_epi8(a, b)
+#define scan_gt(a, b) _mm_cmpgt_epi8(a, b)
+#define scan_and(a, b) _mm_and_si128(a, b)
+#define scan_or(a, b) _mm_or_si128(a, b)
+#define scan_mask(v) ((uint32_t)_mm_movemask_epi8(v))
+#endif
+
+#ifdef SCAN_WIDTH
+#define SCAN_ALL ((uint32_t)((1ull << SCAN_WIDTH) - 1))
+
+// lo <= c <= hi, bytewise. Signed compares: bytes above 127 never match.
+static inline scan_vec scan_range(scan_vec v, char lo, char hi){
+    return scan_and(scan_gt(v, scan_set1(lo - 1)), scan_gt(scan_set1(hi + 1), v));
+}
+
+static inline scan_vec scan_ident_vec(scan_vec v){
+    scan_vec lower = scan_or(v, scan_set1(0x20)); // folds A-Z onto a-z
+    return scan_or(scan_or(scan_range(v, '0', '9'), scan_range(lower, 'a', 'z')), scan_eq(v, scan_set1('_')));
+}
+#endif
+
+// [A-Za-z0-9_]*
+static inline const char* scan_ident(const char* p, const char* end){
+#ifdef SCAN_WIDTH
+    while (end - p >= SCAN_WIDTH){
+        uint32_t stop = ~scan_mask(scan_ident_vec(scan_load(p))) & SCAN_ALL;
+        if (stop) return p + __builtin_ctz(stop);
+        p += SCAN_WIDTH;
+    }
+#endif
+    while (p < end && is_class(*p, CC_IDENT)) p++;
+    return p;
+}
+
+// [0-9]*
+static inline const char* scan_digits(const char* p, const char* end){
+#ifdef SCAN_WIDTH
+    while (end - p >= SCAN_WIDTH){
+        uint32_t stop = ~scan_mask(scan_range(scan_load(p), '0', '9')) & SCAN_ALL;
+        if (stop) return p + __builtin_ctz(stop);
+        p += SCAN_WIDTH;
+    }
+#endif
+    while (p < end && is_class(*p, CC_DIGIT)) p++;
+    return p;
+}
+
+// ' '*
+static inline const char* scan_spaces(const char* p, const char* end){
+#ifdef SCAN_WIDTH
+    while (end - p >= SCAN_WIDTH){
+        uint32_t stop = ~scan_mask(scan_eq(scan_load(p), scan_set1(' '))) & SCAN_ALL;
+        if (stop) return p + __builtin_ctz(stop);
+        p += SCAN_WIDTH;
+    }
+#endif
+    while (p < end && *p == ' ') p++;
+    return p;
+}
+
+// The next quote or backslash inside a string literal
+static inline const char* scan_string(const char* p, const char* end, char quote){
+#ifdef SCAN_WIDTH
+    scan_vec q = scan_set1(quote);
+    scan_vec backslash = scan_set1('\\');
+    while (end - p >= SCAN_WIDTH){
+        scan_vec v = scan_load(p);
+        uint32_t hit = scan_mask(scan_or(scan_eq(v, q), scan_eq(v, backslash)));
+        if (hit) return p + __builtin_ctz(hit);
+        p += SCAN_WIDTH;
+    }
+#endif
+    while (p < end && *p != quote && *p != '\\') p++;
+    return p;
+}
+
+#endif
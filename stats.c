@@ -0,0 +1,244 @@
+// stats.c
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "stats.h"
+#include "lexer.h"
+#include "ast.h"
+#include "interpreter.h"
+#include "context.h"
+#include "tier.h"
+#include "timer.h"
+#include "gc.h"
+#include "colors.h"
+
+int stats_enabled = 0;
+
+static const char* op_names[STAT_OPS] = { "+", "-", "*", "/", ">", "<", ">=", "==", "<=", "!=", "and", "or", "not", "in" };
+
+// The position in op_names plus one, so every other character is 0.
+const unsigned char stats_op_index[256] = {
+    ['+'] = 1, ['-'] = 2, ['*'] = 3, ['/'] = 4, ['>'] = 5, ['<'] = 6, ['g'] = 7,
+    ['e'] = 8, ['l'] = 9, ['n'] = 10, ['&'] = 11, ['|'] = 12, ['!'] = 13, ['i'] = 14,
+};
+
+#ifdef _WIN32
+long stats_peak_rss_kb(){
+    return 0;
+}
+#else
+#include <sys/resource.h>
+
+long stats_peak_rss_kb(){
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+}
+#endif
+
+static uint64_t total_ops(Stats* stats){
+    uint64_t total = 0;
+    for (int o = 0; o < STAT_OPS; o++)
+        for (int l = 0; l < STAT_TYPES; l++)
+            for (int r = 0; r < STAT_TYPES; r++) total += stats->ops[o][l][r];
+    return total;
+}
+
+void stats_print(Interpreter* interp){
+    FILE* out = interp->out;
+    Stats* stats = &interp->stats;
+    fprintf(out, CYN "\n[STATS]\n" RESET);
+    fprintf(out, "statements     : %llu\n", (unsigned long long)stats->statements);
+    fprintf(out, "calls          : %llu\n", (unsigned long long)stats->calls);
+    fprintf(out, "operator evals : %llu\n", (unsigned long long)total_ops(stats));
+    for (int o = 0; o < STAT_OPS; o++){
+        for (int l = 0; l < STAT_TYPES; l++){
+            for (int r = 0; r < STAT_TYPES; r++){
+                if (!stats->ops[o][l][r]) continue;
+                fprintf(out, "  %-3s %-7s %-7s : %llu\n", op_names[o], datatype_name(l), datatype_name(r),
+                        (unsigned long long)stats->ops[o][l][r]);
+            }
+        }
+    }
+    fprintf(out, "lookups        : %llu (avg probe %.2f, longest %llu)\n", (unsigned long long)stats->lookups,
+            stats->lookups ? (double)stats->probes / stats->lookups : 0.0, (unsigned long long)stats->longest_probe);
+    fprintf(out, "inline caches  : %llu hits, %llu misses\n", (unsigned long long)stats->cache_hits,
+            (unsigned long long)stats->cache_misses);
+    fprintf(out, "cycle collector: %llu runs, %llu freed\n", (unsigned long long)stats->cycle_collections,
+            (unsigned long long)stats->cycle_freed);
+    if (interp->gc_config.enabled && !stats->gc_nursery_size){
+        fprintf(out, "memory manager : generational (nothing allocated)\n");
+    } else if (interp->gc_config.enabled){
+        static const char* pages[] = {"", ", huge pages", ", transparent huge pages"};
+        fprintf(out, "memory manager : generational (nursery %zu kB, old generation up to %zu MB%s)\n",
+                stats->gc_nursery_size / 1024, stats->gc_old_size >> 20, pages[stats->gc_huge_pages]);
+        fprintf(out, "gc collections : %llu minor, %llu major\n", (unsigned long long)stats->gc_minor,
+                (unsigned long long)stats->gc_major);
+        fprintf(out, "gc heap        : %llu kB allocated, %llu kB promoted\n",
+                (unsigned long long)(stats->gc_allocated / 1024), (unsigned long long)(stats->gc_promoted / 1024));
+    } else {
+        fprintf(out, "memory manager : reference counting\n");
+    }
+    uint64_t eval_ns = interp->tier_stats.eval_ns;
+    fprintf(out, "gc pauses      : %.3f ms total, %.3f ms longest, %.1f%% of run time\n", stats->gc_pause_ns / 1e6,
+            stats->gc_max_pause_ns / 1e6, eval_ns ? 100.0 * stats->gc_pause_ns / eval_ns : 0.0);
+    fprintf(out, "string bytes   : %llu allocated, %llu copied\n", (unsigned long long)stats->string_allocated,
+            (unsigned long long)stats->string_copied);
+    fprintf(out, "tokens         : %llu\n", (unsigned long long)stats->tokens);
+    fprintf(out, "nodes          : %llu\n", (unsigned long long)stats->nodes);
+    fprintf(out, "peak rss       : %ld kB\n", stats_peak_rss_kb());
+}
+
+static uint64_t stream_start;
+static Interpreter* stream_interp;
+
+// The counters a snapshot lists, in order.
+static const char* snapshot_names[] = {
+    "statements", "calls", "op_evals", "dispatches", "lookups", "probes", "cache_hits", "cache_misses",
+    "cycle_collections", "cycle_freed", "gc_minor", "gc_major", "gc_allocated", "gc_promoted",
+    "gc_pause_ns", "gc_max_pause_ns", "string_allocated", "string_copied", "tokens", "nodes",
+};
+#define SNAPSHOT_FIELDS (int)(sizeof snapshot_names / sizeof snapshot_names[0])
+
+static void snapshot_values(Interpreter* interp, uint64_t* values){
+    Stats* stats = &interp->stats;
+    uint64_t fields[] = {
+        stats->statements, stats->calls, total_ops(stats), interp->tier_stats.dispatches,
+        stats->lookups, stats->probes, stats->cache_hits, stats->cache_misses,
+        stats->cycle_collections, stats->cycle_freed, stats->gc_minor, stats->gc_major,
+        stats->gc_allocated, stats->gc_promoted, stats->gc_pause_ns, stats->gc_max_pause_ns,
+        stats->string_allocated, stats->string_copied, stats->tokens, stats->nodes,
+    };
+    memcpy(values, fields, sizeof fields);
+}
+
+// What the interpreter last published for the stream thread, and when.
+static uint64_t published[SNAPSHOT_FIELDS];
+static uint64_t published_ns;
+int stats_publish_due;
+
+void stats_publish(Interpreter* interp){
+    if (interp != stream_interp) return;
+    uint64_t values[SNAPSHOT_FIELDS];
+    snapshot_values(interp, values);
+    for (int i = 0; i < SNAPSHOT_FIELDS; i++) __atomic_store_n(&published[i], values[i], __ATOMIC_RELAXED);
+    __atomic_store_n(&published_ns, timer_ns(), __ATOMIC_RELAXED);
+    __atomic_store_n(&stats_publish_due, 0, __ATOMIC_RELAXED);
+}
+
+// ops, the per-operator counts, are only read by the interpreter's own
+// thread, for the final snapshot.
+static void write_snapshot(int fd, const uint64_t* values, uint64_t ns, Stats* ops){
+    char buf[8192];
+    int n = snprintf(buf, sizeof buf, "{\"t_ms\": %.1f", (ns - stream_start) / 1e6);
+    for (int i = 0; i < SNAPSHOT_FIELDS; i++){
+        n += snprintf(buf + n, sizeof buf - n, ", \"%s\": %llu", snapshot_names[i], (unsigned long long)values[i]);
+    }
+    n += snprintf(buf + n, sizeof buf - n, ", \"peak_rss_kb\": %ld", stats_peak_rss_kb());
+    if (ops){
+        n += snprintf(buf + n, sizeof buf - n, ", \"ops\": {");
+        int first = 1;
+        for (int o = 0; o < STAT_OPS && n < (int)sizeof buf - 128; o++){
+            for (int l = 0; l < STAT_TYPES; l++){
+                for (int r = 0; r < STAT_TYPES; r++){
+                    if (!ops->ops[o][l][r] || n >= (int)sizeof buf - 128) continue;
+                    n += snprintf(buf + n, sizeof buf - n, "%s\"%s %s %s\": %llu", first ? "" : ", ",
+                                  datatype_name(l), op_names[o], datatype_name(r),
+                                  (unsigned long long)ops->ops[o][l][r]);
+                    first = 0;
+                }
+            }
+        }
+        n += snprintf(buf + n, sizeof buf - n, "}");
+    }
+    n += snprintf(buf + n, sizeof buf - n, "}\n");
+    if (n > (int)sizeof buf) n = sizeof buf;
+    write(fd, buf, n);
+}
+
+#ifdef _WIN32
+int stats_stream(Interpreter* interp, int fd, int interval_ms){
+    fprintf(stderr, "--stats-fd is not supported on this platform\n");
+    return 0;
+}
+
+void stats_stream_stop(){}
+#else
+#include <pthread.h>
+#include <time.h>
+
+// The snapshots are written from a separate thread, so the interpreter
+// itself never checks a clock. The thread never reads interp->stats:
+// each time it wakes it asks for fresh counters through
+// stats_publish_due, and the interpreter copies them out with atomic
+// stores at its next safe point. A snapshot therefore shows the counters
+// as of up to one interval before, or longer while the interpreter waits
+// on input; they are approximate, which is fine for watching.
+static pthread_t stream_thread;
+static pthread_mutex_t stream_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stream_wake = PTHREAD_COND_INITIALIZER;
+static int streaming = 0;
+static int stream_fd;
+static int stream_interval_ms;
+
+static void* stream_loop(void* arg){
+    (void)arg;
+    pthread_mutex_lock(&stream_lock);
+    while (streaming){
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += stream_interval_ms / 1000;
+        deadline.tv_nsec += (stream_interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L){
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        // woken early only by stats_stream_stop()
+        if (pthread_cond_timedwait(&stream_wake, &stream_lock, &deadline) != 0 && streaming){
+            uint64_t values[SNAPSHOT_FIELDS];
+            for (int i = 0; i < SNAPSHOT_FIELDS; i++) values[i] = __atomic_load_n(&published[i], __ATOMIC_RELAXED);
+            uint64_t ns = __atomic_load_n(&published_ns, __ATOMIC_RELAXED);
+            write_snapshot(stream_fd, values, ns ? ns : timer_ns(), NULL);
+            __atomic_store_n(&stats_publish_due, 1, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&stream_lock);
+    return NULL;
+}
+
+int stats_stream(Interpreter* interp, int fd, int interval_ms){
+    stream_interp = interp;
+    stream_fd = fd;
+    stream_interval_ms = interval_ms > 0 ? interval_ms : 1000;
+    stream_start = timer_ns();
+    streaming = 1;
+    __atomic_store_n(&stats_publish_due, 1, __ATOMIC_RELAXED);
+    if (pthread_create(&stream_thread, NULL, stream_loop, NULL) != 0){
+        streaming = 0;
+        return 0;
+    }
+    return 1;
+}
+
+void stats_stream_stop(){
+    if (!streaming) return;
+    pthread_mutex_lock(&stream_lock);
+    streaming = 0;
+    pthread_cond_signal(&stream_wake);
+    pthread_mutex_unlock(&stream_lock);
+    pthread_join(stream_thread, NULL);
+    __atomic_store_n(&stats_publish_due, 0, __ATOMIC_RELAXED);
+    uint64_t values[SNAPSHOT_FIELDS];
+    snapshot_values(stream_interp, values);
+    write_snapshot(stream_fd, values, timer_ns(), &stream_interp->stats);
+}
+#endif
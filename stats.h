@@ -0,0 +1,84 @@
+// stats.h
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define STAT_OPS 14 // + - * / > < g e l n & | ! i
+#define STAT_TYPES 11 // DataType values
+
+typedef struct Interpreter Interpreter;
+
+// Each interpreter keeps its own counters (interp->stats).
+// Per-statement, per-token and per-node counters are always bumped. The
+// ones on the lookup and operator paths are only kept while stats_enabled
+// is set (--stats, --stats-fd or debug 2), since they run several times
+// per statement.
+typedef struct {
+    uint64_t statements;     // statements run, on either tier
+    uint64_t calls;          // calls to functions defined with def
+    uint64_t ops[STAT_OPS][STAT_TYPES][STAT_TYPES]; // binary_op() by op, left and right type
+    uint64_t lookups;        // symbol table searches
+    uint64_t probes;         // entries compared during those searches
+    uint64_t longest_probe;
+    uint64_t cache_hits;     // attribute and method sites that found the shape in their inline cache
+    uint64_t cache_misses;
+    uint64_t cycle_collections; // runs of the cycle collector (heap.h)
+    uint64_t cycle_freed;       // lists, dicts and objects it freed
+    uint64_t gc_minor;          // collections of the generational collector (gc.h)
+    uint64_t gc_major;          // those that also swept the old generation
+    uint64_t gc_allocated;      // bytes of cells it allocated
+    uint64_t gc_promoted;       // bytes of them copied to the old generation
+    uint64_t gc_pause_ns;       // time spent in either collector
+    uint64_t gc_max_pause_ns;
+    int gc_huge_pages;          // old generation on hugetlbfs pages (1) or transparent ones (2)
+    size_t gc_nursery_size;     // bytes, as the collector rounded the configured sizes; 0 until it starts
+    size_t gc_old_size;
+    uint64_t string_allocated; // bytes of string buffers created for values
+    uint64_t string_copied;    // bytes copied into them
+    uint64_t tokens;
+    uint64_t nodes;
+} Stats;
+
+extern int stats_enabled;
+extern const unsigned char stats_op_index[256]; // op to its ops index plus one, 0 if not counted
+
+static inline void stats_op(Stats* stats, char op, int left, int right){
+    if (!stats_enabled) return;
+    int i = stats_op_index[(unsigned char)op];
+    if (i) stats->ops[i - 1][left][right]++;
+}
+
+static inline void stats_lookup(Stats* stats, uint64_t probes){
+    if (!stats_enabled) return;
+    stats->lookups++;
+    stats->probes += probes;
+    if (probes > stats->longest_probe) stats->longest_probe = probes;
+}
+
+static inline void stats_string(Stats* stats, uint64_t allocated, uint64_t copied){
+    stats->string_allocated += allocated;
+    stats->string_copied += copied;
+}
+
+static inline void stats_pause(Stats* stats, uint64_t ns){
+    stats->gc_pause_ns += ns;
+    if (ns > stats->gc_max_pause_ns) stats->gc_max_pause_ns = ns;
+}
+
+// Set by the --stats-fd thread when it wants fresh counters; the
+// interpreter publishes them at its next safe point.
+extern int stats_publish_due;
+void stats_publish(Interpreter* interp);
+
+static inline void stats_safe_point(Interpreter* interp){
+    if (__atomic_load_n(&stats_publish_due, __ATOMIC_RELAXED)) stats_publish(interp);
+}
+
+long stats_peak_rss_kb();
+void stats_print(Interpreter* interp);
+int stats_stream(Interpreter* interp, int fd, int interval_ms); // periodic JSON snapshots, one per line
+void stats_stream_stop();                                     // writes a final snapshot
+
+#endif
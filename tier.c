@@ -0,0 +1,127 @@
+// tier.c
+#include <stdio.h>
+#include "lexer.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "function.h"
+#include "interpreter.h"
+#include "context.h"
+#include "timer.h"
+#include "tier.h"
+#include "profile.h"
+#include "hooks.h"
+#include "colors.h"
+#include "debug_alloc.h"
+
+// Short one-off scripts never reach the threshold and pay no compile cost;
+// only loops that keep spinning are handed to the bytecode tier.
+TierConfig tier_config = { .loop_threshold = 64 };
+
+// Called by the tree-walker on every back-edge of a while or for loop. Returns 1
+// once the loop has been compiled and should continue in the bytecode tier.
+int tier_back_edge(Interpreter* interp, ASTNode* node){
+    if (node->construct.hotness < 0 || tier_config.loop_threshold < 0) return 0;
+    if (++node->construct.hotness < tier_config.loop_threshold) return 0;
+
+    int retry = 0;
+    uint64_t start = timer_ns();
+    node->construct.chunk = compile_loop(interp, node, &retry);
+    interp->tier_stats.compile_ns += timer_ns() - start;
+
+    if (!node->construct.chunk){
+        // a branch that has not run yet may still be parsed later
+        node->construct.hotness = retry ? 0 : -1;
+        interp->tier_stats.rejections++;
+        return 0;
+    }
+    interp->tier_stats.promotions++;
+    HOOK(HOOK_BYTECODE, hook_bytecode(interp, node, node->construct.chunk));
+    return 1;
+}
+
+static int run(Interpreter* interp, ASTNode* node, int pc, const Literal* stack, int count){
+    int depth = profiling ? profile_push(-node->line) : 0;
+    uint64_t start = timer_ns();
+    int result = vm_resume(interp, node->construct.chunk, pc, stack, count);
+    interp->tier_stats.vm_ns += timer_ns() - start;
+    if (profiling) profile_depth = depth;
+    return result;
+}
+
+int tier_run(Interpreter* interp, ASTNode* node){
+    return run(interp, node, 0, NULL, 0);
+}
+
+// Continues a for loop in the bytecode tier after the tree-walker has run
+// the iteration with the given counter: the chunk picks up at its back-edge
+// with the loop state on the stack.
+int tier_resume(Interpreter* interp, ASTNode* node, int counter, int stop, int step){
+    Literal state[3];
+    int values[3] = { counter, stop, step };
+    for (int i = 0; i < 3; i++){
+        state[i].datatype = INT;
+        state[i].owns_str = 0;
+        state[i].numeric = values[i];
+    }
+    Chunk* chunk = node->construct.chunk;
+    return run(interp, node, chunk->resume, state, 3);
+}
+
+// Compiles every loop in a tree up front, so running the tree never writes
+// to it: a loop either has its chunk or is marked as rejected. Used for
+// programs shared between interpreters.
+void tier_freeze(Interpreter* interp, ASTNode* node){
+    if (!node) return;
+    switch (node->type){
+        case AST_BLOCK:
+            for (int i = 0; i < node->block.count; i++) tier_freeze(interp, node->block.statements[i]);
+            break;
+        case AST_SCOPE:
+            tier_freeze(interp, node->scope.body);
+            break;
+        case AST_IF:
+        case AST_ELIF:
+        case AST_ELSE:
+            tier_freeze(interp, node->construct.code);
+            tier_freeze(interp, node->construct.next);
+            break;
+        case AST_DEF:
+            tier_freeze(interp, node->function->body);
+            break;
+        case AST_CLASS:
+            tier_freeze(interp, node->classdef.body);
+            break;
+        case AST_WHILE:
+        case AST_FOR:
+            if (!node->construct.chunk && node->construct.hotness >= 0 && tier_config.loop_threshold >= 0){
+                uint64_t start = timer_ns();
+                node->construct.chunk = compile_loop(interp, node, NULL);
+                interp->tier_stats.compile_ns += timer_ns() - start;
+                if (node->construct.chunk){
+                    interp->tier_stats.promotions++;
+                    HOOK(HOOK_BYTECODE, hook_bytecode(interp, node, node->construct.chunk));
+                    break; // nested loops run inside the chunk
+                }
+                interp->tier_stats.rejections++;
+            }
+            if (!node->construct.chunk) node->construct.hotness = -1;
+            tier_freeze(interp, node->construct.code);
+            tier_freeze(interp, node->construct.next);
+            break;
+        default:
+            break;
+    }
+}
+
+void tier_print_stats(Interpreter* interp){
+    FILE* out = interp->out;
+    TierStats* tier_stats = &interp->tier_stats;
+    uint64_t tree_ns = tier_stats->eval_ns - tier_stats->vm_ns - tier_stats->compile_ns;
+    fprintf(out, CYN "\n[TIER STATS]\n" RESET);
+    fprintf(out, "loop threshold : %d back-edges\n", tier_config.loop_threshold);
+    fprintf(out, "promotions     : %d (rejected %d)\n", tier_stats->promotions, tier_stats->rejections);
+    fprintf(out, "tree-walker    : %.3f ms\n", tree_ns / 1e6);
+    fprintf(out, "compile        : %.3f ms\n", tier_stats->compile_ns / 1e6);
+    fprintf(out, "bytecode       : %.3f ms (%llu dispatches, peephole %s)\n", tier_stats->vm_ns / 1e6,
+            (unsigned long long)tier_stats->dispatches, peephole_enabled ? "on" : "off");
+}
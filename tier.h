@@ -0,0 +1,33 @@
+// tier.h
+#ifndef TIER_H
+#define TIER_H
+
+#include <stdint.h>
+
+typedef struct ASTNode ASTNode;
+typedef struct Interpreter Interpreter;
+
+typedef struct {
+    int loop_threshold; // back-edges before a loop is compiled (-1 = never)
+} TierConfig;
+
+// Kept per interpreter (interp->tier_stats)
+typedef struct {
+    uint64_t eval_ns;     // total time spent executing statements
+    uint64_t compile_ns;  // time spent compiling hot loops
+    uint64_t vm_ns;       // time spent in the bytecode tier
+    uint64_t dispatches;  // instructions executed by the VM
+    uint64_t back_edges;  // loop iterations run by the VM
+    int promotions;       // loops moved to the bytecode tier
+    int rejections;       // hot loops the compiler could not handle
+} TierStats;
+
+extern TierConfig tier_config;
+
+int tier_back_edge(Interpreter* interp, ASTNode* node);
+int tier_run(Interpreter* interp, ASTNode* node);
+int tier_resume(Interpreter* interp, ASTNode* node, int counter, int stop, int step);
+void tier_freeze(Interpreter* interp, ASTNode* node);
+void tier_print_stats(Interpreter* interp);
+
+#endif
@@ -0,0 +1,9 @@
+//timer.h
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+uint64_t timer_ns(); // monotonic clock in nanoseconds
+
+#endif
@@ -0,0 +1,137 @@
+// trace.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "trace.h"
+#include "timer.h"
+#include "debug_alloc.h"
+
+#define RING_SIZE 65536 // events, power of two
+#define WRITER_SLEEP_NS 2000000
+
+// Events go through a single-producer single-consumer ring: the
+// interpreter only copies a record and bumps an index, a writer thread
+// formats the JSON. When the writer falls behind, events are dropped and
+// counted rather than stalling the interpreter.
+typedef struct {
+    const char* name;
+    const char* cat;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    int line;
+    int64_t iterations;
+    int64_t back_edges;
+} TraceEvent;
+
+int tracing = 0;
+
+static TraceEvent* ring;
+static _Atomic uint64_t head; // next slot the interpreter writes
+static _Atomic uint64_t tail; // next slot the writer reads
+static _Atomic int stopping;
+static uint64_t dropped;
+static uint64_t origin_ns;
+static FILE* out;
+static char* out_buffer;
+static pthread_t writer;
+static int first_event = 1;
+
+void trace_event(const char* name, const char* cat, uint64_t start_ns, uint64_t end_ns,
+                 int line, int64_t iterations, int64_t back_edges){
+    uint64_t h = atomic_load_explicit(&head, memory_order_relaxed);
+    if (h - atomic_load_explicit(&tail, memory_order_acquire) >= RING_SIZE){
+        dropped++;
+        return;
+    }
+    ring[h & (RING_SIZE - 1)] = (TraceEvent){ name, cat, start_ns, end_ns, line, iterations, back_edges };
+    atomic_store_explicit(&head, h + 1, memory_order_release);
+}
+
+static void write_event(TraceEvent* e){
+    fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f",
+            first_event ? "" : ",", e->name, e->cat, (e->start_ns - origin_ns) / 1e3,
+            (e->end_ns - e->start_ns) / 1e3);
+    first_event = 0;
+    if (e->line < 0 && e->iterations < 0 && e->back_edges < 0){
+        fputc('}', out);
+        return;
+    }
+    const char* sep = "";
+    fprintf(out, ",\"args\":{");
+    if (e->line >= 0){
+        fprintf(out, "\"line\":%d", e->line);
+        sep = ",";
+    }
+    if (e->iterations >= 0){
+        fprintf(out, "%s\"iterations\":%lld", sep, (long long)e->iterations);
+        sep = ",";
+    }
+    if (e->back_edges >= 0) fprintf(out, "%s\"bytecode_iterations\":%lld", sep, (long long)e->back_edges);
+    fprintf(out, "}}");
+}
+
+static int drain(){
+    uint64_t t = atomic_load_explicit(&tail, memory_order_relaxed);
+    uint64_t h = atomic_load_explicit(&head, memory_order_acquire);
+    for (uint64_t i = t; i < h; i++) write_event(&ring[i & (RING_SIZE - 1)]);
+    atomic_store_explicit(&tail, h, memory_order_release);
+    return h != t;
+}
+
+static void* writer_loop(void* arg){
+    (void)arg;
+    struct timespec delay = { 0, WRITER_SLEEP_NS };
+    while (!atomic_load(&stopping)){
+        if (!drain()) nanosleep(&delay, NULL);
+    }
+    drain();
+    return NULL;
+}
+
+int trace_start(const char* path){
+    out = fopen(path, "w");
+    if (!out){
+        perror("Failed to open trace file");
+        return 0;
+    }
+    out_buffer = malloc(1 << 20);
+    if (out_buffer) setvbuf(out, out_buffer, _IOFBF, 1 << 20);
+    ring = malloc(sizeof(TraceEvent) * RING_SIZE);
+    if (!ring){
+        fclose(out);
+        free(out_buffer);
+        out_buffer = NULL;
+        return 0;
+    }
+    origin_ns = timer_ns();
+    fprintf(out, "{\"traceEvents\":[");
+    fprintf(out, "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"minipy\"}}");
+    first_event = 0;
+    if (pthread_create(&writer, NULL, writer_loop, NULL) != 0){
+        fclose(out);
+        free(out_buffer);
+        out_buffer = NULL;
+        free(ring);
+        ring = NULL;
+        return 0;
+    }
+    tracing = 1;
+    return 1;
+}
+
+void trace_stop(){
+    if (!tracing) return;
+    tracing = 0;
+    atomic_store(&stopping, 1);
+    pthread_join(writer, NULL);
+    fprintf(out, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_events\":%llu}}\n",
+            (unsigned long long)dropped);
+    fclose(out);
+    free(out_buffer);
+    free(ring);
+    if (dropped) fprintf(stderr, "trace: %llu events dropped, the writer could not keep up\n",
+                         (unsigned long long)dropped);
+}
@@ -0,0 +1,18 @@
+// trace.h
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+extern int tracing;
+
+int trace_start(const char* path);
+void trace_stop();
+
+// Records a complete event from start_ns to end_ns (timer_ns() values).
+// name and cat must be string literals, the writer reads them later.
+// line, iterations and back_edges are left out of the args when negative.
+void trace_event(const char* name, const char* cat, uint64_t start_ns, uint64_t end_ns,
+                 int line, int64_t iterations, int64_t back_edges);
+
+#endif
@@ -0,0 +1,441 @@
+// vm.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lexer.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "interpreter.h"
+#include "error_handling.h"
+#include "context.h"
+#include "tier.h"
+#include "optimize.h"
+#include "hooks.h"
+#include "profile.h"
+#include "list.h"
+#include "dict.h"
+#include "function.h"
+#include "heap.h"
+#include "object.h"
+#include "debug_alloc.h"
+
+// Values pushed by OP_LOAD and OP_LOAD_LOCAL are borrowed from the symbol
+// table or the call's frame; they never outlive the expression that loaded
+// them (which a call cannot rebind, see function.h), so only results that
+// own their string need to be released. Stack slots are released in place, so after
+// an error every slot still marked as owning is a live value.
+static void release(Interpreter* interp, Literal* lit){
+    release_literal(interp, lit);
+}
+
+static int as_number(Literal lit, float* out){
+    switch (lit.datatype){
+        case INT: *out = (float)lit.numeric; return 1;
+        case FLOAT: *out = lit.floating_point; return 1;
+        case BOOLEAN: *out = (float)lit.boolean; return 1;
+        default: return 0;
+    }
+}
+
+// Fast path of binary_op() for comparisons between numbers; the same
+// float conversion is used so results are identical.
+static int test(Interpreter* interp, char op, Literal left, Literal right){
+    float l, r;
+    if (as_number(left, &l) && as_number(right, &r)){
+        switch (op){
+            case '>': return l > r;
+            case '<': return l < r;
+            case 'g': return l >= r;
+            case 'e': return l == r;
+            case 'l': return l <= r;
+            case 'n': return l != r;
+        }
+    }
+    Literal result;
+    binary_op(interp, op, left, right, &result);
+    int truthy = is_truthy(result);
+    release(interp, &result);
+    return truthy;
+}
+
+// Moves call arguments to interp->stack, which owns them from then on.
+static void move_args(Interpreter* interp, Literal* args, int count){
+    for (int i = 0; i < count; i++){
+        Literal arg = args[i].owns_str ? args[i] : copy_literal(interp, args[i]);
+        args[i].owns_str = 0;
+        stack_push(interp, arg);
+    }
+}
+
+static Variable* lookup(Interpreter* interp, const char* name){
+    Variable* var = find_variable(interp, name);
+    if (!var) get_variable(interp, name); // raises the NameError
+    return var;
+}
+
+// Writes the counter of a for loop to its local slot or variable.
+static inline void set_counter(Interpreter* interp, Chunk* chunk, Instr in, int value){
+    if (in.arg2) set_int_local(interp, in.arg2 - 1, value);
+    else set_int_variable(interp, chunk->names[in.arg], value);
+}
+
+static void free_stack(Interpreter* interp, Literal* stack, int size){
+    for (int i = 0; i < size; i++) release(interp, &stack[i]);
+    free(stack);
+}
+
+// Runs a compiled chunk. Returns FLOW_BREAK if it ended on a 'break' that
+// belongs to an enclosing loop, FLOW_RETURN on a 'return', FLOW_NEXT
+// otherwise. Errors unwind to the caller's frame.
+int vm_run(Interpreter* interp, Chunk* chunk){
+    return vm_resume(interp, chunk, 0, NULL, 0);
+}
+
+// Runs a chunk from start with count values already on the stack (borrowed,
+// so they must not own anything).
+int vm_resume(Interpreter* interp, Chunk* chunk, int start, const Literal* state, int count){
+    int stack_size = chunk->max_stack > count ? chunk->max_stack : count > 0 ? count : 1;
+    Literal* stack = calloc(stack_size, sizeof(Literal));
+    if (!stack){
+        raiseError(interp, MEMORY_ERROR, "Out of memory");
+        return 0;
+    }
+    RootRange roots = {stack, stack_size, interp->vm_roots};
+    interp->vm_roots = &roots;
+    ErrorFrame frame;
+    error_push(interp, &frame);
+    if (setjmp(frame.env)){
+        interp->vm_roots = roots.next;
+        free_stack(interp, stack, stack_size);
+        error_throw(interp);
+    }
+    for (int i = 0; i < count; i++) stack[i] = state[i];
+    Literal* sp = stack + count;
+    Instr* code = chunk->code;
+    int* lines = chunk->lines;
+    int line = interp->error_line;
+    // with --profile, a frame above tier_run's holding the statement
+    // being run, so samples are charged to real lines
+    int depth = profiling ? profile_push(lines[start]) : 0;
+    int pc = start;
+    int result = 0;
+    int prev = -1;
+    unsigned long long dispatches = 0;
+    unsigned long long back_edges = 0;
+
+    while (1){
+        // errors raised by this instruction report its statement's line
+        interp->error_line = lines[pc];
+        Instr in = code[pc++];
+        dispatches++;
+        if (in.stmt){
+            interp->stats.statements++;
+            if (profiling && depth < PROFILE_MAX_DEPTH) profile_stack[depth] = lines[pc - 1];
+        }
+        if (pair_profile_enabled){
+            if (prev >= 0) pair_counts[prev][in.op]++;
+            prev = in.op;
+        }
+        switch (in.op){
+            case OP_CONST:
+                *sp = chunk->constants[in.arg];
+                sp->owns_str = 0;
+                sp++;
+                break;
+
+            case OP_LOAD: {
+                Literal lit = get_variable(interp, chunk->names[in.arg]);
+                lit.owns_str = 0;
+                *sp++ = lit;
+                break;
+            }
+
+            case OP_STORE:
+                sp--;
+                set_variable(interp, chunk->names[in.arg], *sp);
+                release(interp, sp);
+                break;
+
+            case OP_LOAD_LOCAL: {
+                Literal lit = get_local(interp, in.arg, chunk->names[in.arg2]);
+                lit.owns_str = 0;
+                *sp++ = lit;
+                break;
+            }
+
+            case OP_STORE_LOCAL:
+                sp--;
+                set_local(interp, in.arg, *sp);
+                release(interp, sp);
+                break;
+
+            case OP_BINARY: {
+                Literal* right = --sp;
+                Literal* left = sp - 1;
+                Literal out;
+                binary_op(interp, in.binary, *left, *right, &out);
+                release(interp, left);
+                release(interp, right);
+                *left = out;
+                break;
+            }
+
+            case OP_PRINT:
+                sp--;
+                fprint_literal(interp->out, *sp);
+                release(interp, sp);
+                break;
+
+            case OP_LOOP:
+                back_edges++;
+                heap_safe_point(interp);
+                stats_safe_point(interp);
+                // the condition is charged to the loop header
+                if (profiling && depth < PROFILE_MAX_DEPTH) profile_stack[depth] = lines[pc - 1];
+                pc = in.arg;
+                break;
+
+            case OP_JUMP:
+                pc = in.arg;
+                break;
+
+            case OP_JUMP_IF_FALSE: {
+                sp--;
+                int truthy = is_truthy(*sp);
+                release(interp, sp);
+                if (!truthy) pc = in.arg;
+                break;
+            }
+
+            case OP_CACHE_LOAD: {
+                CacheSlot* slot = &interp->cse_slots[in.arg];
+                if (slot->valid){
+                    *sp++ = copy_literal(interp, slot->value);
+                    pc = in.arg2;
+                }
+                break;
+            }
+
+            case OP_CACHE_STORE: {
+                CacheSlot* slot = &interp->cse_slots[in.arg];
+                slot->value = copy_literal(interp, sp[-1]);
+                slot->valid = 1;
+                break;
+            }
+
+            case OP_CACHE_CLEAR:
+                cse_clear(interp, in.arg, in.arg2);
+                break;
+
+            case OP_BUILD_LIST: {
+                Literal* items = sp - in.arg;
+                List* list = list_from(interp, items, in.arg);
+                for (int i = 0; i < in.arg; i++) release(interp, &items[i]);
+                sp = items;
+                sp->datatype = LIST;
+                sp->list = list;
+                sp->owns_str = 1;
+                sp++;
+                break;
+            }
+
+            case OP_BUILD_DICT: {
+                Literal* items = sp - 2 * in.arg;
+                Dict* dict = dict_from(interp, items, in.arg);
+                for (int i = 0; i < 2 * in.arg; i++) release(interp, &items[i]);
+                sp = items;
+                sp->datatype = DICT;
+                sp->dict = dict;
+                sp->owns_str = 1;
+                sp++;
+                break;
+            }
+
+            case OP_INDEX: {
+                Literal* index = --sp;
+                Literal* target = sp - 1;
+                Literal out;
+                index_get(interp, *target, *index, &out);
+                release(interp, target);
+                release(interp, index);
+                *target = out;
+                break;
+            }
+
+            case OP_STORE_INDEX:
+                sp -= 3;
+                index_assign(interp, in.binary ? in.binary : '=', sp[0], sp[1], sp[2]);
+                release(interp, &sp[0]);
+                release(interp, &sp[1]);
+                release(interp, &sp[2]);
+                break;
+
+            case OP_CALL: {
+                Literal* args = sp - in.arg;
+                Literal out;
+                if (in.arg2 == BUILTIN_NONE){
+                    // the arguments move to the new frame
+                    Literal callee;
+                    int base = call_begin(interp, chunk->names[in.arg3], &callee);
+                    move_args(interp, args, in.arg);
+                    sp = args;
+                    call_end(interp, callee, base, &out);
+                    *sp++ = out;
+                    break;
+                }
+                call_builtin(interp, in.arg2, chunk->names[in.arg3], 0, args, in.arg, &out);
+                for (int i = 0; i < in.arg; i++) release(interp, &args[i]);
+                sp = args;
+                *sp++ = out;
+                break;
+            }
+
+            case OP_CALL_METHOD: {
+                Literal* args = sp - in.arg;
+                Literal out;
+                if (args[0].datatype == OBJECT){
+                    int base = interp->stack_top;
+                    move_args(interp, args, in.arg);
+                    sp = args;
+                    call_method(interp, chunk->names[in.arg3], in.arg2, base, &out);
+                    *sp++ = out;
+                    break;
+                }
+                call_builtin(interp, in.binary, chunk->names[in.arg3], 1, args, in.arg, &out);
+                for (int i = 0; i < in.arg; i++) release(interp, &args[i]);
+                sp = args;
+                *sp++ = out;
+                break;
+            }
+
+            case OP_GET_ATTR: {
+                Literal* target = sp - 1;
+                Literal out;
+                attr_get(interp, *target, chunk->names[in.arg], in.arg2, &out);
+                release(interp, target);
+                *target = out;
+                break;
+            }
+
+            case OP_SET_ATTR:
+                sp -= 2;
+                attr_set(interp, in.binary ? in.binary : '=', sp[0], chunk->names[in.arg], in.arg2, sp[1]);
+                release(interp, &sp[0]);
+                release(interp, &sp[1]);
+                break;
+
+            case OP_FOR_PREP: {
+                Literal* base = sp - 3;
+                int bounds[3];
+                range_bounds(interp, base, 3, bounds);
+                for (int i = 0; i < 3; i++){
+                    release(interp, &base[i]);
+                    base[i].datatype = INT;
+                    base[i].numeric = bounds[i];
+                }
+                if (bounds[2] > 0 ? bounds[0] >= bounds[1] : bounds[0] <= bounds[1]){
+                    sp = base;
+                    pc = in.arg3;
+                } else if (in.binary){
+                    set_counter(interp, chunk, in, bounds[0]);
+                }
+                break;
+            }
+
+            case OP_FOR_LOOP: {
+                // counter, stop and step, unboxed ints
+                Literal* base = sp - 3;
+                int step = base[2].numeric;
+                long long next = (long long)base[0].numeric + step;
+                if (step > 0 ? next < base[1].numeric : next > base[1].numeric){
+                    base[0].numeric = (int)next;
+                    if (in.binary) set_counter(interp, chunk, in, (int)next);
+                    back_edges++;
+                    heap_safe_point(interp);
+                    stats_safe_point(interp);
+                    if (profiling && depth < PROFILE_MAX_DEPTH) profile_stack[depth] = lines[pc - 1];
+                    pc = in.arg3;
+                    break;
+                }
+                if (!in.binary) set_counter(interp, chunk, in, base[0].numeric);
+                sp = base;
+                break;
+            }
+
+            case OP_FOR_END:
+                sp -= 3;
+                if (!in.binary) set_counter(interp, chunk, in, sp[0].numeric);
+                break;
+
+            case OP_TEST_VAR_CONST:
+            case OP_TEST_VAR_VAR: {
+                Variable* left = lookup(interp, chunk->names[in.arg]);
+                Literal right;
+                if (in.op == OP_TEST_VAR_CONST){
+                    right = chunk->constants[in.arg2];
+                } else {
+                    right = lookup(interp, chunk->names[in.arg2])->literal;
+                }
+                if (!test(interp, in.binary, left->literal, right)) pc = in.arg3;
+                break;
+            }
+
+            case OP_UPDATE_VAR: {
+                Variable* var = lookup(interp, chunk->names[in.arg]);
+                Literal* lit = &var->literal;
+                Literal k = chunk->constants[in.arg2];
+                if (lit->datatype == INT && k.datatype == INT){
+                    switch (in.binary){
+                        case '+': lit->numeric += k.numeric; break;
+                        case '-': lit->numeric -= k.numeric; break;
+                        case '*': lit->numeric *= k.numeric; break;
+                    }
+                    HOOK(HOOK_VARIABLE, hook_variable(interp, var->name, *lit));
+                    break;
+                }
+                if (lit->datatype == FLOAT && (k.datatype == FLOAT || k.datatype == INT)){
+                    float r = k.datatype == FLOAT ? k.floating_point : (float)k.numeric;
+                    switch (in.binary){
+                        case '+': lit->floating_point += r; break;
+                        case '-': lit->floating_point -= r; break;
+                        case '*': lit->floating_point *= r; break;
+                    }
+                    HOOK(HOOK_VARIABLE, hook_variable(interp, var->name, *lit));
+                    break;
+                }
+                Literal out;
+                binary_op(interp, in.binary, *lit, k, &out);
+                set_variable(interp, chunk->names[in.arg], out);
+                release(interp, &out);
+                break;
+            }
+
+            case OP_BREAK:
+                result = FLOW_BREAK;
+                goto done;
+
+            case OP_RETURN:
+                sp--;
+                interp->returned = sp->owns_str ? *sp : copy_literal(interp, *sp);
+                sp->owns_str = 0;
+                result = FLOW_RETURN;
+                goto done;
+
+            case OP_HALT:
+                goto done;
+
+            case OP_NOP:
+                break;
+        }
+    }
+
+    done:
+        error_pop(interp, &frame);
+        interp->error_line = line;
+        if (profiling) profile_depth = depth;
+        interp->tier_stats.dispatches += dispatches;
+        interp->tier_stats.back_edges += back_edges;
+        interp->vm_roots = roots.next;
+        free_stack(interp, stack, stack_size);
+        return result;
+}